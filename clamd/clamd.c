@@ -476,6 +476,31 @@ int main(int argc, char **argv)
         if (optget(opts, "ForceToDisk")->enabled)
             cl_engine_set_num(engine, CL_ENGINE_FORCETODISK, 1);
 
+        if ((opt = optget(opts, "ScanTrace"))->enabled) {
+            if (scan_trace_open(opt->strarg)) {
+                ret = 1;
+                break;
+            }
+            cl_engine_set_clcb_trace(engine, scan_trace_callback);
+            logg("#Tracing scans to %s.\n", opt->strarg);
+        }
+
+        if (optget(opts, "Telemetry")->enabled) {
+            if ((ret = cl_engine_set_num(engine, CL_ENGINE_TELEMETRY, 1))) {
+                logg("!cl_engine_set_num(CL_ENGINE_TELEMETRY) failed: %s\n", cl_strerror(ret));
+                break;
+            }
+            logg("#Scan telemetry enabled.\n");
+
+            if ((opt = optget(opts, "TelemetrySignatures"))->numarg) {
+                if ((ret = cl_engine_set_num(engine, CL_ENGINE_TELEMETRY_SIGNATURES, opt->numarg))) {
+                    logg("!cl_engine_set_num(CL_ENGINE_TELEMETRY_SIGNATURES) failed: %s\n", cl_strerror(ret));
+                    break;
+                }
+                logg("#Signature profiling enabled, reporting %lld signatures.\n", opt->numarg);
+            }
+        }
+
         if (optget(opts, "PhishingSignatures")->enabled)
             dboptions |= CL_DB_PHISHING;
         else
@@ -561,6 +586,9 @@ int main(int argc, char **argv)
         if (optget(opts, "DisableCertCheck")->enabled)
             cl_engine_set_num(engine, CL_ENGINE_DISABLE_PE_CERTS, 1);
 
+        if (optget(opts, "ImageFastPath")->enabled)
+            cl_engine_set_num(engine, CL_ENGINE_IMAGE_FASTPATH, 1);
+
         logg("#Loaded %u signatures.\n", sigs);
 
         /* pcre engine limits - required for cl_engine_compile */
@@ -68,6 +68,9 @@ extern int progexit;
 extern time_t reloaded_time;
 extern pthread_mutex_t reload_mutex;
 
+static FILE *trace_file = NULL;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 void msg_callback(enum cl_msg severity, const char *fullmsg, const char *msg, void *ctx)
 {
     struct cb_context *c = ctx;
@@ -104,6 +107,27 @@ void hash_callback(int fd, unsigned long long size, const unsigned char *md5, co
     c->virhash[32] = '\0';
 }
 
+int scan_trace_open(const char *path)
+{
+    if (!(trace_file = fopen(path, "a"))) {
+        logg("!Can't open scan trace file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Traces of concurrent scans are written whole, one at a time */
+void scan_trace_callback(const char *trace, size_t len, void *context)
+{
+    UNUSEDPARAM(context);
+
+    pthread_mutex_lock(&trace_mutex);
+    if (fwrite(trace, 1, len, trace_file) != len || fflush(trace_file))
+        logg("^Can't write scan trace: %s\n", strerror(errno));
+    pthread_mutex_unlock(&trace_mutex);
+}
+
 void clamd_virus_found_cb(int fd, const char *virname, void *ctx)
 {
     struct cb_context *c   = ctx;
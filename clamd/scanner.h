@@ -68,5 +68,7 @@ int scan_pathchk(const char *path, struct cli_ftw_cbdata *data);
 void hash_callback(int fd, unsigned long long size, const unsigned char *md5, const char *virname, void *ctx);
 void msg_callback(enum cl_msg severity, const char *fullmsg, const char *msg, void *ctx);
 void clamd_virus_found_cb(int fd, const char *virname, void *context);
+int scan_trace_open(const char *path);
+void scan_trace_callback(const char *trace, size_t len, void *context);
 
 #endif
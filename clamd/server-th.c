@@ -84,6 +84,8 @@ pthread_mutex_t exit_mutex   = PTHREAD_MUTEX_INITIALIZER;
 int reload                   = 0;
 time_t reloaded_time         = 0;
 pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+unsigned int reload_count    = 0; /* successful reloads, protected by reload_mutex */
+double reload_duration       = 0; /* seconds the last reload took, protected by reload_mutex */
 int sighup                   = 0;
 
 static pthread_mutex_t reload_stage_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -910,6 +912,7 @@ int recvloop(int *socketds, unsigned nsockets, struct cl_engine *engine, unsigne
     struct acceptdata acceptdata  = ACCEPTDATA_INIT(&fds_mutex, &recvfds_mutex);
     struct fd_data *fds           = &acceptdata.recv_fds;
     time_t start_time, current_time;
+    struct timeval reload_start = {0, 0}, tv_now;
     unsigned int selfchk;
     threadpool_t *thr_pool;
 
@@ -1085,6 +1088,16 @@ int recvloop(int *socketds, unsigned nsockets, struct cl_engine *engine, unsigne
     val = cl_engine_get_num(engine, CL_ENGINE_MAX_RECHWP3, NULL);
     logg("Limits: MaxRecHWP3 limit set to %llu.\n", val);
 
+    if ((opt = optget(opts, "BudgetReserve"))->active) {
+        if ((ret = cl_engine_set_num(engine, CL_ENGINE_BUDGET_RESERVE, opt->numarg))) {
+            logg("!cli_engine_set_num(BudgetReserve) failed: %s\n", cl_strerror(ret));
+            cl_engine_free(engine);
+            return 1;
+        }
+    }
+    if ((val = cl_engine_get_num(engine, CL_ENGINE_BUDGET_RESERVE, NULL)))
+        logg("Limits: BudgetReserve set to %llu%%.\n", val);
+
     /* options are handled in main (clamd.c) */
     val = cl_engine_get_num(engine, CL_ENGINE_PCRE_MATCH_LIMIT, NULL);
     logg("Limits: PCREMatchLimit limit set to %llu.\n", val);
@@ -1728,6 +1741,7 @@ int recvloop(int *socketds, unsigned nsockets, struct cl_engine *engine, unsigne
                 /* Reloading not already taking place */
                 reload_stage = RELOAD_STAGE__RELOADING;
                 pthread_mutex_unlock(&reload_stage_mutex);
+                gettimeofday(&reload_start, NULL);
                 if (CL_SUCCESS != reload_db(&engine, dboptions, opts, thr_pool)) {
                     logg("^Database reload setup failed, keeping the previous instance\n");
                     pthread_mutex_lock(&reload_mutex);
@@ -1740,6 +1754,8 @@ int recvloop(int *socketds, unsigned nsockets, struct cl_engine *engine, unsigne
                 pthread_mutex_lock(&reload_stage_mutex);
             }
             if (reload_stage == RELOAD_STAGE__NEW_DB_AVAILABLE) {
+                int reloaded = 0;
+
                 /* New database available */
                 if (g_newengine) {
                     /* Reload succeeded */
@@ -1751,13 +1767,17 @@ int recvloop(int *socketds, unsigned nsockets, struct cl_engine *engine, unsigne
                     }
                     engine      = g_newengine;
                     g_newengine = NULL;
+                    reloaded    = 1;
                 } else {
                     logg("^Database reload failed, keeping the previous instance\n");
                 }
                 reload_stage = RELOAD_STAGE__IDLE;
                 pthread_mutex_unlock(&reload_stage_mutex);
+                gettimeofday(&tv_now, NULL);
                 pthread_mutex_lock(&reload_mutex);
                 reload = 0;
+                reload_count += reloaded;
+                reload_duration = (tv_now.tv_sec - reload_start.tv_sec) + (tv_now.tv_usec - reload_start.tv_usec) / 1e6;
                 pthread_mutex_unlock(&reload_mutex);
                 time(&reloaded_time);
             } else {
@@ -45,5 +45,7 @@ void sigsegv(int sig);
 
 extern pthread_mutex_t exit_mutex, reload_mutex;
 extern int progexit, reload;
+extern unsigned int reload_count;
+extern double reload_duration;
 
 #endif
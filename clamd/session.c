@@ -96,7 +96,8 @@ static struct {
     {CMD17, sizeof(CMD17) - 1, COMMAND_INSTREAM, 0, 0, 1},
     {CMD19, sizeof(CMD19) - 1, COMMAND_DETSTATSCLEAR, 0, 1, 1},
     {CMD20, sizeof(CMD20) - 1, COMMAND_DETSTATS, 0, 1, 1},
-    {CMD21, sizeof(CMD21) - 1, COMMAND_ALLMATCHSCAN, 1, 0, 1}};
+    {CMD21, sizeof(CMD21) - 1, COMMAND_ALLMATCHSCAN, 1, 0, 1},
+    {CMD25, sizeof(CMD25) - 1, COMMAND_TELEMETRY, 0, 0, 1}};
 
 enum commands parse_command(const char *cmd, const char **argument, int oldstyle)
 {
@@ -322,7 +323,7 @@ int command(client_conn_t *conn, int *virus)
             thrmgr_setactivetask(NULL, "STATS");
             if (conn->group)
                 mdprintf(desc, "%u: ", conn->id);
-            thrmgr_printstats(desc, conn->term);
+            thrmgr_printstats(desc, conn->term, engine);
             return 0;
         case COMMAND_STREAM:
             thrmgr_setactivetask(NULL, "STREAM");
@@ -500,6 +501,21 @@ static int print_ver(int desc, char term, const struct cl_engine *engine)
     return mdprintf(desc, "ClamAV %s%c", get_version(), term);
 }
 
+static void print_telemetry(int desc, char term, const struct cl_engine *engine)
+{
+    char *report = NULL;
+    cl_error_t ret;
+
+    ret = cl_engine_get_telemetry(engine, &report, 0);
+    if (ret != CL_SUCCESS) {
+        mdprintf(desc, "TELEMETRY: %s. ERROR%c",
+                 ret == CL_EARG ? "Telemetry not enabled" : cl_strerror(ret), term);
+        return;
+    }
+    mdprintf(desc, "%sEND%c", report, term);
+    free(report);
+}
+
 static void print_commands(int desc, char term, const struct cl_engine *engine)
 {
     unsigned i, n;
@@ -547,6 +563,7 @@ int execute_or_dispatch_command(client_conn_t *conn, enum commands cmd, const ch
             case COMMAND_VERSION:
             case COMMAND_PING:
             case COMMAND_STATS:
+            case COMMAND_TELEMETRY:
             case COMMAND_COMMANDS:
                 /* These commands are accepted inside IDSESSION */
                 break;
@@ -591,6 +608,12 @@ int execute_or_dispatch_command(client_conn_t *conn, enum commands cmd, const ch
             print_commands(desc, conn->term, engine);
             return conn->group ? 0 : 1;
         }
+        case COMMAND_TELEMETRY: {
+            if (conn->group)
+                mdprintf(desc, "%u: ", conn->id);
+            print_telemetry(desc, conn->term, engine);
+            return conn->group ? 0 : 1;
+        }
         case COMMAND_DETSTATSCLEAR: {
             /* TODO: tell client this command has been removed */
             return 1;
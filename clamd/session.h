@@ -49,6 +49,8 @@
 #define CMD23 "GET / HTTP/2"
 #define CMD24 ""
 
+#define CMD25 "TELEMETRY"
+
 #include "libclamav/clamav.h"
 #include "shared/optparser.h"
 #include "server.h"
@@ -74,6 +76,7 @@ enum commands {
     COMMAND_COMMANDS,
     COMMAND_DETSTATSCLEAR,
     COMMAND_DETSTATS,
+    COMMAND_TELEMETRY,
     /* internal commands */
     COMMAND_MULTISCANFILE,
     COMMAND_INSTREAMSCAN,
@@ -191,7 +191,43 @@ static void print_queue(int f, work_queue_t *queue, struct timeval *tv_now)
                  (unsigned)queue->item_count);
 }
 
-int thrmgr_printstats(int f, char term)
+/* Scan pipeline counters of the engine serving the STATS command */
+static void print_engine_stats(int f, const struct cl_engine *engine, unsigned int reloads, double reload_time)
+{
+    size_t used, total;
+    uint64_t cache_mem;
+    char *report = NULL, *line, *next;
+
+    mdprintf(f, "ENGINE: scans %llu bytes %llu cache_lookups %llu cache_hits %llu tempfiles %llu\n",
+             cl_engine_get_num(engine, CL_ENGINE_SCANS, NULL),
+             cl_engine_get_num(engine, CL_ENGINE_SCANNED_BYTES, NULL),
+             cl_engine_get_num(engine, CL_ENGINE_CACHE_LOOKUPS, NULL),
+             cl_engine_get_num(engine, CL_ENGINE_CACHE_HITS, NULL),
+             cl_engine_get_num(engine, CL_ENGINE_TEMPFILES, NULL));
+
+    cache_mem = cl_engine_get_num(engine, CL_ENGINE_CACHE_MEMORY, NULL);
+    if (MPOOL_GETSTATS(engine, &used, &total) != -1 && used >= cache_mem)
+        mdprintf(f, "ENGINEMEM: signatures %.3fM cache %.3fM\n",
+                 (used - cache_mem) / (1024 * 1024.0), cache_mem / (1024 * 1024.0));
+    else
+        mdprintf(f, "ENGINEMEM: signatures N/A cache %.3fM\n", cache_mem / (1024 * 1024.0));
+
+    mdprintf(f, "RELOAD: count %u last %.3fs\n", reloads, reload_time);
+
+    /* per file type parse time, only there with Telemetry enabled */
+    if (cl_engine_get_telemetry(engine, &report, 0) != CL_SUCCESS)
+        return;
+    for (line = report; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        if (!strncmp(line, "TYPE: ", 6))
+            mdprintf(f, "%s\n", line);
+    }
+    free(report);
+}
+
+int thrmgr_printstats(int f, char term, const struct cl_engine *engine)
 {
     struct threadpool_list *l;
     unsigned cnt, pool_cnt = 0;
@@ -199,6 +235,13 @@ int thrmgr_printstats(int f, char term)
     float mem_heap = 0, mem_mmap = 0, mem_used = 0, mem_free = 0, mem_releasable = 0;
     const struct cl_engine **seen = NULL;
     int has_libc_memstats         = 0;
+    unsigned int reloads;
+    double reload_time;
+
+    pthread_mutex_lock(&reload_mutex);
+    reloads     = reload_count;
+    reload_time = reload_duration;
+    pthread_mutex_unlock(&reload_mutex);
 
     pthread_mutex_lock(&pools_lock);
     for (cnt = 0, l = pools; l; l = l->nxt) cnt++;
@@ -304,6 +347,8 @@ int thrmgr_printstats(int f, char term)
         else
             mdprintf(f, "MEMSTATS: heap N/A mmap N/A used N/A free N/A releasable N/A pools %u pools_used %.3fM pools_total %.3fM\n",
                      pool_cnt, pool_used / (1024 * 1024.0), pool_total / (1024 * 1024.0));
+        if (engine)
+            print_engine_stats(f, engine, reloads, reload_time);
     }
     mdprintf(f, "END%c", term);
     pthread_mutex_unlock(&pools_lock);
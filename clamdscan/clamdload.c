@@ -0,0 +1,870 @@
+/*
+ *  clamdload - replay a corpus against clamd and measure it under load
+ *
+ *  Copyright (C) 2013-2020 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include "clamav-config.h"
+#endif
+
+/* must be first because it may define _XOPEN_SOURCE */
+#include "shared/fdpassing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "shared/optparser.h"
+#include "shared/misc.h"
+
+#define LOAD_CHUNK 65536
+#define LOAD_REPLY_MAX 4096
+#define LOAD_HIST_BUCKETS 32 /* log2 buckets of microseconds */
+
+enum load_mode {
+    MODE_INSTREAM,
+    MODE_FILDES,
+    MODE_MULTISCAN
+};
+
+struct corpus_file {
+    char *path;
+    size_t len;
+};
+
+/* Replies are read in blocks, whatever follows the current one stays here */
+struct reply_buf {
+    char data[LOAD_REPLY_MAX];
+    size_t off;
+    size_t len;
+};
+
+struct load_result {
+    uint64_t requests;
+    uint64_t clean;
+    uint64_t infected;
+    uint64_t errors;
+    uint64_t bytes;
+    uint32_t *latency; /* usec per request */
+    size_t nlatency;
+    size_t latency_size;
+};
+
+struct load_worker {
+    pthread_t thread;
+    unsigned int id;
+    struct load_result result;
+};
+
+static struct {
+    enum load_mode mode;
+    char *socket_path;
+    struct addrinfo *tcp;
+    unsigned int sessions;
+    double rate; /* requests per second over all sessions, 0 for no limit */
+    double duration;
+    uint64_t max_requests;
+    unsigned int stats_interval; /* msec */
+    struct corpus_file *files;
+    size_t nfiles;
+    size_t files_size;
+    double start;
+    pthread_mutex_t mutex; /* protects stop, issued and stats */
+    int stop;
+    uint64_t issued;
+} load;
+
+/* Filled by the stats thread */
+static struct {
+    uint64_t samples;
+    uint64_t queue_sum;
+    unsigned int queue_max;
+    uint64_t busy_sum;
+    unsigned int busy_max;
+    unsigned int threads_max;
+} stats;
+
+static int load_stopped(void)
+{
+    int stop;
+
+    pthread_mutex_lock(&load.mutex);
+    stop = load.stop;
+    pthread_mutex_unlock(&load.mutex);
+    return stop;
+}
+
+static void load_set_stop(void)
+{
+    pthread_mutex_lock(&load.mutex);
+    load.stop = 1;
+    pthread_mutex_unlock(&load.mutex);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double when)
+{
+    double delta = when - now();
+    struct timespec ts;
+
+    if (delta <= 0)
+        return;
+    ts.tv_sec  = (time_t)delta;
+    ts.tv_nsec = (long)((delta - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+/* ---------------------------------------------------------------------------
+ * Connections
+ */
+
+static int load_connect(void)
+{
+    int sockd;
+
+    if (load.socket_path) {
+        struct sockaddr_un nixsock;
+
+        memset(&nixsock, 0, sizeof(nixsock));
+        nixsock.sun_family = AF_UNIX;
+        strncpy(nixsock.sun_path, load.socket_path, sizeof(nixsock.sun_path) - 1);
+        if ((sockd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+        if (connect(sockd, (struct sockaddr *)&nixsock, sizeof(nixsock)) < 0) {
+            close(sockd);
+            return -1;
+        }
+        return sockd;
+    }
+
+    if ((sockd = socket(load.tcp->ai_family, load.tcp->ai_socktype, load.tcp->ai_protocol)) < 0)
+        return -1;
+    if (connect(sockd, load.tcp->ai_addr, load.tcp->ai_addrlen) < 0) {
+        close(sockd);
+        return -1;
+    }
+    return sockd;
+}
+
+static int send_all(int sockd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len) {
+        ssize_t sent = send(sockd, p, len, 0);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+/* Reads one NUL terminated reply. Returns its length or -1 on error/EOF. */
+static int recv_reply(int sockd, struct reply_buf *rb, char *reply, size_t size)
+{
+    size_t len = 0;
+
+    while (len < size - 1) {
+        if (rb->off == rb->len) {
+            ssize_t got = recv(sockd, rb->data, sizeof(rb->data), 0);
+
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return -1;
+            rb->off = 0;
+            rb->len = got;
+        }
+        if (!(reply[len] = rb->data[rb->off++]))
+            return len;
+        len++;
+    }
+    reply[len] = '\0';
+    return len;
+}
+
+static void count_reply(struct load_result *res, const char *reply)
+{
+    size_t len = strlen(reply);
+
+    if (len >= 5 && !strcmp(reply + len - 5, "FOUND"))
+        res->infected++;
+    else if (len >= 2 && !strcmp(reply + len - 2, "OK"))
+        res->clean++;
+    else
+        res->errors++;
+}
+
+/* The file is read from disk as it is sent, @chunk holds LOAD_CHUNK bytes.
+ * Returns 1 if the file can't be opened, the session is still usable then. */
+static int send_instream(int sockd, const struct corpus_file *file, unsigned char *chunk)
+{
+    unsigned char hdr[4];
+    ssize_t got;
+    int fd, ret = 0;
+
+    if ((fd = open(file->path, O_RDONLY)) < 0)
+        return 1;
+    if (send_all(sockd, "zINSTREAM", 10)) {
+        close(fd);
+        return -1;
+    }
+    while ((got = read(fd, chunk, LOAD_CHUNK)) != 0) {
+        uint32_t nlen;
+
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        nlen = htonl((uint32_t)got);
+        memcpy(hdr, &nlen, sizeof(hdr));
+        if (send_all(sockd, hdr, sizeof(hdr)) || send_all(sockd, chunk, got)) {
+            ret = -1;
+            break;
+        }
+    }
+    close(fd);
+    if (ret)
+        return ret;
+    memset(hdr, 0, sizeof(hdr));
+    return send_all(sockd, hdr, sizeof(hdr));
+}
+
+#ifdef HAVE_FD_PASSING
+/* Returns 1 if the file can't be opened, the session is still usable then */
+static int send_fildes(int sockd, const struct corpus_file *file)
+{
+    struct iovec iov[1];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    unsigned char fdbuf[CMSG_SPACE(sizeof(int))];
+    char dummy[] = "";
+    int fd, ret = 0;
+
+    if ((fd = open(file->path, O_RDONLY)) < 0)
+        return 1;
+    if (send_all(sockd, "zFILDES", 8)) {
+        close(fd);
+        return -1;
+    }
+
+    iov[0].iov_base = dummy;
+    iov[0].iov_len  = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control         = fdbuf;
+    msg.msg_iov             = iov;
+    msg.msg_iovlen          = 1;
+    msg.msg_controllen      = CMSG_LEN(sizeof(int));
+    cmsg                    = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len          = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level        = SOL_SOCKET;
+    cmsg->cmsg_type         = SCM_RIGHTS;
+    *(int *)CMSG_DATA(cmsg) = fd;
+    if (sendmsg(sockd, &msg, 0) == -1)
+        ret = -1;
+    close(fd);
+    return ret;
+}
+#endif
+
+/* MULTISCAN is not valid inside IDSESSION, every request gets its own
+ * connection. Failing to connect ends the run, like failing to open a session. */
+static int run_multiscan(struct load_result *res, const struct corpus_file *file)
+{
+    char reply[LOAD_REPLY_MAX], *cmd;
+    struct reply_buf rb;
+    size_t len = strlen(file->path) + sizeof("zMULTISCAN ");
+    int sockd, ret = 0;
+
+    if ((sockd = load_connect()) < 0) {
+        fprintf(stderr, "Can't connect to clamd: %s\n", strerror(errno));
+        load_set_stop();
+        return -1;
+    }
+    cmd = malloc(len);
+    if (!cmd) {
+        close(sockd);
+        return -1;
+    }
+    snprintf(cmd, len, "zMULTISCAN %s", file->path);
+    if (send_all(sockd, cmd, len)) {
+        ret = -1;
+    } else {
+        /* one reply per infected or failed file, a single OK otherwise */
+        rb.off = rb.len = 0;
+        while (recv_reply(sockd, &rb, reply, sizeof(reply)) >= 0)
+            count_reply(res, reply);
+    }
+    free(cmd);
+    close(sockd);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------
+ * Workers
+ */
+
+static void add_latency(struct load_result *res, double seconds)
+{
+    if (res->nlatency == res->latency_size) {
+        size_t size   = res->latency_size ? res->latency_size * 2 : 4096;
+        uint32_t *lat = realloc(res->latency, size * sizeof(*lat));
+
+        if (!lat)
+            return;
+        res->latency      = lat;
+        res->latency_size = size;
+    }
+    res->latency[res->nlatency++] = seconds > 4294 ? 0xffffffff : (uint32_t)(seconds * 1e6);
+}
+
+/* Returns the index of the next request to send or -1 once the run is over */
+static int64_t next_request(void)
+{
+    int64_t n = -1;
+
+    pthread_mutex_lock(&load.mutex);
+    if (!load.stop && (!load.max_requests || load.issued < load.max_requests))
+        n = load.issued++;
+    pthread_mutex_unlock(&load.mutex);
+    return n;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct load_worker *w   = arg;
+    struct load_result *res = &w->result;
+    char reply[LOAD_REPLY_MAX];
+    struct reply_buf rb;
+    unsigned char *chunk = NULL;
+    int sockd           = -1;
+    int64_t n;
+
+    rb.off = rb.len = 0;
+    if (load.mode == MODE_INSTREAM && !(chunk = malloc(LOAD_CHUNK))) {
+        fprintf(stderr, "Worker %u: can't allocate memory\n", w->id);
+        res->errors++;
+        load_set_stop();
+        return NULL;
+    }
+    if (load.mode != MODE_MULTISCAN) {
+        if ((sockd = load_connect()) < 0 || send_all(sockd, "zIDSESSION", 11)) {
+            fprintf(stderr, "Worker %u: can't open a session: %s\n", w->id, strerror(errno));
+            res->errors++;
+            load_set_stop();
+            if (sockd >= 0)
+                close(sockd);
+            free(chunk);
+            return NULL;
+        }
+    }
+
+    while ((n = next_request()) >= 0) {
+        const struct corpus_file *file = &load.files[n % load.nfiles];
+        double start                   = now();
+        int ret;
+
+        /* open loop: requests leave on schedule and latency counts from the
+         * scheduled time, so a saturated clamd shows up as latency */
+        if (load.rate > 0) {
+            start = load.start + n / load.rate;
+            while (!load_stopped() && now() < start)
+                sleep_until(start - now() > 0.1 ? now() + 0.1 : start);
+            if (load_stopped())
+                break;
+        }
+
+        switch (load.mode) {
+            case MODE_INSTREAM:
+                ret = send_instream(sockd, file, chunk);
+                break;
+#ifdef HAVE_FD_PASSING
+            case MODE_FILDES:
+                ret = send_fildes(sockd, file);
+                break;
+#endif
+            default:
+                ret = run_multiscan(res, file);
+                break;
+        }
+        if (!ret && load.mode != MODE_MULTISCAN) {
+            if (recv_reply(sockd, &rb, reply, sizeof(reply)) < 0)
+                ret = -1;
+            else
+                count_reply(res, reply);
+        }
+
+        res->requests++;
+        if (ret) {
+            res->errors++;
+            if (ret < 0 && load.mode != MODE_MULTISCAN) {
+                fprintf(stderr, "Worker %u: session lost: %s\n", w->id, strerror(errno));
+                break;
+            }
+            continue;
+        }
+        res->bytes += file->len;
+        add_latency(res, now() - start);
+    }
+
+    if (sockd >= 0) {
+        send_all(sockd, "zEND", 5);
+        close(sockd);
+    }
+    free(chunk);
+    return NULL;
+}
+
+/* Samples QUEUE and THREADS from STATS until the run is over */
+static void *stats_thread(void *arg)
+{
+    char buf[LOAD_REPLY_MAX * 4];
+
+    (void)arg;
+    while (!load_stopped()) {
+        unsigned int live, idle, max, queue;
+        size_t len = 0;
+        ssize_t got;
+        const char *p;
+        int sockd;
+
+        if ((sockd = load_connect()) >= 0 && !send_all(sockd, "zSTATS", 7)) {
+            while (len < sizeof(buf) - 1 && (got = recv(sockd, buf + len, sizeof(buf) - 1 - len, 0)) > 0)
+                len += got;
+            buf[len] = '\0';
+            if ((p = strstr(buf, "THREADS: live ")) && sscanf(p, "THREADS: live %u idle %u max %u", &live, &idle, &max) == 3 &&
+                (p = strstr(buf, "QUEUE: ")) && sscanf(p, "QUEUE: %u", &queue) == 1) {
+                pthread_mutex_lock(&load.mutex);
+                stats.samples++;
+                stats.queue_sum += queue;
+                if (queue > stats.queue_max)
+                    stats.queue_max = queue;
+                stats.busy_sum += live - idle;
+                if (live - idle > stats.busy_max)
+                    stats.busy_max = live - idle;
+                stats.threads_max = max;
+                pthread_mutex_unlock(&load.mutex);
+            }
+        }
+        if (sockd >= 0)
+            close(sockd);
+        sleep_until(now() + load.stats_interval / 1000.0);
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Corpus
+ */
+
+static int add_file(const char *path, const struct stat *sb)
+{
+    struct corpus_file *file;
+
+    if (load.nfiles == load.files_size) {
+        size_t size = load.files_size ? load.files_size * 2 : 64;
+
+        file = realloc(load.files, size * sizeof(*file));
+        if (!file)
+            return -1;
+        load.files      = file;
+        load.files_size = size;
+    }
+
+    file = &load.files[load.nfiles];
+    memset(file, 0, sizeof(*file));
+    if (!(file->path = strdup(path)))
+        return -1;
+    file->len = S_ISREG(sb->st_mode) ? sb->st_size : 0;
+
+    if (load.mode == MODE_INSTREAM && access(path, R_OK)) {
+        fprintf(stderr, "Can't read %s\n", path);
+        free(file->path);
+        return 0;
+    }
+
+    load.nfiles++;
+    return 0;
+}
+
+/* Files are replayed one by one for INSTREAM and FILDES, MULTISCAN gets the
+ * paths as given and lets clamd walk directories */
+static int add_path(const char *path)
+{
+    struct stat sb;
+    DIR *dd;
+    struct dirent *dent;
+    int ret = 0;
+
+    if (stat(path, &sb)) {
+        fprintf(stderr, "Can't access %s\n", path);
+        return 0;
+    }
+    if (load.mode == MODE_MULTISCAN || S_ISREG(sb.st_mode))
+        return add_file(path, &sb);
+    if (!S_ISDIR(sb.st_mode) || !(dd = opendir(path)))
+        return 0;
+
+    while (!ret && (dent = readdir(dd))) {
+        char *fname;
+
+        if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, ".."))
+            continue;
+        if (!(fname = malloc(strlen(path) + strlen(dent->d_name) + 2))) {
+            ret = -1;
+            break;
+        }
+        sprintf(fname, "%s/%s", path, dent->d_name);
+        ret = add_path(fname);
+        free(fname);
+    }
+    closedir(dd);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------
+ * Report
+ */
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void report(struct load_worker *workers, double elapsed)
+{
+    struct load_result total;
+    uint64_t hist[LOAD_HIST_BUCKETS];
+    static const double pct[] = {50, 90, 99, 99.9};
+    unsigned int i, b, minb = LOAD_HIST_BUCKETS, maxb = 0;
+    size_t j;
+
+    memset(&total, 0, sizeof(total));
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < load.sessions; i++) {
+        struct load_result *r = &workers[i].result;
+
+        total.requests += r->requests;
+        total.clean += r->clean;
+        total.infected += r->infected;
+        total.errors += r->errors;
+        total.bytes += r->bytes;
+        total.nlatency += r->nlatency;
+    }
+
+    printf("Mode: %s, sessions: %u, rate: ", load.mode == MODE_INSTREAM ? "INSTREAM" : (load.mode == MODE_FILDES ? "FILDES" : "MULTISCAN"), load.sessions);
+    if (load.rate > 0)
+        printf("%.1f/s\n", load.rate);
+    else
+        printf("unlimited\n");
+    printf("Elapsed: %.3f s\n", elapsed);
+    printf("Requests: %llu (clean %llu, infected %llu, errors %llu)\n",
+           (unsigned long long)total.requests, (unsigned long long)total.clean,
+           (unsigned long long)total.infected, (unsigned long long)total.errors);
+    if (elapsed > 0)
+        printf("Throughput: %.1f req/s, %.2f MiB/s\n", total.requests / elapsed,
+               total.bytes / elapsed / (1024 * 1024));
+    if (stats.samples)
+        printf("Clamd queue: avg %.1f max %u, busy threads: avg %.1f max %u of %u (%llu samples)\n",
+               (double)stats.queue_sum / stats.samples, stats.queue_max,
+               (double)stats.busy_sum / stats.samples, stats.busy_max, stats.threads_max,
+               (unsigned long long)stats.samples);
+
+    if (!total.nlatency || !(total.latency = malloc(total.nlatency * sizeof(uint32_t))))
+        return;
+    for (i = 0, j = 0; i < load.sessions; i++) {
+        memcpy(total.latency + j, workers[i].result.latency, workers[i].result.nlatency * sizeof(uint32_t));
+        j += workers[i].result.nlatency;
+    }
+    qsort(total.latency, total.nlatency, sizeof(uint32_t), cmp_u32);
+
+    printf("Latency (usec): min %u", total.latency[0]);
+    for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+        printf(" p%g %u", pct[i], total.latency[(size_t)((total.nlatency - 1) * pct[i] / 100)]);
+    printf(" max %u\n", total.latency[total.nlatency - 1]);
+
+    for (j = 0; j < total.nlatency; j++) {
+        uint32_t v = total.latency[j];
+
+        for (b = 0; v > 1 && b < LOAD_HIST_BUCKETS - 1; b++)
+            v >>= 1;
+        hist[b]++;
+        if (b < minb)
+            minb = b;
+        if (b > maxb)
+            maxb = b;
+    }
+    printf("Latency histogram:\n");
+    for (b = minb; b <= maxb; b++) {
+        unsigned int bar = (unsigned int)(hist[b] * 50 / total.nlatency);
+
+        printf("  < %10llu usec %10llu ", 2ULL << b, (unsigned long long)hist[b]);
+        while (bar--)
+            putchar('#');
+        putchar('\n');
+    }
+    free(total.latency);
+}
+
+static void help(void)
+{
+    printf("\n");
+    printf("                       Clam AntiVirus: Load Generator %s\n", get_version());
+    printf("           By The ClamAV Team: https://www.clamav.net/about.html#credits\n");
+    printf("           (C) 2020 Cisco Systems, Inc.\n");
+    printf("\n");
+    printf("    clamdload [options] [file/directory ...]\n");
+    printf("\n");
+    printf("    --help                 -h         Show this help\n");
+    printf("    --version              -V         Show version\n");
+    printf("    --config-file=FILE     -c FILE    Read clamd's configuration files from FILE\n");
+    printf("    --clamd=SOCKET         -C SOCKET  Connect to /path/to/clamd.socket or host[:port]\n");
+    printf("    --mode=MODE            -m MODE    Send requests with instream (default), fildes or multiscan\n");
+    printf("    --sessions=#n          -j #n      Number of concurrent client sessions (default 4)\n");
+    printf("    --rate=#n              -r #n      Requests per second over all sessions (default: no limit)\n");
+    printf("    --duration=#n          -t #n      Stop after #n seconds (default 10)\n");
+    printf("    --requests=#n          -n #n      Stop after #n requests (default: no limit)\n");
+    printf("    --stats-interval=#n    -S #n      Poll STATS every #n milliseconds, 0 to disable (default 1000)\n");
+    printf("\n");
+    printf("    Files are replayed in a loop until the duration or request count is reached.\n");
+    printf("\n");
+    return;
+}
+
+static int setup_clamd(const struct optstruct *opts)
+{
+    const struct optstruct *opt;
+    struct optstruct *clamd_opts;
+    struct addrinfo hints;
+    char host[256], port[16];
+    int ret;
+
+    strcpy(port, "3310");
+    if ((opt = optget(opts, "clamd"))->enabled) {
+        const char *colon;
+
+        if (strchr(opt->strarg, '/'))
+            return (load.socket_path = strdup(opt->strarg)) ? 0 : -1;
+        strncpy(host, opt->strarg, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        if ((colon = strrchr(opt->strarg, ':')) && !strchr(colon, ']')) {
+            host[colon - opt->strarg] = '\0';
+            strncpy(port, colon + 1, sizeof(port) - 1);
+            port[sizeof(port) - 1] = '\0';
+        }
+    } else {
+        const char *clamd_conf = optget(opts, "config-file")->strarg;
+
+        if ((clamd_opts = optparse(clamd_conf, 0, NULL, 1, OPT_CLAMD, 0, NULL)) == NULL) {
+            fprintf(stderr, "Can't parse clamd configuration file %s\n", clamd_conf);
+            return -1;
+        }
+        if ((opt = optget(clamd_opts, "LocalSocket"))->enabled) {
+            load.socket_path = strdup(opt->strarg);
+            optfree(clamd_opts);
+            return load.socket_path ? 0 : -1;
+        } else if ((opt = optget(clamd_opts, "TCPSocket"))->enabled) {
+            snprintf(port, sizeof(port), "%lld", opt->numarg);
+            strcpy(host, "localhost");
+            if ((opt = optget(clamd_opts, "TCPAddr"))->enabled) {
+                strncpy(host, opt->strarg, sizeof(host) - 1);
+                host[sizeof(host) - 1] = '\0';
+            }
+        } else {
+            fprintf(stderr, "Can't find how to connect to clamd\n");
+            optfree(clamd_opts);
+            return -1;
+        }
+        optfree(clamd_opts);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((ret = getaddrinfo(host, port, &hints, &load.tcp))) {
+        fprintf(stderr, "Can't resolve %s: %s\n", host, gai_strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct optstruct *opts;
+    const struct optstruct *opt;
+    struct load_worker *workers = NULL;
+    pthread_t stats_tid;
+    int stats_running = 0, ret = 2;
+    unsigned int i, started = 0;
+    double elapsed;
+    size_t j;
+
+    if ((opts = optparse(NULL, argc, argv, 1, OPT_CLAMDLOAD, 0, NULL)) == NULL) {
+        fprintf(stderr, "ERROR: Can't parse command line options\n");
+        return 2;
+    }
+
+    if (optget(opts, "help")->enabled) {
+        optfree(opts);
+        help();
+        return 0;
+    }
+
+    if (optget(opts, "version")->enabled) {
+        printf("Clam AntiVirus Load Generator %s\n", get_version());
+        optfree(opts);
+        return 0;
+    }
+
+    opt = optget(opts, "mode");
+    if (!strcmp(opt->strarg, "instream")) {
+        load.mode = MODE_INSTREAM;
+    } else if (!strcmp(opt->strarg, "fildes")) {
+#ifndef HAVE_FD_PASSING
+        fprintf(stderr, "ERROR: File descriptor passing is not supported on this platform\n");
+        goto done;
+#endif
+        load.mode = MODE_FILDES;
+    } else if (!strcmp(opt->strarg, "multiscan")) {
+        load.mode = MODE_MULTISCAN;
+    } else {
+        fprintf(stderr, "ERROR: Unknown mode %s\n", opt->strarg);
+        goto done;
+    }
+
+    load.sessions       = optget(opts, "sessions")->numarg;
+    load.rate           = optget(opts, "rate")->numarg;
+    load.duration       = optget(opts, "duration")->numarg;
+    load.max_requests   = optget(opts, "requests")->numarg;
+    load.stats_interval = optget(opts, "stats-interval")->numarg;
+    if (!load.sessions) {
+        fprintf(stderr, "ERROR: At least one session is needed\n");
+        goto done;
+    }
+    if (!load.duration && !load.max_requests) {
+        fprintf(stderr, "ERROR: Either --duration or --requests must be non-zero\n");
+        goto done;
+    }
+
+    if (setup_clamd(opts))
+        goto done;
+
+    if (opts->filename) {
+        for (i = 0; opts->filename[i]; i++) {
+            char *path = realpath(opts->filename[i], NULL);
+
+            if (!path || add_path(path)) {
+                fprintf(stderr, "ERROR: Can't add %s to the corpus\n", opts->filename[i]);
+                free(path);
+                goto done;
+            }
+            free(path);
+        }
+    }
+    if (!load.nfiles) {
+        fprintf(stderr, "ERROR: No files to replay\n");
+        goto done;
+    }
+
+    if (!(workers = calloc(load.sessions, sizeof(*workers)))) {
+        fprintf(stderr, "ERROR: Can't allocate memory for %u sessions\n", load.sessions);
+        goto done;
+    }
+
+    pthread_mutex_init(&load.mutex, NULL);
+    load.start = now();
+    if (load.stats_interval && !pthread_create(&stats_tid, NULL, stats_thread, NULL))
+        stats_running = 1;
+    for (i = 0; i < load.sessions; i++) {
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i])) {
+            fprintf(stderr, "ERROR: Can't start session %u\n", i);
+            load_set_stop();
+            break;
+        }
+        started++;
+    }
+
+    if (load.duration) {
+        while (now() - load.start < load.duration) {
+            int done;
+
+            sleep_until(now() + 0.1);
+            pthread_mutex_lock(&load.mutex);
+            done = load.stop || (load.max_requests && load.issued >= load.max_requests);
+            pthread_mutex_unlock(&load.mutex);
+            if (done)
+                break;
+        }
+        load_set_stop();
+    }
+    for (i = 0; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+    elapsed = now() - load.start;
+    load_set_stop();
+    if (stats_running)
+        pthread_join(stats_tid, NULL);
+    pthread_mutex_destroy(&load.mutex);
+
+    report(workers, elapsed);
+    ret = 0;
+    for (i = 0; i < started; i++) {
+        if (workers[i].result.errors)
+            ret = 1;
+        free(workers[i].result.latency);
+    }
+
+done:
+    free(workers);
+    for (j = 0; j < load.nfiles; j++)
+        free(load.files[j].path);
+    free(load.files);
+    free(load.socket_path);
+    if (load.tcp)
+        freeaddrinfo(load.tcp);
+    optfree(opts);
+    return ret;
+}
@@ -38,6 +38,7 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/types.h>
 #include CURSES_INCLUDE
@@ -85,6 +86,24 @@ struct global_stats {
     conn_t *conn;
 };
 
+/* most file types shown in the parse time breakdown */
+#define MAX_TYPES 128
+#define SHOWN_TYPES 5
+
+/* Cumulative scan pipeline counters of one STATS reply */
+struct pipeline {
+    struct timeval tv; /* when they were received, zero if clamd didn't send them */
+    unsigned long long scans, bytes, cache_lookups, cache_hits, tempfiles;
+    double sigmem, cachemem; /* in megabytes, sigmem < 0 if not available */
+    unsigned reloads;
+    double reload_time;
+    unsigned ntypes;
+    struct {
+        char name[32];
+        unsigned long long usec;
+    } types[MAX_TYPES];
+};
+
 struct stats {
     const char *remote;
     char *engine_version;
@@ -102,6 +121,8 @@ struct stats {
     double mem; /* in megabytes */
     unsigned long lheapu, lmmapu, ltotalu, ltotalf, lreleasable, lpoolu, lpoolt;
     unsigned pools_cnt;
+    /* pipeline counters, rates are computed against the previous reply */
+    struct pipeline pipe, last_pipe;
 };
 
 static void cleanup(void);
@@ -1004,6 +1025,162 @@ static void parse_memstats(const char *line, struct stats *stats)
     stats->mem         = heapu + mmapu + pools_total;
 }
 
+static void parse_engine(const char *line, struct stats *stats)
+{
+    struct pipeline *pipe = &stats->pipe;
+
+    if (sscanf(line, " scans %llu bytes %llu cache_lookups %llu cache_hits %llu tempfiles %llu",
+               &pipe->scans, &pipe->bytes, &pipe->cache_lookups, &pipe->cache_hits, &pipe->tempfiles) != 5)
+        return;
+    gettimeofday(&pipe->tv, NULL);
+}
+
+static void parse_enginemem(const char *line, struct stats *stats)
+{
+    struct pipeline *pipe = &stats->pipe;
+
+    if (sscanf(line, " signatures %lfM cache %lfM", &pipe->sigmem, &pipe->cachemem) == 2)
+        return;
+    pipe->sigmem = -1;
+    if (sscanf(line, " signatures N/A cache %lfM", &pipe->cachemem) != 1)
+        pipe->cachemem = 0;
+}
+
+static void parse_reload(const char *line, struct stats *stats)
+{
+    if (sscanf(line, " count %u last %lfs", &stats->pipe.reloads, &stats->pipe.reload_time) != 2) {
+        stats->pipe.reloads     = 0;
+        stats->pipe.reload_time = 0;
+    }
+}
+
+static void parse_type(const char *line, struct stats *stats)
+{
+    struct pipeline *pipe = &stats->pipe;
+    unsigned long long files, bytes, usec;
+    char name[32];
+
+    if (pipe->ntypes >= MAX_TYPES)
+        return;
+    if (sscanf(line, " %31s files %llu bytes %llu usec %llu", name, &files, &bytes, &usec) != 4)
+        return;
+    /* CL_TYPE_ is the same for all of them and we are short of columns */
+    strcpy(pipe->types[pipe->ntypes].name, strncmp(name, "CL_TYPE_", 8) ? name : name + 8);
+    pipe->types[pipe->ntypes++].usec = usec;
+}
+
+/* Seconds between the previous reply and this one, 0 if the counters can't be compared */
+static double pipeline_interval(const struct stats *stats)
+{
+    const struct pipeline *cur = &stats->pipe, *last = &stats->last_pipe;
+
+    if (!cur->tv.tv_sec || !last->tv.tv_sec)
+        return 0;
+    /* a database reload brings a new engine with fresh counters */
+    if (cur->scans < last->scans || cur->reloads != last->reloads)
+        return 0;
+    return (cur->tv.tv_sec - last->tv.tv_sec) + (cur->tv.tv_usec - last->tv.tv_usec) / 1e6;
+}
+
+/* Parse time spent on a type since the previous reply, or since the start */
+static unsigned long long type_usec(const struct stats *stats, unsigned t, int delta)
+{
+    const struct pipeline *last = &stats->last_pipe;
+    unsigned long long usec     = stats->pipe.types[t].usec;
+    unsigned i;
+
+    if (!delta)
+        return usec;
+    for (i = 0; i < last->ntypes; i++) {
+        if (!strcmp(last->types[i].name, stats->pipe.types[t].name))
+            return usec >= last->types[i].usec ? usec - last->types[i].usec : 0;
+    }
+    return usec;
+}
+
+static void show_share(WINDOW *win, size_t line, const char *name, unsigned long long usec, unsigned long long total)
+{
+    unsigned len = total ? (unsigned)(usec * 20 / total) : 0;
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%5.1f%%", total ? usec * 100.0 / total : 0);
+    mvwprintw(win, line, 1, "%-15s", name);
+    print_colored(win, buf);
+    waddch(win, ' ');
+    wattron(win, A_BOLD | COLOR_PAIR(activ_color));
+    while (len--)
+        waddch(win, '|');
+    wattroff(win, A_BOLD | COLOR_PAIR(activ_color));
+}
+
+/* Scan rates, cache efficiency, engine memory and the file types that take most time */
+static size_t output_pipeline(WINDOW *win, size_t i, struct stats *stats)
+{
+    const struct pipeline *cur = &stats->pipe, *last = &stats->last_pipe;
+    double dt                  = pipeline_interval(stats);
+    unsigned long long lookups = cur->cache_lookups, hits = cur->cache_hits, total = 0;
+    unsigned shown[SHOWN_TYPES], nshown = 0, t, j;
+    char buf[128];
+
+    if (!cur->tv.tv_sec)
+        return i;
+
+    mvwprintw(win, i++, 0, "Scans:  ");
+    if (dt > 0)
+        snprintf(buf, sizeof(buf), "%8.1f/s %8.2f MiB/s tmp %6.1f/s",
+                 (cur->scans - last->scans) / dt,
+                 (cur->bytes - last->bytes) / dt / (1024 * 1024),
+                 cur->tempfiles >= last->tempfiles ? (cur->tempfiles - last->tempfiles) / dt : 0);
+    else
+        snprintf(buf, sizeof(buf), "%8llu total %8.2f MiB", cur->scans, cur->bytes / (1024 * 1024.0));
+    print_colored(win, buf);
+
+    if (dt > 0) {
+        lookups -= last->cache_lookups;
+        hits -= last->cache_hits;
+    }
+    mvwprintw(win, i++, 0, "Cache:  ");
+    if (lookups)
+        snprintf(buf, sizeof(buf), "hit %5.1f%% of %llu lookups", hits * 100.0 / lookups, lookups);
+    else
+        snprintf(buf, sizeof(buf), "hit   N/A");
+    print_colored(win, buf);
+
+    mvwprintw(win, i++, 0, "Engine: ");
+    if (cur->sigmem >= 0)
+        snprintf(buf, sizeof(buf), "signatures %6.1fM cache %5.1fM", cur->sigmem, cur->cachemem);
+    else
+        snprintf(buf, sizeof(buf), "signatures    N/A cache %5.1fM", cur->cachemem);
+    print_colored(win, buf);
+
+    mvwprintw(win, i++, 0, "Reload: ");
+    snprintf(buf, sizeof(buf), "%u since start, last took %.2fs", cur->reloads, cur->reload_time);
+    print_colored(win, buf);
+
+    /* pick the types with the most parse time, by a simple selection */
+    for (t = 0; t < cur->ntypes; t++)
+        total += type_usec(stats, t, dt > 0);
+    while (nshown < SHOWN_TYPES) {
+        unsigned best = cur->ntypes;
+        for (t = 0; t < cur->ntypes; t++) {
+            for (j = 0; j < nshown && shown[j] != t; j++)
+                ;
+            if (j == nshown && type_usec(stats, t, dt > 0) &&
+                (best == cur->ntypes || type_usec(stats, t, dt > 0) > type_usec(stats, best, dt > 0)))
+                best = t;
+        }
+        if (best == cur->ntypes)
+            break;
+        shown[nshown++] = best;
+    }
+    if (nshown) {
+        mvwprintw(win, i++, 0, "Parse time by type:");
+        for (j = 0; j < nshown; j++)
+            show_share(win, i++, cur->types[shown[j]].name, type_usec(stats, shown[j], dt > 0), total);
+    }
+    return i;
+}
+
 static int output_stats(struct stats *stats, unsigned idx)
 {
     char buf[128];
@@ -1096,6 +1273,10 @@ static int output_stats(struct stats *stats, unsigned idx)
         snprintf(buf, sizeof(buf), "%6u items %6u max", stats->current_q, stats->biggest_queue);
         print_colored(win, buf);
         show_bar(win, i++, stats->current_q, 0, stats->biggest_queue, blink);
+        /* the memory window covers the right side of the first 7 lines */
+        if (i < 7)
+            i = 7;
+        i = output_pipeline(win, i, stats);
         i += 2;
         werase(mem_window);
         output_memstats(stats);
@@ -1215,6 +1396,22 @@ static void parse_stats(conn_t *conn, struct stats *stats, unsigned idx)
             parse_memstats(val, stats);
             continue;
         }
+        if (!strcmp("ENGINE", buf)) {
+            parse_engine(val, stats);
+            continue;
+        }
+        if (!strcmp("ENGINEMEM", buf)) {
+            parse_enginemem(val, stats);
+            continue;
+        }
+        if (!strcmp("RELOAD", buf)) {
+            parse_reload(val, stats);
+            continue;
+        }
+        if (!strcmp("TYPE", buf)) {
+            parse_type(val, stats);
+            continue;
+        }
         if (!strncmp("UNKNOWN COMMAND", buf, 15)) {
             stats->stats_unsupp = 1;
             break;
@@ -1467,6 +1664,11 @@ static int show_help(void)
     explain("Mem", "Memory usage reported by libc");
     explain("Libc", "Used/free memory reported by libc");
     explain("Pool", "Memory usage reported by libclamav's pool");
+    explain("Scans", "Files scanned and bytes read per second, temporary files created per second");
+    explain("Cache", "Share of files found in the scan cache since the last update");
+    explain("Engine", "Memory used by the signatures and by the scan cache");
+    explain("Reload", "Database reloads and how long the last one took");
+    explain("Parse time", "File types that took most scan time, needs Telemetry in clamd.conf");
 
     wrefresh(stdscr);
     werase(status_bar_window);
@@ -1540,7 +1742,9 @@ int main(int argc, char *argv[])
                 if (global.conn[i].sd != -1)
                     send_string(&global.conn[i], "nSTATS\n");
                 biggest_q = stats->biggest_queue;
-                memset(stats, 0, sizeof(*stats));
+                /* keep the previous counters around to compute rates */
+                stats->last_pipe = stats->pipe;
+                memset(stats, 0, offsetof(struct stats, last_pipe));
                 stats->biggest_queue = biggest_q;
                 parse_stats(&global.conn[i], stats, i);
             }
@@ -68,6 +68,8 @@
 dev_t procdev;
 #endif
 
+static FILE *trace_file = NULL;
+
 #ifdef _WIN32
 /* FIXME: If possible, handle users correctly */
 static int checkaccess(const char *path, const char *username, int mode)
@@ -130,6 +132,14 @@ struct clamscan_cb_data {
     const char *filename;
 };
 
+static void scan_trace(const char *trace, size_t len, void *context)
+{
+    UNUSEDPARAM(context);
+
+    if (fwrite(trace, 1, len, trace_file) != len)
+        logg("^Can't write scan trace: %s\n", strerror(errno));
+}
+
 static cl_error_t pre(int fd, const char *type, void *context)
 {
     struct metachain *c;
@@ -780,6 +790,9 @@ int scanmanager(const struct optstruct *opts)
     if (optget(opts, "nocerts")->enabled)
         cl_engine_set_num(engine, CL_ENGINE_DISABLE_PE_CERTS, 1);
 
+    if (optget(opts, "image-fastpath")->enabled)
+        cl_engine_set_num(engine, CL_ENGINE_IMAGE_FASTPATH, 1);
+
     if (optget(opts, "dumpcerts")->enabled)
         cl_engine_set_num(engine, CL_ENGINE_PE_DUMPCERTS, 1);
 
@@ -1027,6 +1040,14 @@ int scanmanager(const struct optstruct *opts)
         }
     }
 
+    if ((opt = optget(opts, "budget-reserve"))->active) {
+        if ((ret = cl_engine_set_num(engine, CL_ENGINE_BUDGET_RESERVE, opt->numarg))) {
+            logg("!cli_engine_set_num(CL_ENGINE_BUDGET_RESERVE) failed: %s\n", cl_strerror(ret));
+            cl_engine_free(engine);
+            return 2;
+        }
+    }
+
     if ((opt = optget(opts, "pcre-max-filesize"))->active) {
         if ((ret = cl_engine_set_num(engine, CL_ENGINE_PCRE_MAX_FILESIZE, opt->numarg))) {
             logg("!cli_engine_set_num(CL_ENGINE_PCRE_MAX_FILESIZE) failed: %s\n", cl_strerror(ret));
@@ -1194,6 +1215,15 @@ int scanmanager(const struct optstruct *opts)
         procdev = sb.st_dev;
 #endif
 
+    if ((opt = optget(opts, "trace"))->enabled) {
+        if (!(trace_file = fopen(opt->strarg, "a"))) {
+            logg("!Can't open trace file %s: %s\n", opt->strarg, strerror(errno));
+            cl_engine_free(engine);
+            return 2;
+        }
+        cl_engine_set_clcb_trace(engine, scan_trace);
+    }
+
     /* check filetype */
     if (!opts->filename && !optget(opts, "file-list")->enabled) {
         /* we need full path for some reasons (eg. archive handling) */
@@ -1271,6 +1301,11 @@ int scanmanager(const struct optstruct *opts)
     /* free the engine */
     cl_engine_free(engine);
 
+    if (trace_file) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+
     /* overwrite return code - infection takes priority */
     if (info.ifiles)
         ret = 1;
@@ -963,6 +963,7 @@ static fc_error_t initialize(struct optstruct *opts)
     fcConfig.requestTimeout = optget(opts, "ReceiveTimeout")->numarg;
 
     fcConfig.bCompressLocalDatabase = optget(opts, "CompressLocalDatabase")->enabled;
+    fcConfig.maxConcurrentPatches   = optget(opts, "ConcurrentPatchDownloads")->numarg;
 
     /*
      * Initilize libfreshclam.
@@ -56,28 +56,20 @@ int cli_binhex(cli_ctx *ctx)
     size_t enc_done = 0, enc_todo = map->len;
     unsigned int dec_done = 0, chunksz = 0, chunkoff = 0;
     uint32_t datalen = 0, reslen = 0;
-    int in_data = 0, in_run = 0, datafd, resfd, ret = CL_CLEAN;
+    int in_data = 0, in_run = 0, ret = CL_CLEAN;
     enum binhex_phase { IN_BANNER,
                         IN_HEADER,
                         IN_DATA,
                         IN_LIMBO1,
                         IN_LIMBO2,
                         IN_RES } write_phase = IN_BANNER;
-    char *dname, *rname;
+    struct cli_membuf data, res; /* the data and resource forks */
 
     cli_dbgmsg("in cli_binhex\n");
     if (!map->len) return CL_CLEAN;
 
-    if ((ret = cli_gentempfd(ctx->sub_tmpdir, &dname, &datafd)) != CL_SUCCESS)
-        return ret;
-
-    if ((ret = cli_gentempfd(ctx->sub_tmpdir, &rname, &resfd)) != CL_SUCCESS) {
-        close(datafd);
-        if (cli_unlink(dname)) ret = CL_EUNLINK;
-        free(dname);
-        return ret;
-    }
-
+    memset(&data, 0, sizeof(data));
+    memset(&res, 0, sizeof(res));
     memset(decoded, 0, 24);
 
     while (1) {
@@ -102,7 +94,7 @@ int cli_binhex(cli_ctx *ctx)
                     break;
                 if (cli_checklimits("cli_binhex(resources)", ctx, reslen, 0, 0) != CL_CLEAN)
                     reslen = 0;
-                cli_dbgmsg("cli_binhex: decoding '%s' - %u bytes of data to %s - %u bytes or resources to %s\n", decoded + 1, datalen, dname, reslen, rname);
+                cli_dbgmsg("cli_binhex: decoding '%s' - %u bytes of data - %u bytes of resources\n", decoded + 1, datalen, reslen);
                 memmove(decoded, &decoded[hdrlen], dec_done - hdrlen);
                 dec_done -= hdrlen;
                 write_phase++;
@@ -111,18 +103,16 @@ int cli_binhex(cli_ctx *ctx)
                 unsigned int todo = MIN(dec_done, datalen);
                 datalen -= todo;
                 dec_done -= todo;
-                if (cli_writen(datafd, decoded, todo) != todo) {
-                    ret = CL_EWRITE;
+                if ((ret = cli_membuf_append(&data, decoded, todo)) != CL_SUCCESS) {
+                    if (ret == CL_EMAXSIZE) {
+                        cli_dbgmsg("cli_binhex: can't keep more of the data fork, scanning what we have\n");
+                        ret = data.len ? cli_magic_scan_buff(data.data, data.len, ctx, NULL) : CL_CLEAN;
+                    }
                     break;
                 }
                 if (!datalen) {
                     write_phase++;
-                    if (lseek(datafd, 0, SEEK_SET) == -1) {
-                        cli_dbgmsg("cli_binhex: call to lseek() has failed\n");
-                        ret = CL_ESEEK;
-                        break;
-                    }
-                    ret = cli_magic_scan_desc(datafd, dname, ctx, NULL);
+                    ret = data.len ? cli_magic_scan_buff(data.data, data.len, ctx, NULL) : CL_CLEAN;
                     if (ret == CL_VIRUS) break;
                 }
                 if (dec_done)
@@ -158,37 +148,25 @@ int cli_binhex(cli_ctx *ctx)
                 unsigned int todo = MIN(dec_done, reslen);
                 reslen -= todo;
                 dec_done -= todo;
-                if (cli_writen(resfd, decoded, todo) != todo) {
-                    ret = CL_EWRITE;
+                if ((ret = cli_membuf_append(&res, decoded, todo)) != CL_SUCCESS) {
+                    if (ret == CL_EMAXSIZE) {
+                        cli_dbgmsg("cli_binhex: can't keep more of the resource fork, scanning what we have\n");
+                        ret = res.len ? cli_magic_scan_buff(res.data, res.len, ctx, NULL) : CL_CLEAN;
+                    }
                     break;
                 }
                 if (!reslen) {
-                    if (lseek(resfd, 0, SEEK_SET) == -1) {
-                        cli_dbgmsg("cli_binhex: call to lseek() has failed\n");
-                        ret = CL_ESEEK;
-                        break;
-                    }
-                    ret = cli_magic_scan_desc(resfd, rname, ctx, NULL);
+                    ret = res.len ? cli_magic_scan_buff(res.data, res.len, ctx, NULL) : CL_CLEAN;
                     break;
                 }
             }
             if (!enc_todo) {
                 if (write_phase == IN_DATA) {
                     cli_dbgmsg("cli_binhex: scanning partially extracted data fork\n");
-                    if (lseek(datafd, 0, SEEK_SET) == -1) {
-                        cli_dbgmsg("cli_binhex: call to lseek() has failed\n");
-                        ret = CL_ESEEK;
-                        break;
-                    }
-                    ret = cli_magic_scan_desc(datafd, dname, ctx, NULL);
+                    ret = data.len ? cli_magic_scan_buff(data.data, data.len, ctx, NULL) : CL_CLEAN;
                 } else if (write_phase == IN_RES) {
                     cli_dbgmsg("cli_binhex: scanning partially extracted resource fork\n");
-                    if (lseek(resfd, 0, SEEK_SET) == -1) {
-                        cli_dbgmsg("cli_binhex: call to lseek() has failed\n");
-                        ret = CL_ESEEK;
-                        break;
-                    }
-                    ret = cli_magic_scan_desc(resfd, rname, ctx, NULL);
+                    ret = res.len ? cli_magic_scan_buff(res.data, res.len, ctx, NULL) : CL_CLEAN;
                 }
                 break;
             }
@@ -262,13 +240,7 @@ int cli_binhex(cli_ctx *ctx)
         last_byte           = this_byte;
     }
 
-    close(datafd);
-    close(resfd);
-    if (!ctx->engine->keeptmp) {
-        if (cli_unlink(dname) && ret != CL_VIRUS) ret = CL_EUNLINK;
-        if (cli_unlink(rname) && ret != CL_VIRUS) ret = CL_EUNLINK;
-    }
-    free(dname);
-    free(rname);
+    cli_membuf_free(&data);
+    cli_membuf_free(&res);
     return ret;
 }
@@ -825,6 +825,17 @@ void cli_cache_destroy(struct cl_engine *engine)
     MPOOL_FREE(engine->mempool, cache);
 }
 
+/* Bytes the engine cache takes from the mempool */
+size_t cli_cache_memory(const struct cl_engine *engine)
+{
+    struct CACHE *cache;
+
+    if (!engine || !(cache = engine->cache) || (engine->engine_options & ENGINE_OPTIONS_DISABLE_CACHE))
+        return 0;
+
+    return TREES * (sizeof(*cache) + NODES * sizeof(*cache->cacheset.data));
+}
+
 /* Looks up an hash in the proper tree */
 static int cache_lookup_hash(unsigned char *md5, size_t len, struct CACHE *cache, uint32_t reclevel)
 {
@@ -958,6 +969,9 @@ cl_error_t cache_check(unsigned char *hash, cli_ctx *ctx)
 
     map = *ctx->fmap;
     ret = cache_lookup_hash(hash, map->len, ctx->engine->cache, ctx->recursion);
+    ctx->cache_lookups++;
+    if (ret == CL_CLEAN)
+        ctx->cache_hits++;
     cli_dbgmsg("cache_check: %02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x is %s\n", hash[0], hash[1], hash[2], hash[3], hash[4], hash[5], hash[6], hash[7], hash[8], hash[9], hash[10], hash[11], hash[12], hash[13], hash[14], hash[15], (ret == CL_VIRUS) ? "negative" : "positive");
     return ret;
 }
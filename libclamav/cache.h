@@ -31,6 +31,7 @@ void cache_remove(unsigned char *md5, size_t size, const struct cl_engine *engin
 cl_error_t cache_check(unsigned char *hash, cli_ctx *ctx);
 int cli_cache_init(struct cl_engine *engine);
 void cli_cache_destroy(struct cl_engine *engine);
+size_t cli_cache_memory(const struct cl_engine *engine);
 
 
 #endif
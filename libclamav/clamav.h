@@ -213,6 +213,8 @@ struct cl_scan_options {
 #define ENGINE_OPTIONS_DISABLE_PE_STATS 0x4
 #define ENGINE_OPTIONS_DISABLE_PE_CERTS 0x8
 #define ENGINE_OPTIONS_PE_DUMPCERTS     0x10
+#define ENGINE_OPTIONS_TELEMETRY        0x20
+#define ENGINE_OPTIONS_IMAGE_FASTPATH   0x40
 // clang-format on
 
 struct cl_engine;
@@ -311,6 +313,16 @@ enum cl_engine_field {
     CL_ENGINE_PCRE_MAX_FILESIZE,   /* uint64_t */
     CL_ENGINE_DISABLE_PE_CERTS,    /* uint32_t */
     CL_ENGINE_PE_DUMPCERTS,        /* uint32_t */
+    CL_ENGINE_TELEMETRY,           /* uint32_t */
+    CL_ENGINE_TELEMETRY_SIGNATURES, /* uint32_t */
+    CL_ENGINE_SCANS,               /* uint64_t, read only: top level scans since the engine was created */
+    CL_ENGINE_SCANNED_BYTES,       /* uint64_t, read only: bytes of the files passed to these scans */
+    CL_ENGINE_CACHE_LOOKUPS,       /* uint64_t, read only */
+    CL_ENGINE_CACHE_HITS,          /* uint64_t, read only */
+    CL_ENGINE_CACHE_MEMORY,        /* uint64_t, read only: bytes allocated to the scan cache */
+    CL_ENGINE_TEMPFILES,           /* uint64_t, read only: temporary file and directory names generated by the process */
+    CL_ENGINE_BUDGET_RESERVE,      /* uint32_t, percent of the scan limits kept for high value nested files, 0 to 90 */
+    CL_ENGINE_IMAGE_FASTPATH,      /* uint32_t */
 };
 
 enum bytecode_security {
@@ -706,6 +718,46 @@ typedef int (*clcb_file_props)(const char *j_propstr, int rc, void *cbdata);
  */
 extern void cl_engine_set_clcb_file_props(struct cl_engine *engine, clcb_file_props callback);
 
+/**
+ * @brief Scan trace callback function.
+ *
+ * Invoked once at the end of every scan when set. The trace has one JSON
+ * object per line for each file and nested object the scan went through,
+ * in the order they were finished, so nested objects come first:
+ *
+ *   {"id":2,"parent":1,"depth":1,"type":"CL_TYPE_MSEXE","size":<bytes>,
+ *    "start_usec":<n>,"usec":<n>,"self_usec":<n>,"fmap_bytes":<n>,
+ *    "tempfiles":<n>,"result":"<cl_strerror() text>",
+ *    "stack":"CL_TYPE_ZIP;CL_TYPE_MSEXE","name":"<name, if any>"}
+ *
+ * The outermost object, with parent 0, also has the "path" of the scanned
+ * file when it is known.
+ *
+ * start_usec is relative to the start of the scan. usec includes nested
+ * objects, self_usec doesn't. fmap_bytes counts the bytes requested from the
+ * object's map, repeated reads included. tempfiles counts the temporary files
+ * created while the object was scanned, nested objects included. stack lists
+ * the types from the outermost object down to this one, so "<stack>
+ * <self_usec>" lines are the collapsed input flame graph tools take.
+ *
+ * The trace is kept in memory until the scan is over. Only set the callback
+ * when traces are wanted.
+ *
+ * @param trace     The trace, not nul-terminated. Only valid during the call.
+ * @param len       Length of the trace.
+ * @param context   Opaque application provided data.
+ */
+typedef void (*clcb_trace)(const char *trace, size_t len, void *context);
+/**
+ * @brief Set a scan trace callback function.
+ *
+ * Caution: changing options for an engine that is in-use is not thread-safe!
+ *
+ * @param engine    The initialized scanning engine.
+ * @param callback  The callback function pointer, NULL disables tracing.
+ */
+extern void cl_engine_set_clcb_trace(struct cl_engine *engine, clcb_trace callback);
+
 /* ----------------------------------------------------------------------------
  * Statistics/telemetry gathering callbacks.
  *
@@ -876,6 +928,30 @@ extern void cl_engine_set_clcb_stats_get_hostid(struct cl_engine *engine, clcb_s
  */
 extern void cl_engine_stats_enable(struct cl_engine *engine);
 
+/**
+ * @brief Get the scan telemetry collected by the engine.
+ *
+ * Telemetry is collected once CL_ENGINE_TELEMETRY is set. The report is
+ * plain text, one "KEY: name counters..." line per counter:
+ *   TELEMETRY: since <time_t> scans <n>
+ *   TYPE: <file type> files <n> bytes <n> usec <n>   (time excludes nested files)
+ *   DEPTH: <level> files <n> bytes <n> usec <n>      (time includes nested files)
+ *   STAGE: <scan stage> calls <n> usec <n>
+ *
+ * If CL_ENGINE_TELEMETRY_SIGNATURES is also set to N, one signature
+ * evaluation in 64 is timed and the N most expensive signatures are
+ * listed, costliest first:
+ *   SIGNATURE: <name> <ac|lsig|bytecode|yara> samples <n> usec <n>
+ * The usec value is extrapolated from the samples. The lsig time of a
+ * bytecode-driven signature includes its bytecode time.
+ *
+ * @param engine        The initialized scanning engine.
+ * @param[out] report   Set to the report. The caller must free() it.
+ * @param reset         If non-zero, clear the counters once they are read.
+ * @return cl_error_t   CL_SUCCESS, CL_EARG if telemetry is not enabled, or another error code.
+ */
+extern cl_error_t cl_engine_get_telemetry(const struct cl_engine *engine, char **report, int reset);
+
 /* ----------------------------------------------------------------------------
  * File scanning.
  */
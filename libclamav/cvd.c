@@ -48,352 +48,289 @@
 #include "cvd.h"
 #include "readdb.h"
 #include "default.h"
+#include "fmap.h"
 
 #define TAR_BLOCKSIZE 512
 
-static void cli_untgz_cleanup(char *path, gzFile infile, FILE *outfile, int fdd)
-{
-    UNUSEDPARAM(fdd);
-    cli_dbgmsg("in cli_untgz_cleanup()\n");
-    if (path != NULL)
-        free(path);
-    if (infile != NULL)
-        gzclose(infile);
-    if (outfile != NULL)
-        fclose(outfile);
-}
-
-static int cli_untgz(int fd, const char *destdir)
+/*
+ * Inflate a gzip compressed tar archive held in memory into a single writable
+ * buffer, so that the signature parsers can tokenize lines in place.
+ * Uncompressed archives are copied as is.
+ */
+static cl_error_t cli_cvdinflate(const unsigned char *data, size_t len, unsigned char **out, size_t *outlen)
 {
-    char *path, osize[13], name[101], type;
-    char block[TAR_BLOCKSIZE];
-    int nbytes, nread, nwritten, in_block = 0, fdd = -1;
-    unsigned int size, pathlen = strlen(destdir) + 100 + 5;
-    FILE *outfile = NULL;
-    STATBUF foo;
-    gzFile infile = NULL;
+    z_stream strm;
+    unsigned char *buf = NULL, *newbuf;
+    size_t bufsize, isize;
+    int zret;
+
+    *out    = NULL;
+    *outlen = 0;
+
+    if (len < 2 || data[0] != 0x1f || data[1] != 0x8b) {
+        /* plain tar */
+        if (!(buf = malloc(len ? len : 1))) {
+            cli_errmsg("cli_cvdinflate: Can't allocate %zu bytes\n", len);
+            return CL_EMEM;
+        }
+        memcpy(buf, data, len);
+        *out    = buf;
+        *outlen = len;
+        return CL_SUCCESS;
+    }
 
-    cli_dbgmsg("in cli_untgz()\n");
+    /* len >= 2 here, so the buffer never starts out empty */
+    bufsize = len > SIZE_MAX / 4 ? len : len * 4;
 
-    if ((fdd = dup(fd)) == -1) {
-        cli_errmsg("cli_untgz: Can't duplicate descriptor %d\n", fd);
-        return -1;
+    /* The gzip trailer stores the uncompressed size modulo 2^32. Nothing
+     * verifies it, so it is only a hint, and one deflate can't expand more
+     * than 1032 times. */
+    if (len >= 18) {
+        isize = (uint32_t)cli_readint32(data + len - 4);
+        if (isize > len && isize / 1032 <= len && isize < SIZE_MAX)
+            buf = malloc(isize + 1);
+        if (buf)
+            bufsize = isize + 1;
     }
 
-    if ((infile = gzdopen(fdd, "rb")) == NULL) {
-        cli_errmsg("cli_untgz: Can't gzdopen() descriptor %d, errno = %d\n", fdd, errno);
-        if (FSTAT(fdd, &foo) == 0)
-            close(fdd);
-        return -1;
+    /* the official databases unpack to more than CLI_MAX_ALLOCATION */
+    if (!buf && !(buf = malloc(bufsize))) {
+        cli_errmsg("cli_cvdinflate: Can't allocate %zu bytes\n", bufsize);
+        return CL_EMEM;
     }
 
-    path = (char *)cli_calloc(sizeof(char), pathlen);
-    if (!path) {
-        cli_errmsg("cli_untgz: Can't allocate memory for path\n");
-        cli_untgz_cleanup(NULL, infile, NULL, fdd);
-        return -1;
+    memset(&strm, 0, sizeof(strm));
+    strm.next_in  = (Bytef *)data;
+    strm.avail_in = len;
+    if (inflateInit2(&strm, MAX_WBITS + 16) != Z_OK) {
+        cli_errmsg("cli_cvdinflate: inflateInit2() failed\n");
+        free(buf);
+        return CL_EUNPACK;
     }
 
     while (1) {
-
-        nread = gzread(infile, block, TAR_BLOCKSIZE);
-
-        if (!in_block && !nread)
-            break;
-
-        if (nread != TAR_BLOCKSIZE) {
-            cli_errmsg("cli_untgz: Incomplete block read\n");
-            cli_untgz_cleanup(path, infile, outfile, fdd);
-            return -1;
-        }
-
-        if (!in_block) {
-            if (block[0] == '\0') /* We're done */
-                break;
-
-            strncpy(name, block, 100);
-            name[100] = '\0';
-
-            if (strchr(name, '/')) {
-                cli_errmsg("cli_untgz: Slash separators are not allowed in CVD\n");
-                cli_untgz_cleanup(path, infile, outfile, fdd);
-                return -1;
+        if (strm.total_out == bufsize) {
+            if (bufsize >= SIZE_MAX / 2) {
+                cli_errmsg("cli_cvdinflate: Uncompressed database too large\n");
+                inflateEnd(&strm);
+                free(buf);
+                return CL_EMEM;
             }
-
-            snprintf(path, pathlen, "%s" PATHSEP "%s", destdir, name);
-            cli_dbgmsg("cli_untgz: Unpacking %s\n", path);
-            type = block[156];
-
-            switch (type) {
-                case '0':
-                case '\0':
-                    break;
-                case '5':
-                    cli_errmsg("cli_untgz: Directories are not supported in CVD\n");
-                    cli_untgz_cleanup(path, infile, outfile, fdd);
-                    return -1;
-                default:
-                    cli_errmsg("cli_untgz: Unknown type flag '%c'\n", type);
-                    cli_untgz_cleanup(path, infile, outfile, fdd);
-                    return -1;
-            }
-
-            if (outfile) {
-                if (fclose(outfile)) {
-                    cli_errmsg("cli_untgz: Cannot close file %s\n", path);
-                    outfile = NULL;
-                    cli_untgz_cleanup(path, infile, outfile, fdd);
-                    return -1;
-                }
-                outfile = NULL;
+            if (!(newbuf = realloc(buf, bufsize * 2))) {
+                cli_errmsg("cli_cvdinflate: Can't allocate %zu bytes\n", bufsize * 2);
+                inflateEnd(&strm);
+                free(buf);
+                return CL_EMEM;
             }
-
-            if (!(outfile = fopen(path, "wb"))) {
-                cli_errmsg("cli_untgz: Cannot create file %s\n", path);
-                cli_untgz_cleanup(path, infile, outfile, fdd);
-                return -1;
-            }
-
-            strncpy(osize, block + 124, 12);
-            osize[12] = '\0';
-
-            if ((sscanf(osize, "%o", &size)) == 0) {
-                cli_errmsg("cli_untgz: Invalid size in header\n");
-                cli_untgz_cleanup(path, infile, outfile, fdd);
-                return -1;
-            }
-
-            if (size > 0)
-                in_block = 1;
-
-        } else { /* write or continue writing file contents */
-            nbytes   = size > TAR_BLOCKSIZE ? TAR_BLOCKSIZE : size;
-            nwritten = fwrite(block, 1, nbytes, outfile);
-
-            if (nwritten != nbytes) {
-                cli_errmsg("cli_untgz: Wrote %d instead of %d (%s)\n", nwritten, nbytes, path);
-                cli_untgz_cleanup(path, infile, outfile, fdd);
-                return -1;
+            buf     = newbuf;
+            bufsize = bufsize * 2;
+        }
+        strm.next_out  = buf + strm.total_out;
+        strm.avail_out = bufsize - strm.total_out;
+
+        zret = inflate(&strm, Z_NO_FLUSH);
+        if (zret == Z_STREAM_END) {
+            /* concatenated gzip members are valid, gzread() accepts them too */
+            if (strm.avail_in >= 2 && strm.next_in[0] == 0x1f && strm.next_in[1] == 0x8b) {
+                uLong total_out = strm.total_out;
+                if (inflateReset(&strm) != Z_OK)
+                    break;
+                strm.total_out = total_out;
+                continue;
             }
-
-            size -= nbytes;
-            if (size == 0)
-                in_block = 0;
+            break;
+        }
+        if (zret != Z_OK && !(zret == Z_BUF_ERROR && !strm.avail_out)) {
+            cli_errmsg("cli_cvdinflate: inflate() failed (%d)\n", zret);
+            inflateEnd(&strm);
+            free(buf);
+            return CL_EUNPACK;
+        }
+        if (!strm.avail_in && strm.avail_out) {
+            cli_errmsg("cli_cvdinflate: Truncated gzip stream\n");
+            inflateEnd(&strm);
+            free(buf);
+            return CL_EUNPACK;
         }
     }
 
-    cli_untgz_cleanup(path, infile, outfile, fdd);
-    return 0;
-}
-
-static void cli_tgzload_cleanup(int comp, struct cli_dbio *dbio, int fdd)
-{
-    UNUSEDPARAM(fdd);
-    cli_dbgmsg("in cli_tgzload_cleanup()\n");
-    if (comp) {
-        gzclose(dbio->gzs);
-        dbio->gzs = NULL;
-    } else {
-        fclose(dbio->fs);
-        dbio->fs = NULL;
-    }
-    if (dbio->buf != NULL) {
-        free(dbio->buf);
-        dbio->buf = NULL;
-    }
-
-    if (dbio->hashctx) {
-        cl_hash_destroy(dbio->hashctx);
-        dbio->hashctx = NULL;
-    }
+    *out    = buf;
+    *outlen = strm.total_out;
+    inflateEnd(&strm);
+    return CL_SUCCESS;
 }
 
-static int cli_tgzload(int fd, struct cl_engine *engine, unsigned int *signo, unsigned int options, struct cli_dbio *dbio, struct cli_dbinfo *dbinfo)
+/*
+ * Walk to the next member of a tar archive held in memory.
+ * Returns CL_SUCCESS with the member's name and data, CL_BREAK at the end of
+ * the archive or CL_EMALFDB on malformed input.
+ */
+static cl_error_t cli_tarnext(unsigned char *tar, size_t tarlen, size_t *pos, char *name, unsigned char **data, unsigned int *size)
 {
-    char osize[13], name[101];
-    char block[TAR_BLOCKSIZE];
-    int nread, fdd, ret;
-    unsigned int type, size, pad, compr = 1;
-    off_t off;
-    struct cli_dbinfo *db;
-    char hash[32];
+    char osize[13];
+    unsigned char *block;
+    size_t remain;
+    unsigned int pad;
 
-    cli_dbgmsg("in cli_tgzload()\n");
+    if (*pos >= tarlen)
+        return CL_BREAK;
 
-    if (lseek(fd, 512, SEEK_SET) < 0) {
-        return CL_ESEEK;
+    if (tarlen - *pos < TAR_BLOCKSIZE) {
+        cli_errmsg("cli_tarnext: Incomplete block read\n");
+        return CL_EMALFDB;
     }
 
-    if (cli_readn(fd, block, 7) != 7)
-        return CL_EFORMAT; /* truncated file? */
+    block = tar + *pos;
+    if (block[0] == '\0') /* We're done */
+        return CL_BREAK;
 
-    if (!strncmp(block, "COPYING", 7))
-        compr = 0;
+    strncpy(name, (const char *)block, 100);
+    name[100] = '\0';
 
-    if (lseek(fd, 512, SEEK_SET) < 0) {
-        return CL_ESEEK;
+    if (strchr(name, '/')) {
+        cli_errmsg("cli_tarnext: Slash separators are not allowed in CVD\n");
+        return CL_EMALFDB;
     }
 
-    if ((fdd = dup(fd)) == -1) {
-        cli_errmsg("cli_tgzload: Can't duplicate descriptor %d\n", fd);
-        return CL_EDUP;
+    switch (block[156]) {
+        case '0':
+        case '\0':
+            break;
+        case '5':
+            cli_errmsg("cli_tarnext: Directories are not supported in CVD\n");
+            return CL_EMALFDB;
+        default:
+            cli_errmsg("cli_tarnext: Unknown type flag '%c'\n", block[156]);
+            return CL_EMALFDB;
     }
 
-    if (compr) {
-        if ((dbio->gzs = gzdopen(fdd, "rb")) == NULL) {
-            cli_errmsg("cli_tgzload: Can't gzdopen() descriptor %d, errno = %d\n", fdd, errno);
-            if (fdd > -1)
-                close(fdd);
-            return CL_EOPEN;
-        }
-        dbio->fs = NULL;
-    } else {
-        if ((dbio->fs = fdopen(fdd, "rb")) == NULL) {
-            cli_errmsg("cli_tgzload: Can't fdopen() descriptor %d, errno = %d\n", fdd, errno);
-            if (fdd > -1)
-                close(fdd);
-            return CL_EOPEN;
-        }
-        dbio->gzs = NULL;
+    strncpy(osize, (const char *)block + 124, 12);
+    osize[12] = '\0';
+
+    if ((sscanf(osize, "%o", size)) == 0) {
+        cli_errmsg("cli_tarnext: Invalid size in header\n");
+        return CL_EMALFDB;
     }
 
-    dbio->bufsize = CLI_DEFAULT_DBIO_BUFSIZE;
-    dbio->buf     = cli_malloc(dbio->bufsize);
-    if (!dbio->buf) {
-        cli_errmsg("cli_tgzload: Can't allocate memory for dbio->buf\n");
-        cli_tgzload_cleanup(compr, dbio, fdd);
+    *pos += TAR_BLOCKSIZE;
+    remain = tarlen - *pos;
+    if (*size > remain) {
+        cli_errmsg("cli_tarnext: Incomplete block read\n");
         return CL_EMALFDB;
     }
-    dbio->bufpt  = NULL;
-    dbio->usebuf = 1;
-    dbio->readpt = dbio->buf;
+    *data = tar + *pos;
 
-    while (1) {
+    pad = *size % TAR_BLOCKSIZE ? (TAR_BLOCKSIZE - (*size % TAR_BLOCKSIZE)) : 0;
+    if ((size_t)*size + pad > remain)
+        *pos = tarlen;
+    else
+        *pos += *size + pad;
 
-        if (compr)
-            nread = gzread(dbio->gzs, block, TAR_BLOCKSIZE);
-        else
-            nread = fread(block, 1, TAR_BLOCKSIZE, dbio->fs);
+    return CL_SUCCESS;
+}
 
-        if (!nread)
-            break;
+static int cli_untgz(const unsigned char *data, size_t len, const char *destdir)
+{
+    char *path, name[101];
+    unsigned int pathlen = strlen(destdir) + 100 + 5, size;
+    unsigned char *tar, *member;
+    size_t tarlen, pos = 0;
+    FILE *outfile;
+    cl_error_t ret;
 
-        if (nread != TAR_BLOCKSIZE) {
-            cli_errmsg("cli_tgzload: Incomplete block read\n");
-            cli_tgzload_cleanup(compr, dbio, fdd);
-            return CL_EMALFDB;
-        }
+    cli_dbgmsg("in cli_untgz()\n");
 
-        if (block[0] == '\0') /* We're done */
-            break;
+    if (cli_cvdinflate(data, len, &tar, &tarlen) != CL_SUCCESS)
+        return -1;
 
-        strncpy(name, block, 100);
-        name[100] = '\0';
+    path = (char *)cli_calloc(sizeof(char), pathlen);
+    if (!path) {
+        cli_errmsg("cli_untgz: Can't allocate memory for path\n");
+        free(tar);
+        return -1;
+    }
 
-        if (strchr(name, '/')) {
-            cli_errmsg("cli_tgzload: Slash separators are not allowed in CVD\n");
-            cli_tgzload_cleanup(compr, dbio, fdd);
-            return CL_EMALFDB;
+    while ((ret = cli_tarnext(tar, tarlen, &pos, name, &member, &size)) == CL_SUCCESS) {
+        snprintf(path, pathlen, "%s" PATHSEP "%s", destdir, name);
+        cli_dbgmsg("cli_untgz: Unpacking %s\n", path);
+
+        if (!(outfile = fopen(path, "wb"))) {
+            cli_errmsg("cli_untgz: Cannot create file %s\n", path);
+            break;
         }
 
-        type = block[156];
+        if (size && fwrite(member, 1, size, outfile) != size) {
+            cli_errmsg("cli_untgz: Can't write %u bytes to %s\n", size, path);
+            fclose(outfile);
+            break;
+        }
 
-        switch (type) {
-            case '0':
-            case '\0':
-                break;
-            case '5':
-                cli_errmsg("cli_tgzload: Directories are not supported in CVD\n");
-                cli_tgzload_cleanup(compr, dbio, fdd);
-                return CL_EMALFDB;
-            default:
-                cli_errmsg("cli_tgzload: Unknown type flag '%c'\n", type);
-                cli_tgzload_cleanup(compr, dbio, fdd);
-                return CL_EMALFDB;
+        if (fclose(outfile)) {
+            cli_errmsg("cli_untgz: Cannot close file %s\n", path);
+            break;
         }
+    }
 
-        strncpy(osize, block + 124, 12);
-        osize[12] = '\0';
+    free(path);
+    free(tar);
+    return ret == CL_BREAK ? 0 : -1;
+}
 
-        if ((sscanf(osize, "%o", &size)) == 0) {
-            cli_errmsg("cli_tgzload: Invalid size in header\n");
-            cli_tgzload_cleanup(compr, dbio, fdd);
-            return CL_EMALFDB;
-        }
-        dbio->size     = size;
-        dbio->readsize = dbio->size < dbio->bufsize ? dbio->size : dbio->bufsize - 1;
-        dbio->bufpt    = NULL;
-        dbio->readpt   = dbio->buf;
-        if (!(dbio->hashctx)) {
-            dbio->hashctx = cl_hash_init("sha256");
-            if (!(dbio->hashctx)) {
-                cli_tgzload_cleanup(compr, dbio, fdd);
-                return CL_EMALFDB;
-            }
-        }
-        dbio->bread = 0;
+static int cli_tgzload(unsigned char *tar, size_t tarlen, struct cl_engine *engine, unsigned int *signo, unsigned int options, struct cli_dbio *dbio, struct cli_dbinfo *dbinfo)
+{
+    char name[101];
+    unsigned char *member;
+    unsigned int size;
+    size_t pos = 0;
+    struct cli_dbinfo *db;
+    unsigned char hash[32];
+    cl_error_t ret;
 
-        /* cli_dbgmsg("cli_tgzload: Loading %s, size: %u\n", name, size); */
-        if (compr)
-            off = (off_t)gzseek(dbio->gzs, 0, SEEK_CUR);
-        else
-            off = ftell(dbio->fs);
+    cli_dbgmsg("in cli_tgzload()\n");
 
+    dbio->gzs     = NULL;
+    dbio->fs      = NULL;
+    dbio->hashctx = NULL;
+    dbio->usebuf  = 1;
+
+    while ((ret = cli_tarnext(tar, tarlen, &pos, name, &member, &size)) == CL_SUCCESS) {
         if ((!dbinfo && cli_strbcasestr(name, ".info")) || (dbinfo && CLI_DBEXT(name))) {
-            ret = cli_load(name, engine, signo, options, dbio);
-            if (ret) {
-                cli_errmsg("cli_tgzload: Can't load %s\n", name);
-                cli_tgzload_cleanup(compr, dbio, fdd);
-                return CL_EMALFDB;
-            }
-            if (!dbinfo) {
-                cli_tgzload_cleanup(compr, dbio, fdd);
-                return CL_SUCCESS;
-            } else {
+            if (dbinfo) {
+                /* the parsers may modify the member in place, verify it first */
                 db = dbinfo;
                 while (db && strcmp(db->name, name))
                     db = db->next;
                 if (!db) {
                     cli_errmsg("cli_tgzload: File %s not found in .info\n", name);
-                    cli_tgzload_cleanup(compr, dbio, fdd);
                     return CL_EMALFDB;
                 }
-                if (dbio->bread) {
-                    if (db->size != dbio->bread) {
-                        cli_errmsg("cli_tgzload: File %s not correctly loaded\n", name);
-                        cli_tgzload_cleanup(compr, dbio, fdd);
-                        return CL_EMALFDB;
-                    }
-                    cl_finish_hash(dbio->hashctx, hash);
-                    dbio->hashctx = cl_hash_init("sha256");
-                    if (!(dbio->hashctx)) {
-                        cli_tgzload_cleanup(compr, dbio, fdd);
-                        return CL_EMALFDB;
-                    }
-                    if (memcmp(db->hash, hash, 32)) {
-                        cli_errmsg("cli_tgzload: Invalid checksum for file %s\n", name);
-                        cli_tgzload_cleanup(compr, dbio, fdd);
-                        return CL_EMALFDB;
-                    }
+                if (db->size != size) {
+                    cli_errmsg("cli_tgzload: File %s has invalid size\n", name);
+                    return CL_EMALFDB;
+                }
+                cl_sha256(member, size, hash, NULL);
+                if (memcmp(db->hash, hash, 32)) {
+                    cli_errmsg("cli_tgzload: Invalid checksum for file %s\n", name);
+                    return CL_EMALFDB;
                 }
             }
-        }
-        pad = size % TAR_BLOCKSIZE ? (TAR_BLOCKSIZE - (size % TAR_BLOCKSIZE)) : 0;
-        if (compr) {
-            if (off == gzseek(dbio->gzs, 0, SEEK_CUR))
-                gzseek(dbio->gzs, size + pad, SEEK_CUR);
-            else if (pad)
-                gzseek(dbio->gzs, pad, SEEK_CUR);
-        } else {
-            if (off == ftell(dbio->fs))
-                fseek(dbio->fs, size + pad, SEEK_CUR);
-            else if (pad)
-                fseek(dbio->fs, pad, SEEK_CUR);
+
+            /* hand the member to the parsers straight from the unpacked buffer */
+            dbio->mem   = (char *)member;
+            dbio->size  = size;
+            dbio->bread = 0;
+
+            ret = cli_load(name, engine, signo, options, dbio);
+            if (ret) {
+                cli_errmsg("cli_tgzload: Can't load %s\n", name);
+                return CL_EMALFDB;
+            }
+            if (!dbinfo)
+                return CL_SUCCESS;
         }
     }
 
-    cli_tgzload_cleanup(compr, dbio, fdd);
-    return CL_SUCCESS;
+    return ret == CL_BREAK ? CL_SUCCESS : CL_EMALFDB;
 }
 
 struct cl_cvd *cl_cvdparse(const char *head)
@@ -518,18 +455,19 @@ void cl_cvdfree(struct cl_cvd *cvd)
     free(cvd);
 }
 
-static int cli_cvdverify(FILE *fs, struct cl_cvd *cvdpt, unsigned int skipsig)
+static int cli_cvdverify(const unsigned char *data, size_t len, struct cl_cvd *cvdpt, unsigned int skipsig)
 {
     struct cl_cvd *cvd;
-    char *md5, head[513];
+    unsigned char digest[16];
+    char md5[33], head[513];
     int i;
 
-    fseek(fs, 0, SEEK_SET);
-    if (fread(head, 1, 512, fs) != 512) {
+    if (len < 512) {
         cli_errmsg("cli_cvdverify: Can't read CVD header\n");
         return CL_ECVD;
     }
 
+    memcpy(head, data, 512);
     head[512] = 0;
     for (i = 511; i > 0 && (head[i] == ' ' || head[i] == 10); head[i] = 0, i--)
         ;
@@ -545,29 +483,27 @@ static int cli_cvdverify(FILE *fs, struct cl_cvd *cvdpt, unsigned int skipsig)
         return CL_SUCCESS;
     }
 
-    md5 = cli_hashstream(fs, NULL, 1);
-    if (md5 == NULL) {
+    if (!cl_hash_data("md5", data + 512, len - 512, digest, NULL)) {
         cli_dbgmsg("cli_cvdverify: Cannot generate hash, out of memory\n");
         cl_cvdfree(cvd);
         return CL_EMEM;
     }
+    for (i = 0; i < 16; i++)
+        sprintf(md5 + i * 2, "%02x", digest[i]);
     cli_dbgmsg("MD5(.tar.gz) = %s\n", md5);
 
     if (strncmp(md5, cvd->md5, 32)) {
         cli_dbgmsg("cli_cvdverify: MD5 verification error\n");
-        free(md5);
         cl_cvdfree(cvd);
         return CL_EVERIFY;
     }
 
     if (cli_versig(md5, cvd->dsig)) {
         cli_dbgmsg("cli_cvdverify: Digital signature verification error\n");
-        free(md5);
         cl_cvdfree(cvd);
         return CL_EVERIFY;
     }
 
-    free(md5);
     cl_cvdfree(cvd);
     return CL_SUCCESS;
 }
@@ -606,43 +542,62 @@ cl_error_t cl_cvdverify(const char *file)
 int cli_cvdload(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigned int options, unsigned int dbtype, const char *filename, unsigned int chkonly)
 {
     struct cl_cvd cvd, dupcvd;
-    FILE *dupfs;
-    int ret;
+    fmap_t *map = NULL, *dupmap;
+    const unsigned char *data, *dupdata;
+    unsigned char *tar = NULL;
+    size_t tarlen = 0;
+    int ret, dupfd;
     time_t s_time;
-    int cfd;
     struct cli_dbio dbio;
     struct cli_dbinfo *dbinfo = NULL;
     char *dupname;
 
-    dbio.hashctx = NULL;
+    memset(&dbio, 0, sizeof(dbio));
 
     cli_dbgmsg("in cli_cvdload()\n");
 
+    if (!(map = fmap(fileno(fs), 0, 0, filename))) {
+        cli_errmsg("cli_cvdload: Can't map %s\n", filename);
+        return CL_EMAP;
+    }
+    if (!(data = fmap_need_off_once(map, 0, map->len))) {
+        cli_errmsg("cli_cvdload: Can't read %s\n", filename);
+        ret = CL_EREAD;
+        goto done;
+    }
+
     /* verify */
-    if ((ret = cli_cvdverify(fs, &cvd, dbtype)))
-        return ret;
+    if ((ret = cli_cvdverify(data, map->len, &cvd, dbtype)))
+        goto done;
 
     if (dbtype <= 1) {
         /* check for duplicate db */
         dupname = cli_strdup(filename);
-        if (!dupname)
-            return CL_EMEM;
+        if (!dupname) {
+            ret = CL_EMEM;
+            goto done;
+        }
         dupname[strlen(dupname) - 2] = (dbtype == 1 ? 'v' : 'l');
-        if (!access(dupname, R_OK) && (dupfs = fopen(dupname, "rb"))) {
-            if ((ret = cli_cvdverify(dupfs, &dupcvd, !dbtype))) {
-                fclose(dupfs);
+        if (!access(dupname, R_OK) && (dupfd = open(dupname, O_RDONLY | O_BINARY)) != -1) {
+            ret = CL_ECVD;
+            if ((dupmap = fmap(dupfd, 0, 0, dupname))) {
+                if ((dupdata = fmap_need_off_once(dupmap, 0, dupmap->len)))
+                    ret = cli_cvdverify(dupdata, dupmap->len, &dupcvd, !dbtype);
+                funmap(dupmap);
+            }
+            close(dupfd);
+            if (ret) {
                 free(dupname);
-                return ret;
+                goto done;
             }
-            fclose(dupfs);
             if (dupcvd.version > cvd.version) {
                 cli_warnmsg("Detected duplicate databases %s and %s. The %s database is older and will not be loaded, you should manually remove it from the database directory.\n", filename, dupname, filename);
                 free(dupname);
-                return CL_SUCCESS;
+                goto done;
             } else if (dupcvd.version == cvd.version && !dbtype) {
                 cli_warnmsg("Detected duplicate databases %s and %s, please manually remove one of them\n", filename, dupname);
                 free(dupname);
-                return CL_SUCCESS;
+                goto done;
             }
         }
         free(dupname);
@@ -674,24 +629,32 @@ int cli_cvdload(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigne
         cli_warnmsg("*******************************************************************\n");
     }
 
-    cfd          = fileno(fs);
+    /* unpack once, both passes below walk the same buffer */
+    if ((ret = cli_cvdinflate(data + 512, map->len - 512, &tar, &tarlen))) {
+        cli_errmsg("cli_cvdload: Can't unpack %s\n", filename);
+        ret = CL_EMALFDB;
+        goto done;
+    }
+
     dbio.chkonly = 0;
     if (dbtype == 2)
-        ret = cli_tgzload(cfd, engine, signo, options | CL_DB_UNSIGNED, &dbio, NULL);
+        ret = cli_tgzload(tar, tarlen, engine, signo, options | CL_DB_UNSIGNED, &dbio, NULL);
     else
-        ret = cli_tgzload(cfd, engine, signo, options | CL_DB_OFFICIAL, &dbio, NULL);
+        ret = cli_tgzload(tar, tarlen, engine, signo, options | CL_DB_OFFICIAL, &dbio, NULL);
     if (ret != CL_SUCCESS)
-        return ret;
+        goto done;
 
     dbinfo = engine->dbinfo;
     if (!dbinfo || !dbinfo->cvd || (dbinfo->cvd->version != cvd.version) || (dbinfo->cvd->sigs != cvd.sigs) || (dbinfo->cvd->fl != cvd.fl) || (dbinfo->cvd->stime != cvd.stime)) {
         cli_errmsg("cli_cvdload: Corrupted CVD header\n");
-        return CL_EMALFDB;
+        ret = CL_EMALFDB;
+        goto done;
     }
     dbinfo = engine->dbinfo ? engine->dbinfo->next : NULL;
     if (!dbinfo) {
         cli_errmsg("cli_cvdload: dbinfo error\n");
-        return CL_EMALFDB;
+        ret = CL_EMALFDB;
+        goto done;
     }
 
     dbio.chkonly = chkonly;
@@ -700,7 +663,7 @@ int cli_cvdload(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigne
     else
         options |= CL_DB_SIGNED | CL_DB_OFFICIAL;
 
-    ret = cli_tgzload(cfd, engine, signo, options, &dbio, dbinfo);
+    ret = cli_tgzload(tar, tarlen, engine, signo, options, &dbio, dbinfo);
 
     while (engine->dbinfo) {
         dbinfo         = engine->dbinfo;
@@ -712,23 +675,28 @@ int cli_cvdload(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigne
         MPOOL_FREE(engine->mempool, dbinfo);
     }
 
+done:
+    free(tar);
+    funmap(map);
     return ret;
 }
 
 int cli_cvdunpack(const char *file, const char *dir)
 {
-    int fd, ret;
+    int fd, ret = -1;
+    fmap_t *map;
+    const unsigned char *data;
 
     fd = open(file, O_RDONLY | O_BINARY);
     if (fd == -1)
         return -1;
 
-    if (lseek(fd, 512, SEEK_SET) < 0) {
-        close(fd);
-        return -1;
+    if ((map = fmap(fd, 0, 0, file))) {
+        if (map->len > 512 && (data = fmap_need_off_once(map, 512, map->len - 512)))
+            ret = cli_untgz(data, map->len - 512, dir);
+        funmap(map);
     }
 
-    ret = cli_untgz(fd, dir);
     close(fd);
     return ret;
 }
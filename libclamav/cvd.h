@@ -39,6 +39,7 @@ struct cli_dbio {
     unsigned int usebuf, bufsize, readsize;
     unsigned int chkonly;
     void *hashctx;
+    char *mem; /* member data when loading from an unpacked container; bread is the read offset */
 };
 
 int cli_cvdload(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigned int options, unsigned int dbtype, const char *filename, unsigned int chkonly);
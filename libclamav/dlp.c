@@ -252,37 +252,91 @@ int dlp_is_valid_cc(const unsigned char *buffer, size_t length, int cc_only)
     return 1;
 }
 
+#define DLP_ISDIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+#define ONES 0x0101010101010101ULL
+
+/* Returns the offset of the first digit in buffer[pos..end), or end */
+static size_t find_digit(const unsigned char *buffer, size_t pos, size_t end)
+{
+    uint64_t word, low;
+
+    /* Bytes below 0x80 are digits when adding 0x50 sets their high bit and
+     * adding 0x46 doesn't. Masking the high bit first keeps the additions
+     * from carrying into the next byte. */
+    for (; pos + 8 <= end; pos += 8) {
+        memcpy(&word, buffer + pos, 8);
+        low = word & (0x7f * ONES);
+        if ((low + 0x50 * ONES) & ~(low + 0x46 * ONES) & ~word & (0x80 * ONES))
+            break;
+    }
+
+    while (pos < end && !DLP_ISDIGIT(buffer[pos]))
+        pos++;
+
+    return pos;
+}
+
+int dlp_scan(struct dlp_scan *scan, const unsigned char *buffer, size_t length, size_t offset, size_t start, size_t end)
+{
+    size_t pos, run;
+    const unsigned char *num;
+
+    if (end > length)
+        end = length;
+
+    for (pos = start; (pos = find_digit(buffer, pos, end)) < end; pos += run) {
+        num = buffer + pos;
+        for (run = 1; pos + run < length && DLP_ISDIGIT(num[run]); run++)
+            ;
+
+        /* numbers only start after a non-digit */
+        if (pos && DLP_ISDIGIT(num[-1]))
+            continue;
+
+        /* a CC # has 13 or more digits, possibly broken up by separators */
+        if ((scan->what & DLP_CC) && offset + pos >= scan->cc_next && *num <= '6' &&
+            (run >= 13 || (pos + run < length && (num[run] == ' ' || num[run] == '-'))) &&
+            dlp_is_valid_cc(num, length - pos, scan->cc_only)) {
+            scan->cc_count++;
+            scan->cc_next = offset + pos + 16;
+        }
+
+        if ((scan->what & DLP_SSN_STRIPPED) && run == 9 && offset + pos >= scan->stripped_next &&
+            dlp_is_valid_ssn(num, length - pos, SSN_FORMAT_STRIPPED)) {
+            scan->ssn_count++;
+            scan->stripped_next = offset + pos + 10;
+        }
+
+        if ((scan->what & DLP_SSN_NORMAL) && run == 3 && offset + pos >= scan->normal_next &&
+            dlp_is_valid_ssn(num, length - pos, SSN_FORMAT_HYPHENS)) {
+            scan->ssn_count++;
+            scan->normal_next = offset + pos + 12;
+        }
+
+        if ((scan->min_cc && scan->cc_count >= scan->min_cc) ||
+            (scan->min_ssn && scan->ssn_count >= scan->min_ssn))
+            return 1;
+    }
+
+    return 0;
+}
+
 static int contains_cc(const unsigned char *buffer, size_t length, int detmode, int cc_only)
 {
-    const unsigned char *idx;
-    const unsigned char *end;
-    int count = 0;
+    struct dlp_scan scan;
 
     if (buffer == NULL || length < 13) {
         return 0;
     }
 
-    end = buffer + length;
-    idx = buffer;
-
-    while (idx < end) {
-        if (isdigit(*idx)) {
-            if ((idx == buffer || !isdigit(idx[-1])) && dlp_is_valid_cc(idx, length - (idx - buffer), cc_only) == 1) {
-                if (detmode == DETECT_MODE_DETECT)
-                    return 1;
-                else {
-                    count++;
-                    /* if we got a valid match we should increment the idx ptr
-                     * to gain a little performance
-                     */
-                    idx += (length > 15 ? 15 : (length - 1));
-                }
-            }
-        }
-        idx++;
-    }
+    memset(&scan, 0, sizeof(scan));
+    scan.what    = DLP_CC;
+    scan.cc_only = cc_only;
+    scan.min_cc  = (detmode == DETECT_MODE_DETECT) ? 1 : 0;
+    dlp_scan(&scan, buffer, length, 0, 0, length);
 
-    return count;
+    return (int)scan.cc_count;
 }
 
 int dlp_get_cc_count(const unsigned char *buffer, size_t length, int cc_only)
@@ -379,32 +433,17 @@ int dlp_is_valid_ssn(const unsigned char *buffer, size_t length, int format)
 
 static int contains_ssn(const unsigned char *buffer, size_t length, int format, int detmode)
 {
-    const unsigned char *idx;
-    const unsigned char *end;
-    int count = 0;
+    struct dlp_scan scan;
 
     if (buffer == NULL || length < 9)
         return 0;
 
-    end = buffer + length;
-    idx = buffer;
-    while (idx < end) {
-        if (isdigit(*idx)) {
-            /* check for area number and the first hyphen */
-            if ((idx == buffer || !isdigit(idx[-1])) && dlp_is_valid_ssn(idx, length - (idx - buffer), format) == 1) {
-                if (detmode == DETECT_MODE_COUNT) {
-                    count++;
-                    /* hop over the matched bytes if we found an SSN */
-                    idx += ((format == SSN_FORMAT_HYPHENS) ? 11 : 9);
-                } else {
-                    return 1;
-                }
-            }
-        }
-        idx++;
-    }
+    memset(&scan, 0, sizeof(scan));
+    scan.what    = (format == SSN_FORMAT_HYPHENS) ? DLP_SSN_NORMAL : DLP_SSN_STRIPPED;
+    scan.min_ssn = (detmode == DETECT_MODE_DETECT) ? 1 : 0;
+    dlp_scan(&scan, buffer, length, 0, 0, length);
 
-    return count;
+    return (int)scan.ssn_count;
 }
 
 int dlp_get_stripped_ssn_count(const unsigned char *buffer, size_t length)
@@ -30,6 +30,28 @@
 #define SSN_FORMAT_HYPHENS 0  /* xxx-yy-zzzz */
 #define SSN_FORMAT_STRIPPED 1 /* xxxyyzzzz */
 
+/* what dlp_scan() looks for */
+#define DLP_CC 0x1
+#define DLP_SSN_NORMAL 0x2
+#define DLP_SSN_STRIPPED 0x4
+
+/* bytes a number may span, separators and the following byte included */
+#define DLP_MAX_CANDIDATE 32
+
+/* Settings and state of a dlp_scan() over one or more buffers */
+struct dlp_scan {
+    unsigned int what;    /* DLP_* flags */
+    int cc_only;          /* only credit cards, not debit or private label */
+    unsigned int min_cc;  /* stop once this many CC #'s are found, 0 never stops */
+    unsigned int min_ssn; /* same for SSNs */
+    unsigned int cc_count;
+    unsigned int ssn_count;
+    /* offsets before which a new number would overlap the last one found */
+    size_t cc_next;
+    size_t normal_next;
+    size_t stripped_next;
+};
+
 /*
  * will check if a valid credit card number exists within the
  * first 16 bytes of the supplied buffer.  Validation supplied
@@ -137,6 +159,24 @@ int dlp_has_stripped_ssn(const unsigned char *buffer, size_t length);
  */
 int dlp_has_normal_ssn(const unsigned char *buffer, size_t length);
 
+/* Searches a buffer for credit card numbers and SSNs in a single pass.
+ * Only digit runs that could hold a number are handed to the validators,
+ * runs are found eight bytes at a time.
+ * Data larger than a buffer can be searched with consecutive calls, each
+ * buffer overlapping the previous one by one byte before start and by at
+ * least DLP_MAX_CANDIDATE bytes after end, so numbers crossing the buffer
+ * boundaries are found exactly once.
+ * Params:
+ *      scan => settings, counts are added to it. Zero the state first.
+ *      buffer => data buffer to be analyzed.
+ *      length => length of buffer.
+ *      offset => offset of buffer in the data.
+ *      start, end => numbers starting in buffer[start..end) are counted.
+ * Returns:
+ *      1 once min_cc or min_ssn is reached, 0 otherwise
+ */
+int dlp_scan(struct dlp_scan *scan, const unsigned char *buffer, size_t length, size_t offset, size_t start, size_t end);
+
 int cdn_ctn_is_valid(const char *buffer, size_t length);
 int cdn_eft_is_valid(const char *buffer, size_t length);
 int us_micr_is_valid(const char *buffer, size_t length);
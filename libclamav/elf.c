@@ -682,22 +682,27 @@ static void cli_elf_sectionlog(uint32_t sh_type, uint32_t sh_flags)
         cli_dbgmsg("ELF: Section contains executable code\n");
 }
 
-/* Scan function for ELF */
+/* Scan function for ELF
+ * The header info gathered on the way is handed over to the map, so the
+ * matcher doesn't need to parse the file again with cli_elfheader()
+ */
 int cli_scanelf(cli_ctx *ctx)
 {
     union elf_file_hdr file_hdr;
+    struct cli_exe_info elfinfo;
     fmap_t *map = *ctx->fmap;
     int ret;
     uint8_t conv = 0, is64 = 0;
+    uint16_t shnum;
 
     cli_dbgmsg("in cli_scanelf\n");
 
+    cli_exe_info_init(&elfinfo, 0);
+
     /* Load header to determine size and class */
     ret = cli_elf_fileheader(ctx, map, &file_hdr, &conv, &is64);
-    if (ret == CL_BREAK) {
-        return CL_CLEAN; /* here, break means "exit but report clean" */
-    } else if (ret != CL_CLEAN) {
-        return ret;
+    if (ret != CL_CLEAN) {
+        goto done;
     }
 
     /* Log File type and machine type */
@@ -774,29 +779,40 @@ int cli_scanelf(cli_ctx *ctx)
 
     /* Program headers and Entry */
     if (is64) {
-        ret = cli_elf_ph64(ctx, map, NULL, &(file_hdr.hdr64), conv);
+        ret = cli_elf_ph64(ctx, map, &elfinfo, &(file_hdr.hdr64), conv);
     } else {
-        ret = cli_elf_ph32(ctx, map, NULL, &(file_hdr.hdr32.hdr), conv);
+        ret = cli_elf_ph32(ctx, map, &elfinfo, &(file_hdr.hdr32.hdr), conv);
     }
-    if (ret == CL_BREAK) {
-        return CL_CLEAN; /* break means "exit but report clean" */
-    } else if (ret != CL_CLEAN) {
-        return ret;
+    if (ret != CL_CLEAN) {
+        goto done;
     }
 
-    /* Sections */
+    /* Sections
+     * cli_elfheader() gives up on more than 256 of them, which the scan
+     * still goes through */
+    shnum = is64 ? file_hdr.hdr64.e_shnum : file_hdr.hdr32.hdr.e_shnum;
     if (is64) {
-        ret = cli_elf_sh64(ctx, map, NULL, &(file_hdr.hdr64), conv);
+        ret = cli_elf_sh64(ctx, map, shnum > 256 ? NULL : &elfinfo, &(file_hdr.hdr64), conv);
     } else {
-        ret = cli_elf_sh32(ctx, map, NULL, &(file_hdr.hdr32.hdr), conv);
+        ret = cli_elf_sh32(ctx, map, shnum > 256 ? NULL : &elfinfo, &(file_hdr.hdr32.hdr), conv);
     }
+    if (ret == CL_CLEAN && shnum > 256) {
+        ret = CL_BREAK;
+    }
+
+done:
+    if (ret == CL_CLEAN) {
+        cli_exe_info_cache(map, 6, &elfinfo);
+    } else {
+        cli_exe_info_destroy(&elfinfo);
+        if (ret != CL_EMEM)
+            cli_exe_info_cache(map, 6, NULL);
+    }
+
     if (ret == CL_BREAK) {
         return CL_CLEAN; /* break means "exit but report clean" */
-    } else if (ret != CL_CLEAN) {
-        return ret;
     }
-
-    return CL_CLEAN;
+    return ret;
 }
 
 /* ELF header parsing only
@@ -21,6 +21,10 @@
 #include "execs.h"
 #include <string.h>
 
+#include "others.h"
+#include "elf.h"
+#include "macho.h"
+
 /**
  * Initialize a struct cli_exe_info so that it's ready to be populated
  * by the EXE header parsing functions (cli_peheader, cli_elfheader, and
@@ -78,4 +82,78 @@ void cli_exe_info_destroy(struct cli_exe_info *exeinfo)
     }
 
     cli_hashset_destroy(&(exeinfo->vinfo));
-}
\ No newline at end of file
+}
+
+/**
+ * Remember the header info parsed while scanning an executable, so that
+ * cli_exe_info_get() doesn't have to parse the headers again. Whatever the
+ * map held before is freed.
+ *
+ * @param map the fmap_t backing the executable
+ * @param target 6 for ELF, 9 for Mach-O
+ * @param exeinfo the parsed info, or NULL if the headers are broken. The map
+ *        takes over its sections in any case, the caller must not destroy it
+ */
+void cli_exe_info_cache(fmap_t *map, unsigned int target, struct cli_exe_info *exeinfo)
+{
+    if (NULL != map->exeinfo) {
+        cli_exe_info_destroy(map->exeinfo);
+        free(map->exeinfo);
+        map->exeinfo = NULL;
+    }
+
+    map->exeinfo_target = target;
+    map->exeinfo_status = -1;
+
+    if (NULL == exeinfo) {
+        return;
+    }
+
+    map->exeinfo = cli_malloc(sizeof(*exeinfo));
+    if (NULL == map->exeinfo) {
+        cli_errmsg("cli_exe_info_cache: Can't allocate memory for exeinfo\n");
+        cli_exe_info_destroy(exeinfo);
+        map->exeinfo_target = 0;
+        return;
+    }
+
+    memcpy(map->exeinfo, exeinfo, sizeof(*exeinfo));
+    map->exeinfo_status = 1;
+}
+
+/**
+ * Get the header info of the ELF or Mach-O file backing a map. The headers
+ * are parsed by the first call only, or not at all if the scanner of the
+ * file already handed its result over with cli_exe_info_cache().
+ *
+ * @param map the fmap_t backing the executable
+ * @param target 6 for ELF, 9 for Mach-O
+ * @return the info, owned by the map and freed with it, or NULL if the
+ *         headers couldn't be parsed
+ */
+const struct cli_exe_info *cli_exe_info_get(fmap_t *map, unsigned int target)
+{
+    struct cli_exe_info exeinfo;
+    int (*einfo)(fmap_t *, struct cli_exe_info *) = NULL;
+
+    if (map->exeinfo_target == target) {
+        return map->exeinfo_status == 1 ? map->exeinfo : NULL;
+    }
+
+    if (target == 6)
+        einfo = cli_elfheader;
+    else if (target == 9)
+        einfo = cli_machoheader;
+    else
+        return NULL;
+
+    cli_exe_info_init(&exeinfo, 0);
+    if (einfo(map, &exeinfo)) {
+        cli_exe_info_destroy(&exeinfo);
+        cli_exe_info_cache(map, target, NULL);
+        return NULL;
+    }
+    cli_exe_info_cache(map, target, &exeinfo);
+
+    return map->exeinfo;
+}
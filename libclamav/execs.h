@@ -26,6 +26,7 @@
 #include "hashtab.h"
 #include "bcfeatures.h"
 #include "pe_structs.h"
+#include "fmap.h"
 
 /** @file */
 /** Section of executable file.
@@ -164,4 +165,7 @@ struct cli_exe_info {
 void cli_exe_info_init(struct cli_exe_info *exeinfo, uint32_t offset);
 void cli_exe_info_destroy(struct cli_exe_info *exeinfo);
 
+const struct cli_exe_info *cli_exe_info_get(fmap_t *map, unsigned int target);
+void cli_exe_info_cache(fmap_t *map, unsigned int target, struct cli_exe_info *exeinfo);
+
 #endif
@@ -160,6 +160,17 @@ const char *cli_ftname(cli_file_t code)
     return NULL;
 }
 
+static void ftindex_free(const struct cl_engine *engine, struct cli_ftindex *idx)
+{
+    if (!idx)
+        return;
+
+    MPOOL_FREE(engine->mempool, idx->offsets);
+    MPOOL_FREE(engine->mempool, idx->cand);
+    MPOOL_FREE(engine->mempool, idx->any);
+    MPOOL_FREE(engine->mempool, idx);
+}
+
 void cli_ftfree(const struct cl_engine *engine)
 {
     struct cli_ftype *ftypes = engine->ftypes, *pt;
@@ -180,11 +191,170 @@ void cli_ftfree(const struct cl_engine *engine)
         MPOOL_FREE(engine->mempool, pt->tname);
         MPOOL_FREE(engine->mempool, pt);
     }
+
+    ftindex_free(engine, engine->ftindex);
+    ftindex_free(engine, engine->ptindex);
+}
+
+static int ftindex_offcmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Bucket the memcmp() magic of one definition list by offset and by the
+ * first magic byte. Candidates keep their list order so the lookup still
+ * returns the first matching definition, as the plain list walk did.
+ */
+static struct cli_ftindex *ftindex_new(struct cl_engine *engine, const struct cli_ftype *list)
+{
+    const struct cli_ftype *ft;
+    struct cli_ftindex *idx;
+    struct cli_ftindex_off *off;
+    uint32_t *offs = NULL, nftypes = 0, ncand = 0, order, i, n;
+
+    for (ft = list; ft; ft = ft->next)
+        nftypes++;
+
+    if (!(idx = MPOOL_CALLOC(engine->mempool, 1, sizeof(*idx))))
+        return NULL;
+    if (!nftypes)
+        return idx;
+
+    if (!(offs = cli_malloc(nftypes * sizeof(uint32_t))))
+        goto fail;
+
+    /* distinct offsets, ascending */
+    for (ft = list, n = 0; ft; ft = ft->next) {
+        if (ft->length)
+            offs[n++] = ft->offset;
+        else
+            idx->nany++;
+    }
+    ncand = n;
+    if (n) {
+        cli_qsort(offs, n, sizeof(uint32_t), ftindex_offcmp);
+        for (i = 1, idx->noffsets = 1; i < n; i++)
+            if (offs[i] != offs[idx->noffsets - 1])
+                offs[idx->noffsets++] = offs[i];
+
+        idx->offsets = MPOOL_CALLOC(engine->mempool, idx->noffsets, sizeof(struct cli_ftindex_off));
+        idx->cand    = MPOOL_CALLOC(engine->mempool, ncand, sizeof(struct cli_ftindex_cand));
+        if (!idx->offsets || !idx->cand)
+            goto fail;
+    }
+    if (idx->nany && !(idx->any = MPOOL_CALLOC(engine->mempool, idx->nany, sizeof(struct cli_ftindex_cand))))
+        goto fail;
+
+    /* count candidates per (offset, byte), then turn the counts into starting positions */
+    for (i = 0; i < idx->noffsets; i++)
+        idx->offsets[i].offset = offs[i];
+    for (ft = list; ft; ft = ft->next) {
+        if (!ft->length)
+            continue;
+        off = bsearch(&ft->offset, idx->offsets, idx->noffsets, sizeof(struct cli_ftindex_off), ftindex_offcmp);
+        off->start[ft->magic[0] + 1]++;
+    }
+    for (i = 0, n = 0; i < idx->noffsets; i++) {
+        off = &idx->offsets[i];
+        for (order = 0; order < 257; order++) {
+            n += off->start[order];
+            off->start[order] = n;
+        }
+    }
+
+    /* fill the buckets in list order; start[b] ends up at the beginning of bucket b */
+    for (ft = list, order = 0, n = 0; ft; ft = ft->next, order++) {
+        struct cli_ftindex_cand *c;
+
+        if (!ft->length) {
+            c = &idx->any[n++];
+        } else {
+            off = bsearch(&ft->offset, idx->offsets, idx->noffsets, sizeof(struct cli_ftindex_off), ftindex_offcmp);
+            c   = &idx->cand[off->start[ft->magic[0]]++];
+        }
+        c->ftype = ft;
+        c->order = order;
+    }
+    for (i = 0; i < idx->noffsets; i++) {
+        off = &idx->offsets[i];
+        memmove(&off->start[1], &off->start[0], 256 * sizeof(uint32_t));
+        off->start[0] = i ? idx->offsets[i - 1].start[256] : 0;
+    }
+
+    free(offs);
+    return idx;
+
+fail:
+    free(offs);
+    ftindex_free(engine, idx);
+    return NULL;
+}
+
+int cli_ftindex_build(struct cl_engine *engine)
+{
+    ftindex_free(engine, engine->ftindex);
+    ftindex_free(engine, engine->ptindex);
+    engine->ftindex = engine->ptindex = NULL;
+
+    if (!(engine->ftindex = ftindex_new(engine, engine->ftypes)) ||
+        !(engine->ptindex = ftindex_new(engine, engine->ptypes))) {
+        cli_errmsg("cli_ftindex_build: Can't allocate memory for the filetype index\n");
+        return CL_EMEM;
+    }
+
+    cli_dbgmsg("cli_ftindex_build: %u file and %u partition magic offsets\n",
+               engine->ftindex->noffsets, engine->ptindex->noffsets);
+    return CL_SUCCESS;
+}
+
+static const struct cli_ftype *ftindex_lookup(const struct cli_ftindex *idx, const unsigned char *buf, size_t buflen)
+{
+    const struct cli_ftype *found = NULL;
+    const struct cli_ftindex_cand *c, *end;
+    const struct cli_ftindex_off *off;
+    uint32_t best = UINT32_MAX, i;
+
+    for (i = 0; i < idx->noffsets; i++) {
+        off = &idx->offsets[i];
+        if (off->offset >= buflen)
+            break;
+
+        c   = &idx->cand[off->start[buf[off->offset]]];
+        end = &idx->cand[off->start[buf[off->offset] + 1]];
+        for (; c < end && c->order < best; c++) {
+            if (c->ftype->offset + c->ftype->length <= buflen &&
+                !memcmp(buf + c->ftype->offset, c->ftype->magic, c->ftype->length)) {
+                found = c->ftype;
+                best  = c->order;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < idx->nany && idx->any[i].order < best; i++) {
+        if (idx->any[i].ftype->offset <= buflen) {
+            found = idx->any[i].ftype;
+            break;
+        }
+    }
+
+    return found;
 }
 
 cli_file_t cli_compare_ftm_partition(const unsigned char *buf, size_t buflen, const struct cl_engine *engine)
 {
-    struct cli_ftype *ptype = engine->ptypes;
+    const struct cli_ftype *ptype = engine->ptypes;
+
+    if (engine->ptindex) {
+        if ((ptype = ftindex_lookup(engine->ptindex, buf, buflen))) {
+            cli_dbgmsg("Recognized %s partition\n", ptype->tname);
+            return ptype->type;
+        }
+        ptype = NULL;
+    }
 
     while (ptype) {
         if (ptype->offset + ptype->length <= buflen) {
@@ -202,7 +372,15 @@ cli_file_t cli_compare_ftm_partition(const unsigned char *buf, size_t buflen, co
 
 cli_file_t cli_compare_ftm_file(const unsigned char *buf, size_t buflen, const struct cl_engine *engine)
 {
-    struct cli_ftype *ftype = engine->ftypes;
+    const struct cli_ftype *ftype = engine->ftypes;
+
+    if (engine->ftindex) {
+        if ((ftype = ftindex_lookup(engine->ftindex, buf, buflen))) {
+            cli_dbgmsg("Recognized %s file\n", ftype->tname);
+            return ftype->type;
+        }
+        ftype = NULL;
+    }
 
     while (ftype) {
         if (ftype->offset + ftype->length <= buflen) {
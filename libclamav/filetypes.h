@@ -134,6 +134,25 @@ struct cli_ftype {
     uint16_t length;
 };
 
+struct cli_ftindex_cand {
+    const struct cli_ftype *ftype;
+    uint32_t order; /* position in the definition list, lower wins */
+};
+
+/* magic entries sharing one offset, bucketed by the byte found there */
+struct cli_ftindex_off {
+    uint32_t offset;
+    uint32_t start[257]; /* candidates for byte b are cand[start[b]] .. cand[start[b + 1] - 1] */
+};
+
+struct cli_ftindex {
+    uint32_t noffsets;
+    struct cli_ftindex_off *offsets; /* sorted by offset */
+    struct cli_ftindex_cand *cand;
+    uint32_t nany;
+    struct cli_ftindex_cand *any; /* zero-length magic */
+};
+
 struct cli_matched_type {
     struct cli_matched_type *next;
     off_t offset;
@@ -144,6 +163,7 @@ struct cli_matched_type {
 cli_file_t cli_ftcode(const char *name);
 const char *cli_ftname(cli_file_t code);
 void cli_ftfree(const struct cl_engine *engine);
+int cli_ftindex_build(struct cl_engine *engine);
 cli_file_t cli_compare_ftm_file(const unsigned char *buf, size_t buflen, const struct cl_engine *engine);
 cli_file_t cli_compare_ftm_partition(const unsigned char *buf, size_t buflen, const struct cl_engine *engine);
 cli_file_t cli_determine_fmap_type(fmap_t *map, const struct cl_engine *engine, cli_file_t basetype);
@@ -47,6 +47,7 @@
 #include "clamav.h"
 #include "others.h"
 #include "str.h"
+#include "execs.h"
 
 #define FM_MASK_COUNT 0x3fffffff
 #define FM_MASK_PAGED 0x40000000
@@ -97,6 +98,15 @@ static const void *handle_gets(fmap_t *m, char *dst, size_t *at, size_t max_len)
 static void unmap_mmap(fmap_t *m);
 static void unmap_malloc(fmap_t *m);
 
+static void fmap_free_exeinfo(fmap_t *m)
+{
+    if (NULL != m->exeinfo) {
+        cli_exe_info_destroy(m->exeinfo);
+        free(m->exeinfo);
+        m->exeinfo = NULL;
+    }
+}
+
 #ifndef _WIN32
 /* pread proto here in order to avoid the use of XOPEN and BSD_SOURCE
    which may in turn prevent some mmap constants to be defined */
@@ -158,6 +168,7 @@ fmap_t *fmap_check_empty(int fd, off_t offset, size_t len, int *empty, const cha
 static void unmap_win32(fmap_t *m)
 {
     if (NULL != m) {
+        fmap_free_exeinfo(m);
         if (NULL != m->data) {
             UnmapViewOfFile(m->data);
         }
@@ -265,6 +276,11 @@ fmap_t *fmap_duplicate(cl_fmap_t *map, off_t offset, size_t length, const char *
     /* Duplicate the state of the original map */
     memcpy(duplicate_map, map, sizeof(cl_fmap_t));
 
+    /* The executable headers of the parent don't describe this part of it */
+    duplicate_map->exeinfo        = NULL;
+    duplicate_map->exeinfo_target = 0;
+    duplicate_map->exeinfo_status = 0;
+
     /* Set the new offset and length for the new map */
     /* can't change offset because then we'd have to discard/move cached
      * data, instead use another offset to reuse the already cached data */
@@ -290,6 +306,8 @@ fmap_t *fmap_duplicate(cl_fmap_t *map, off_t offset, size_t length, const char *
         goto done;
     }
     memcpy(duplicate_map->maphash, hash, 16);
+    /* account only what the nested scan reads, not the hashing above */
+    duplicate_map->need_bytes = 0;
 
     if (NULL != name) {
         duplicate_map->name = cli_strdup(name);
@@ -317,6 +335,7 @@ done:
 void free_duplicate_fmap(cl_fmap_t *map)
 {
     if (NULL != map) {
+        fmap_free_exeinfo(map);
         if (NULL != map->name) {
             free(map->name);
             map->name = NULL;
@@ -328,6 +347,7 @@ void free_duplicate_fmap(cl_fmap_t *map)
 static void unmap_handle(fmap_t *m)
 {
     if (NULL != m) {
+        fmap_free_exeinfo(m);
         if (NULL != m->data) {
             if (m->aging) {
                 unmap_mmap(m);
@@ -723,6 +743,7 @@ static void unmap_mmap(fmap_t *m)
 static void unmap_malloc(fmap_t *m)
 {
     if (NULL != m) {
+        fmap_free_exeinfo(m);
         if (NULL != m->name) {
             free(m->name);
         }
@@ -39,6 +39,8 @@
 struct cl_fmap;
 typedef cl_fmap_t fmap_t;
 
+struct cli_exe_info;
+
 struct cl_fmap {
     /* handle interface */
     void *handle;
@@ -61,6 +63,7 @@ struct cl_fmap {
     size_t nested_offset; /* buffer offset for nested scan*/
     size_t real_len;      /* amount of data mapped from file, starting at offset */
     size_t len;           /* length of data accessible via current fmap */
+    uint64_t need_bytes;  /* bytes requested through fmap_need_*(), for scan traces */
 
     /* real_len = nested_offset + len
      * file_offset = offset + nested_offset + need_offset
@@ -83,6 +86,11 @@ struct cl_fmap {
     unsigned char maphash[16];
     uint32_t *bitmap;
     char *name;
+
+    /* executable headers, see cli_exe_info_get() */
+    struct cli_exe_info *exeinfo;
+    unsigned int exeinfo_target; /* 0 until the headers have been parsed */
+    int exeinfo_status;          /* 1 == parsed OK, -1 == error */
 };
 
 /**
@@ -153,11 +161,13 @@ static inline void funmap(fmap_t *m)
 
 static inline const void *fmap_need_off(fmap_t *m, size_t at, size_t len)
 {
+    m->need_bytes += len;
     return m->need(m, at, len, 1);
 }
 
 static inline const void *fmap_need_off_once(fmap_t *m, size_t at, size_t len)
 {
+    m->need_bytes += len;
     return m->need(m, at, len, 0);
 }
 
@@ -168,11 +178,13 @@ static inline size_t fmap_ptr2off(const fmap_t *m, const void *ptr)
 
 static inline const void *fmap_need_ptr(fmap_t *m, const void *ptr, size_t len)
 {
+    m->need_bytes += len;
     return m->need(m, fmap_ptr2off(m, ptr), len, 1);
 }
 
 static inline const void *fmap_need_ptr_once(fmap_t *m, const void *ptr, size_t len)
 {
+    m->need_bytes += len;
     return m->need(m, fmap_ptr2off(m, ptr), len, 0);
 }
 
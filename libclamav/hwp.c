@@ -72,17 +72,18 @@
 #define hwpml_debug(...) ;
 #endif
 
-typedef cl_error_t (*hwp_cb)(void *cbdata, int fd, const char *filepath, cli_ctx *ctx);
+typedef cl_error_t (*hwp_cb)(void *cbdata, fmap_t *map, cli_ctx *ctx);
 
 static cl_error_t decompress_and_callback(cli_ctx *ctx, fmap_t *input, size_t at, size_t len, const char *parent, hwp_cb cb, void *cbdata)
 {
     cl_error_t ret = CL_SUCCESS;
-    int zret, ofd;
+    int zret;
     size_t in;
     size_t off_in = at;
     size_t count, remain = 1, outsize = 0;
     z_stream zstrm;
-    char *tmpname;
+    struct cli_membuf out;
+    fmap_t *map = NULL;
     unsigned char inbuf[FILEBUFF], outbuf[FILEBUFF];
 
     if (!ctx || !input || !cb)
@@ -91,11 +92,7 @@ static cl_error_t decompress_and_callback(cli_ctx *ctx, fmap_t *input, size_t at
     if (len)
         remain = len;
 
-    /* reserve tempfile for output and callback */
-    if ((ret = cli_gentempfd(ctx->sub_tmpdir, &tmpname, &ofd)) != CL_SUCCESS) {
-        cli_errmsg("%s: Can't generate temporary file\n", parent);
-        return ret;
-    }
+    memset(&out, 0, sizeof(out));
 
     /* initialize zlib inflation stream */
     memset(&zstrm, 0, sizeof(zstrm));
@@ -142,10 +139,13 @@ static cl_error_t decompress_and_callback(cli_ctx *ctx, fmap_t *input, size_t at
             if ((ret = cli_checklimits("HWP", ctx, outsize + count, 0, 0)) != CL_SUCCESS)
                 break;
 
-            if (cli_writen(ofd, outbuf, count) != count) {
-                cli_errmsg("%s: Can't write to file %s\n", parent, tmpname);
-                ret = CL_EWRITE;
-                goto dc_end;
+            if ((ret = cli_membuf_append(&out, outbuf, count)) != CL_SUCCESS) {
+                if (ret == CL_EMEM) {
+                    cli_errmsg("%s: Can't allocate memory for the decompressed stream\n", parent);
+                    goto dc_end;
+                }
+                /* too big to keep in memory, scan what we have */
+                break;
             }
             outsize += count;
         }
@@ -153,7 +153,7 @@ static cl_error_t decompress_and_callback(cli_ctx *ctx, fmap_t *input, size_t at
         zstrm.avail_out = FILEBUFF;
     } while (zret == Z_OK && remain);
 
-    cli_dbgmsg("%s: Decompressed %zu bytes to %s\n", parent, outsize, tmpname);
+    cli_dbgmsg("%s: Decompressed %zu bytes\n", parent, outsize);
 
     /* post inflation checks */
     if (zret != Z_STREAM_END && zret != Z_OK) {
@@ -166,16 +166,24 @@ static cl_error_t decompress_and_callback(cli_ctx *ctx, fmap_t *input, size_t at
         cli_infomsg(ctx, "%s: Error decompressing stream. Scanning what was decompressed.\n", parent);
     }
 
+    /* the inflated stream is handed over as a nested map */
+    map = fmap_open_memory(out.data, out.len, NULL);
+    if (!map) {
+        cli_errmsg("%s: Failed to get fmap for decompressed stream\n", parent);
+        ret = CL_EMAP;
+        goto dc_end;
+    }
+
     /* check for limits exceeded or zlib failure */
     if (ret == CL_SUCCESS && (zret == Z_STREAM_END || zret == Z_OK)) {
         if (len && remain > 0)
             cli_infomsg(ctx, "%s: Error decompressing stream. Not all requested input was converted\n", parent);
 
         /* scanning inflated stream */
-        ret = cb(cbdata, ofd, tmpname, ctx);
+        ret = cb(cbdata, map, ctx);
     } else {
         /* default to scanning what we got */
-        ret = cli_magic_scan_desc(ofd, tmpname, ctx, NULL);
+        ret = cli_magic_scan_nested_fmap_type(map, 0, map->len, ctx, CL_TYPE_ANY, NULL);
     }
 
     /* clean-up */
@@ -186,11 +194,9 @@ dc_end:
         if (ret == CL_SUCCESS)
             ret = CL_EUNPACK;
     }
-    close(ofd);
-    if (!ctx->engine->keeptmp)
-        if (cli_unlink(tmpname))
-            ret = CL_EUNLINK;
-    free(tmpname);
+    if (map)
+        funmap(map);
+    cli_membuf_free(&out);
     return ret;
 }
 
@@ -370,14 +376,14 @@ cl_error_t cli_hwp5header(cli_ctx *ctx, hwp5_header_t *hwp5)
     return CL_SUCCESS;
 }
 
-static cl_error_t hwp5_cb(void *cbdata, int fd, const char *filepath, cli_ctx *ctx)
+static cl_error_t hwp5_cb(void *cbdata, fmap_t *map, cli_ctx *ctx)
 {
     UNUSEDPARAM(cbdata);
 
-    if (fd < 0 || !ctx)
+    if (!map || !ctx)
         return CL_ENULLARG;
 
-    return cli_magic_scan_desc(fd, filepath, ctx, NULL);
+    return cli_magic_scan_nested_fmap_type(map, 0, map->len, ctx, CL_TYPE_ANY, NULL);
 }
 
 cl_error_t cli_scanhwp5_stream(cli_ctx *ctx, hwp5_header_t *hwp5, char *name, int fd, const char *filepath)
@@ -1747,10 +1753,9 @@ static inline cl_error_t parsehwp3_infoblk_1(cli_ctx *ctx, fmap_t *dmap, size_t
     return ret;
 }
 
-static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *ctx)
+static cl_error_t hwp3_cb(void *cbdata, fmap_t *map, cli_ctx *ctx)
 {
     cl_error_t ret = CL_SUCCESS;
-    fmap_t *map, *dmap;
     size_t offset, start, new_offset;
     int i, p = 0, last = 0;
     uint16_t nstyles;
@@ -1758,34 +1763,12 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
     json_object *fonts;
 #endif
 
-    UNUSEDPARAM(filepath);
+    if (!map || !ctx)
+        return CL_ENULLARG;
 
     offset = start = cbdata ? *(size_t *)cbdata : 0;
 
-    if (offset == 0) {
-        if (fd < 0) {
-            cli_errmsg("HWP3.x: Invalid file descriptor argument\n");
-            return CL_ENULLARG;
-        } else {
-            STATBUF statbuf;
-
-            if (FSTAT(fd, &statbuf) == -1) {
-                cli_errmsg("HWP3.x: Can't stat file descriptor\n");
-                return CL_ESTAT;
-            }
-
-            map = dmap = fmap(fd, 0, statbuf.st_size, NULL);
-            if (!map) {
-                cli_errmsg("HWP3.x: Failed to get fmap for uncompressed stream\n");
-                return CL_EMAP;
-            }
-        }
-    } else {
-        hwp3_debug("HWP3.x: Document Content Stream starts @ offset %zu\n", offset);
-
-        map  = *ctx->fmap;
-        dmap = NULL;
-    }
+    hwp3_debug("HWP3.x: Document Content Stream starts @ offset %zu\n", offset);
 
     /* Fonts - 7 entries of 2 + (n x 40) bytes where n is the first 2 bytes of the entry */
 #if HAVE_JSON
@@ -1796,8 +1779,6 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
         uint16_t nfonts;
 
         if (fmap_readn(map, &nfonts, offset, sizeof(nfonts)) != sizeof(nfonts)) {
-            if (dmap)
-                funmap(dmap);
             return CL_EREAD;
         }
         nfonts = le16_to_host(nfonts);
@@ -1810,8 +1791,6 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
         new_offset = offset + (2 + nfonts * 40);
         if ((new_offset <= offset) || (new_offset >= map->len)) {
             cli_errmsg("HWP3.x: Font Entry: number of fonts is too high, invalid. %u\n", nfonts);
-            if (dmap)
-                funmap(dmap);
             return CL_EPARSE;
         }
         offset = new_offset;
@@ -1819,8 +1798,6 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
 
     /* Styles - 2 + (n x 238) bytes where n is the first 2 bytes of the section */
     if (fmap_readn(map, &nstyles, offset, sizeof(nstyles)) != sizeof(nstyles)) {
-        if (dmap)
-            funmap(dmap);
         return CL_EREAD;
     }
     nstyles = le16_to_host(nstyles);
@@ -1833,8 +1810,6 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
     new_offset = offset + (2 + nstyles * 238);
     if ((new_offset <= offset) || (new_offset >= map->len)) {
         cli_errmsg("HWP3.x: Font Entry: number of font styles is too high, invalid. %u\n", nstyles);
-        if (dmap)
-            funmap(dmap);
         return CL_EPARSE;
     }
     offset += (2 + nstyles * 238);
@@ -1844,11 +1819,8 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
     /* Paragraphs - are terminated with 0x0d00[13(CR) as hchar], empty paragraph marks end of section and do NOT end with 0x0d00 */
     while (!last && ((ret = parsehwp3_paragraph(ctx, map, p++, 0, &offset, &last)) == CL_SUCCESS)) continue;
     /* return is never a virus */
-    if (ret != CL_SUCCESS) {
-        if (dmap)
-            funmap(dmap);
+    if (ret != CL_SUCCESS)
         return ret;
-    }
 #if HAVE_JSON
     if (SCAN_COLLECT_METADATA)
         cli_jsonint(ctx->wrkproperty, "ParagraphCount", p);
@@ -1870,8 +1842,6 @@ static cl_error_t hwp3_cb(void *cbdata, int fd, const char *filepath, cli_ctx *c
             ret = subret;
     }
 
-    if (dmap)
-        funmap(dmap);
     return ret;
 }
 
@@ -1923,7 +1893,7 @@ cl_error_t cli_scanhwp3(cli_ctx *ctx)
     if (docinfo.di_compressed)
         ret = decompress_and_callback(ctx, *ctx->fmap, offset, 0, "HWP3.x", hwp3_cb, NULL);
     else
-        ret = hwp3_cb(&offset, 0, ctx->sub_filepath, ctx);
+        ret = hwp3_cb(&offset, *ctx->fmap, ctx);
 
     if (ret != CL_SUCCESS)
         return ret;
@@ -1971,22 +1941,24 @@ static const struct key_entry hwpml_keys[] = {
 static size_t num_hwpml_keys = sizeof(hwpml_keys) / sizeof(struct key_entry);
 
 /* binary streams needs to be base64-decoded then decompressed if fields are set */
-static cl_error_t hwpml_scan_cb(void *cbdata, int fd, const char *filepath, cli_ctx *ctx)
+static cl_error_t hwpml_scan_cb(void *cbdata, fmap_t *map, cli_ctx *ctx)
 {
     UNUSEDPARAM(cbdata);
 
-    if (fd < 0 || !ctx)
+    if (!map || !ctx)
         return CL_ENULLARG;
 
-    return cli_magic_scan_desc(fd, filepath, ctx, NULL);
+    return cli_magic_scan_nested_fmap_type(map, 0, map->len, ctx, CL_TYPE_ANY, NULL);
 }
 
 static cl_error_t hwpml_binary_cb(int fd, const char *filepath, cli_ctx *ctx, int num_attribs, struct attrib_entry *attribs, void *cbdata)
 {
     cl_error_t ret;
 
-    int i, df = 0, com = 0, enc = 0;
-    char *tempfile;
+    int i, com = 0, enc = 0;
+    STATBUF statbuf;
+    fmap_t *input;
+    char *decoded = NULL;
 
     UNUSEDPARAM(cbdata);
 
@@ -2011,101 +1983,70 @@ static cl_error_t hwpml_binary_cb(int fd, const char *filepath, cli_ctx *ctx, in
 
     hwpml_debug("HWPML: Checking attributes: com: %d, enc: %d\n", com, enc);
 
-    /* decode the binary data if needed - base64 */
     if (enc < 0) {
         cli_errmsg("HWPML: Unrecognized encoding method\n");
         return cli_magic_scan_desc(fd, filepath, ctx, NULL);
-    } else if (enc == 1) {
-        STATBUF statbuf;
-        fmap_t *input;
+    }
+
+    /* plain binary data, no decoding necessary */
+    if (!enc && !com)
+        return cli_magic_scan_desc(fd, filepath, ctx, NULL);
+
+    /* fmap the input file for easier manipulation */
+    if (FSTAT(fd, &statbuf) == -1) {
+        cli_errmsg("HWPML: Can't stat file descriptor\n");
+        return CL_ESTAT;
+    }
+
+    if (!(input = fmap(fd, 0, statbuf.st_size, NULL))) {
+        cli_errmsg("HWPML: Failed to get fmap for binary data\n");
+        return CL_EMAP;
+    }
+
+    /* decode the binary data if needed - base64 */
+    if (enc == 1) {
         const char *instream;
-        char *decoded;
         size_t decodedlen;
 
         hwpml_debug("HWPML: Decoding base64-encoded binary data\n");
 
-        /* fmap the input file for easier manipulation */
-        if (FSTAT(fd, &statbuf) == -1) {
-            cli_errmsg("HWPML: Can't stat file descriptor\n");
-            return CL_ESTAT;
-        }
-
-        if (!(input = fmap(fd, 0, statbuf.st_size, NULL))) {
-            cli_errmsg("HWPML: Failed to get fmap for binary data\n");
-            return CL_EMAP;
-        }
-
         /* send data for base64 conversion - TODO: what happens with really big files? */
         if (!(instream = fmap_need_off_once(input, 0, input->len))) {
             cli_errmsg("HWPML: Failed to get input stream from binary data\n");
-            funmap(input);
-            return CL_EMAP;
+            ret = CL_EMAP;
+            goto hwpml_end;
         }
 
         decoded = (char *)cl_base64_decode((char *)instream, input->len, NULL, &decodedlen, 0);
-        funmap(input);
         if (!decoded) {
             cli_errmsg("HWPML: Failed to get base64 decode binary data\n");
-            return cli_magic_scan_desc(fd, filepath, ctx, NULL);
-        }
-
-        /* open file for writing and scanning */
-        if ((ret = cli_gentempfd(ctx->sub_tmpdir, &tempfile, &df)) != CL_SUCCESS) {
-            cli_warnmsg("HWPML: Failed to create temporary file for decoded stream scanning\n");
-            return ret;
+            ret = cli_magic_scan_desc(fd, filepath, ctx, NULL);
+            goto hwpml_end;
         }
 
-        if (cli_writen(df, decoded, decodedlen) != decodedlen) {
-            free(decoded);
-            ret = CL_EWRITE;
+        /* the decoded data replaces the input */
+        funmap(input);
+        if (!(input = fmap_open_memory(decoded, decodedlen, NULL))) {
+            cli_errmsg("HWPML: Failed to get fmap for decoded binary data\n");
+            ret = CL_EMAP;
             goto hwpml_end;
         }
-        free(decoded);
-
-        /* keeps the later logic simpler */
-        fd = df;
 
-        cli_dbgmsg("HWPML: Decoded binary data to %s\n", tempfile);
+        cli_dbgmsg("HWPML: Decoded %zu bytes of binary data\n", decodedlen);
     }
 
-    /* decompress the file if needed - zlib */
+    /* decompress the data if needed - zlib */
     if (com) {
-        STATBUF statbuf;
-        fmap_t *input;
-
         hwpml_debug("HWPML: Decompressing binary data\n");
-
-        /* fmap the input file for easier manipulation */
-        if (FSTAT(fd, &statbuf) == -1) {
-            cli_errmsg("HWPML: Can't stat file descriptor\n");
-            ret = CL_ESTAT;
-            goto hwpml_end;
-        }
-
-        input = fmap(fd, 0, statbuf.st_size, NULL);
-        if (!input) {
-            cli_errmsg("HWPML: Failed to get fmap for binary data\n");
-            ret = CL_EMAP;
-            goto hwpml_end;
-        }
         ret = decompress_and_callback(ctx, input, 0, 0, "HWPML", hwpml_scan_cb, NULL);
-        funmap(input);
     } else {
-        if (fd == df) { /* fd is a decoded tempfile */
-            ret = hwpml_scan_cb(NULL, fd, tempfile, ctx);
-        } else { /* fd is the original filepath, no decoding necessary */
-            ret = hwpml_scan_cb(NULL, fd, filepath, ctx);
-        }
+        ret = hwpml_scan_cb(NULL, input, ctx);
     }
 
-    /* close decoded file descriptor if used */
 hwpml_end:
-    if (df) {
-        close(df);
-        if (!(ctx->engine->keeptmp))
-            cli_unlink(tempfile);
-        free(tempfile);
-    }
+    if (input)
+        funmap(input);
+    free(decoded);
     return ret;
 }
 #endif /* HAVE_LIBXML2 */
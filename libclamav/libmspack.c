@@ -24,7 +24,7 @@
 enum mspack_type {
     FILETYPE_DUNNO,
     FILETYPE_FMAP,
-    FILETYPE_FILENAME,
+    FILETYPE_MEMORY,
 };
 
 struct mspack_name {
@@ -32,9 +32,10 @@ struct mspack_name {
     off_t org;
 };
 
-struct mspack_system_ex {
-    struct mspack_system ops;
-    off_t max_size;
+/* Passed to extract() in place of a file name, receives the member's data */
+struct mspack_output {
+    struct cli_membuf buf;
+    size_t max_size; /* anything past this is dropped */
 };
 
 struct mspack_handle {
@@ -44,8 +45,7 @@ struct mspack_handle {
     off_t org;
     off_t offset;
 
-    FILE *f;
-    off_t max_size;
+    struct mspack_output *out;
 };
 
 static struct mspack_file *mspack_fmap_open(struct mspack_system *self,
@@ -53,16 +53,14 @@ static struct mspack_file *mspack_fmap_open(struct mspack_system *self,
 {
     struct mspack_name *mspack_name;
     struct mspack_handle *mspack_handle;
-    struct mspack_system_ex *self_ex;
-    const char *fmode;
-    const struct mspack_system *mptr = self;
+
+    UNUSEDPARAM(self);
 
     if (!filename) {
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         return NULL;
     }
     mspack_handle = malloc(sizeof(*mspack_handle));
-    memset(mspack_handle, 0, (sizeof(*mspack_handle)));
     if (!mspack_handle) {
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         return NULL;
@@ -81,35 +79,19 @@ static struct mspack_file *mspack_fmap_open(struct mspack_system *self,
             return (struct mspack_file *)mspack_handle;
 
         case MSPACK_SYS_OPEN_WRITE:
-            fmode = "wb";
-            break;
-        case MSPACK_SYS_OPEN_UPDATE:
-            fmode = "r+b";
-            break;
-        case MSPACK_SYS_OPEN_APPEND:
-            fmode = "ab";
-            break;
-        default:
-            cli_dbgmsg("%s() wrong mode\n", __func__);
-            goto out_err;
-    }
+            mspack_handle->type = FILETYPE_MEMORY;
 
-    mspack_handle->type = FILETYPE_FILENAME;
+            mspack_handle->out          = (struct mspack_output *)filename;
+            mspack_handle->out->buf.len = 0;
 
-    mspack_handle->f = fopen(filename, fmode);
-    if (!mspack_handle->f) {
-        cli_dbgmsg("%s() failed %d\n", __func__, __LINE__);
-        goto out_err;
-    }
+            return (struct mspack_file *)mspack_handle;
 
-    self_ex                 = (struct mspack_system_ex *)((char *)mptr - offsetof(struct mspack_system_ex, ops));
-    mspack_handle->max_size = self_ex->max_size;
-    return (struct mspack_file *)mspack_handle;
+        default:
+            cli_dbgmsg("%s() wrong mode\n", __func__);
+            break;
+    }
 
-out_err:
-    memset(mspack_handle, 0, (sizeof(*mspack_handle)));
     free(mspack_handle);
-    mspack_handle = NULL;
     return NULL;
 }
 
@@ -120,10 +102,6 @@ static void mspack_fmap_close(struct mspack_file *file)
     if (!mspack_handle)
         return;
 
-    if (mspack_handle->type == FILETYPE_FILENAME)
-        if (mspack_handle->f)
-            fclose(mspack_handle->f);
-
     memset(mspack_handle, 0, (sizeof(*mspack_handle)));
     free(mspack_handle);
     mspack_handle = NULL;
@@ -134,68 +112,52 @@ static int mspack_fmap_read(struct mspack_file *file, void *buffer, int bytes)
 {
     struct mspack_handle *mspack_handle = (struct mspack_handle *)file;
     off_t offset;
-    size_t count;
     int ret;
 
     if (bytes < 0) {
         cli_dbgmsg("%s() %d\n", __func__, __LINE__);
         return -1;
     }
-    if (!mspack_handle) {
+    if (!mspack_handle || mspack_handle->type != FILETYPE_FMAP) {
         cli_dbgmsg("%s() %d\n", __func__, __LINE__);
         return -1;
     }
 
-    if (mspack_handle->type == FILETYPE_FMAP) {
-        offset = mspack_handle->offset + mspack_handle->org;
-
-        ret = fmap_readn(mspack_handle->fmap, buffer, offset, bytes);
-        if (ret != bytes) {
-            cli_dbgmsg("%s() %d %d, %d\n", __func__, __LINE__, bytes, ret);
-            return ret;
-        }
+    offset = mspack_handle->offset + mspack_handle->org;
 
-        mspack_handle->offset += bytes;
-        return bytes;
-    }
-    count = fread(buffer, bytes, 1, mspack_handle->f);
-    if (count < 1) {
-        cli_dbgmsg("%s() %d %d, %zu\n", __func__, __LINE__, bytes, count);
-        return -1;
+    ret = fmap_readn(mspack_handle->fmap, buffer, offset, bytes);
+    if (ret != bytes) {
+        cli_dbgmsg("%s() %d %d, %d\n", __func__, __LINE__, bytes, ret);
+        return ret;
     }
+
+    mspack_handle->offset += bytes;
     return bytes;
 }
 
 static int mspack_fmap_write(struct mspack_file *file, void *buffer, int bytes)
 {
     struct mspack_handle *mspack_handle = (struct mspack_handle *)file;
+    struct mspack_output *out;
     size_t count;
-    off_t max_size;
 
     if (bytes < 0 || !mspack_handle) {
         cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
         return -1;
     }
 
-    if (mspack_handle->type == FILETYPE_FMAP) {
+    if (mspack_handle->type != FILETYPE_MEMORY) {
         cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
         return -1;
     }
 
-    if (!bytes)
-        return 0;
-
-    max_size = mspack_handle->max_size;
-    if (!max_size)
-        return bytes;
-
-    max_size = max_size < (off_t)bytes ? max_size : (off_t)bytes;
-
-    mspack_handle->max_size -= max_size;
+    out   = mspack_handle->out;
+    count = out->max_size - out->buf.len;
+    if (count > (size_t)bytes)
+        count = bytes;
 
-    count = fwrite(buffer, max_size, 1, mspack_handle->f);
-    if (count < 1) {
-        cli_dbgmsg("%s() err %d <%zu %d>\n", __func__, __LINE__, count, bytes);
+    if (count && cli_membuf_append(&out->buf, buffer, count) != CL_SUCCESS) {
+        cli_dbgmsg("%s() err %d <%zu %d>\n", __func__, __LINE__, out->buf.len, bytes);
         return -1;
     }
 
@@ -205,54 +167,34 @@ static int mspack_fmap_write(struct mspack_file *file, void *buffer, int bytes)
 static int mspack_fmap_seek(struct mspack_file *file, off_t offset, int mode)
 {
     struct mspack_handle *mspack_handle = (struct mspack_handle *)file;
+    off_t new_pos;
 
-    if (!mspack_handle) {
+    if (!mspack_handle || mspack_handle->type != FILETYPE_FMAP) {
         cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
         return -1;
     }
 
-    if (mspack_handle->type == FILETYPE_FMAP) {
-        off_t new_pos;
-
-        switch (mode) {
-            case MSPACK_SYS_SEEK_START:
-                new_pos = offset;
-                break;
-            case MSPACK_SYS_SEEK_CUR:
-                new_pos = mspack_handle->offset + offset;
-                break;
-            case MSPACK_SYS_SEEK_END:
-                new_pos = mspack_handle->fmap->len + offset;
-                break;
-            default:
-                cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
-                return -1;
-        }
-        if (new_pos < 0 || new_pos > (off_t)mspack_handle->fmap->len) {
-            cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
-            return -1;
-        }
-
-        mspack_handle->offset = new_pos;
-        return 0;
-    }
-
     switch (mode) {
         case MSPACK_SYS_SEEK_START:
-            mode = SEEK_SET;
+            new_pos = offset;
             break;
         case MSPACK_SYS_SEEK_CUR:
-            mode = SEEK_CUR;
+            new_pos = mspack_handle->offset + offset;
             break;
         case MSPACK_SYS_SEEK_END:
-            mode = SEEK_END;
+            new_pos = mspack_handle->fmap->len + offset;
             break;
         default:
             cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
             return -1;
     }
+    if (new_pos < 0 || new_pos > (off_t)mspack_handle->fmap->len) {
+        cli_dbgmsg("%s() err %d\n", __func__, __LINE__);
+        return -1;
+    }
 
-    return fseek(mspack_handle->f, offset, mode);
+    mspack_handle->offset = new_pos;
+    return 0;
 }
 
 static off_t mspack_fmap_tell(struct mspack_file *file)
@@ -265,7 +207,7 @@ static off_t mspack_fmap_tell(struct mspack_file *file)
     if (mspack_handle->type == FILETYPE_FMAP)
         return mspack_handle->offset;
 
-    return (off_t)ftell(mspack_handle->f);
+    return (off_t)mspack_handle->out->buf.len;
 }
 
 static void mspack_fmap_message(struct mspack_file *file, const char *fmt, ...)
@@ -331,23 +273,68 @@ static struct mspack_system mspack_sys_fmap_ops = {
     .copy    = mspack_fmap_copy,
 };
 
+/* An archive member, in the order the members get extracted */
+struct mspack_member {
+    void *file;
+    uintptr_t stream; /* CAB folder or CHM section the member is stored in */
+    off_t offset;     /* uncompressed offset of the member in that stream */
+    int index;        /* position in the archive's file list */
+};
+
+/*
+ * libmspack keeps decompressing a folder or section where the last member
+ * ended, as long as the next member comes later in the same stream.
+ * Extracting members in stream and offset order lets solid folders be
+ * decompressed once from front to back, rather than from the start again
+ * for every member listed out of order.
+ */
+static int mspack_member_cmp(const void *a, const void *b)
+{
+    const struct mspack_member *ma = a;
+    const struct mspack_member *mb = b;
+
+    if (ma->stream != mb->stream)
+        return ma->stream < mb->stream ? -1 : 1;
+    if (ma->offset != mb->offset)
+        return ma->offset < mb->offset ? -1 : 1;
+    return ma->index - mb->index;
+}
+
+/* How much of the next member may be extracted under the scan limits */
+static size_t mspack_max_size(cli_ctx *ctx)
+{
+    uint64_t max_size;
+
+    if (ctx->engine->maxscansize &&
+        ctx->scansize + ctx->engine->maxfilesize >=
+            ctx->engine->maxscansize)
+        max_size = ctx->engine->maxscansize -
+                   ctx->scansize;
+    else
+        max_size = ctx->engine->maxfilesize ? ctx->engine->maxfilesize : 0xffffffff;
+
+    /* members are kept in memory, larger ones are truncated */
+    return max_size < CLI_MAX_ALLOCATION ? (size_t)max_size : CLI_MAX_ALLOCATION;
+}
+
 int cli_scanmscab(cli_ctx *ctx, off_t sfx_offset)
 {
     struct mscab_decompressor *cab_d;
     struct mscabd_cabinet *cab_h;
     struct mscabd_file *cab_f;
+    struct mspack_member *members = NULL;
+    struct mspack_output output;
     int ret = 0;
-    int files;
+    int files, i;
     int virus_num                  = 0;
     struct mspack_name mspack_fmap = {
         .fmap = *ctx->fmap,
         .org  = sfx_offset,
     };
-    struct mspack_system_ex ops_ex;
-    memset(&ops_ex, 0, sizeof(struct mspack_system_ex));
-    ops_ex.ops = mspack_sys_fmap_ops;
 
-    cab_d = mspack_create_cab_decompressor(&ops_ex.ops);
+    memset(&output, 0, sizeof(output));
+
+    cab_d = mspack_create_cab_decompressor(&mspack_sys_fmap_ops);
     if (!cab_d) {
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         return CL_EUNPACK;
@@ -364,13 +351,30 @@ int cli_scanmscab(cli_ctx *ctx, off_t sfx_offset)
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         goto out_dest;
     }
+
+    files = 0;
+    for (cab_f = cab_h->files; cab_f; cab_f = cab_f->next)
+        files++;
+    if (files && !(members = cli_malloc(files * sizeof(*members)))) {
+        ret = CL_EMEM;
+        goto out_close;
+    }
     files = 0;
     for (cab_f = cab_h->files; cab_f; cab_f = cab_f->next) {
-        off_t max_size;
-        char *tmp_fname = NULL;
+        members[files].file   = cab_f;
+        members[files].stream = (uintptr_t)cab_f->folder;
+        members[files].offset = cab_f->offset;
+        members[files].index  = files;
+        files++;
+    }
+    if (files)
+        qsort(members, files, sizeof(*members), mspack_member_cmp);
+
+    for (i = 0; i < files; i++) {
+        cab_f = members[i].file;
 
         ret = cli_matchmeta(ctx, cab_f->filename, 0, cab_f->length, 0,
-                            files, 0, NULL);
+                            members[i].index, 0, NULL);
         if (ret) {
             if (ret == CL_VIRUS) {
                 virus_num++;
@@ -387,43 +391,17 @@ int cli_scanmscab(cli_ctx *ctx, off_t sfx_offset)
             }
         }
 
-        if (ctx->engine->maxscansize &&
-            ctx->scansize + ctx->engine->maxfilesize >=
-                ctx->engine->maxscansize)
-            max_size = ctx->engine->maxscansize -
-                       ctx->scansize;
-        else
-            max_size = ctx->engine->maxfilesize ? ctx->engine->maxfilesize : 0xffffffff;
-
-        tmp_fname = cli_gentemp(ctx->sub_tmpdir);
-        if (!tmp_fname) {
-            ret = CL_EMEM;
-            break;
-        }
-
-        ops_ex.max_size = max_size;
+        output.max_size = mspack_max_size(ctx);
         /* scan */
-        ret = cab_d->extract(cab_d, cab_f, tmp_fname);
+        ret = cab_d->extract(cab_d, cab_f, (char *)&output);
         if (ret)
             /* Failed to extract. Try to scan what is there */
             cli_dbgmsg("%s() failed to extract %d\n", __func__, ret);
 
-        ret = cli_magic_scan_file(tmp_fname, ctx, cab_f->filename);
-        if (CL_EOPEN == ret) {
-            ret = CL_CLEAN;
-        } else if (CL_VIRUS == ret) {
+        ret = output.buf.len ? cli_magic_scan_buff(output.buf.data, output.buf.len, ctx, cab_f->filename) : CL_CLEAN;
+        if (CL_VIRUS == ret)
             virus_num++;
-        }
 
-        if (!ctx->engine->keeptmp) {
-            if (!access(tmp_fname, R_OK) && cli_unlink(tmp_fname)) {
-                free(tmp_fname);
-                ret = CL_EUNLINK;
-                break;
-            }
-        }
-        free(tmp_fname);
-        files++;
         if (ret == CL_VIRUS && SCAN_ALLMATCHES)
             continue;
         if (ret)
@@ -431,6 +409,8 @@ int cli_scanmscab(cli_ctx *ctx, off_t sfx_offset)
     }
 
 out_close:
+    free(members);
+    cli_membuf_free(&output.buf);
     cab_d->close(cab_d, cab_h);
 out_dest:
     mspack_destroy_cab_decompressor(cab_d);
@@ -444,17 +424,18 @@ int cli_scanmschm(cli_ctx *ctx)
     struct mschm_decompressor *mschm_d;
     struct mschmd_header *mschm_h;
     struct mschmd_file *mschm_f;
+    struct mspack_member *members = NULL;
+    struct mspack_output output;
     int ret = CL_CLEAN; // Default CLEAN in case CHM contains no files.
-    int files;
+    int files, i;
     int virus_num                  = 0;
     struct mspack_name mspack_fmap = {
         .fmap = *ctx->fmap,
     };
-    struct mspack_system_ex ops_ex;
-    memset(&ops_ex, 0, sizeof(struct mspack_system_ex));
-    ops_ex.ops = mspack_sys_fmap_ops;
 
-    mschm_d = mspack_create_chm_decompressor(&ops_ex.ops);
+    memset(&output, 0, sizeof(output));
+
+    mschm_d = mspack_create_chm_decompressor(&mspack_sys_fmap_ops);
     if (!mschm_d) {
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         return CL_EUNPACK;
@@ -466,13 +447,30 @@ int cli_scanmschm(cli_ctx *ctx)
         cli_dbgmsg("%s() failed at %d\n", __func__, __LINE__);
         goto out_dest;
     }
+
+    files = 0;
+    for (mschm_f = mschm_h->files; mschm_f; mschm_f = mschm_f->next)
+        files++;
+    if (files && !(members = cli_malloc(files * sizeof(*members)))) {
+        ret = CL_EMEM;
+        goto out_close;
+    }
     files = 0;
     for (mschm_f = mschm_h->files; mschm_f; mschm_f = mschm_f->next) {
-        off_t max_size;
-        char *tmp_fname;
+        members[files].file   = mschm_f;
+        members[files].stream = mschm_f->section->id;
+        members[files].offset = mschm_f->offset;
+        members[files].index  = files;
+        files++;
+    }
+    if (files)
+        qsort(members, files, sizeof(*members), mspack_member_cmp);
+
+    for (i = 0; i < files; i++) {
+        mschm_f = members[i].file;
 
         ret = cli_matchmeta(ctx, mschm_f->filename, 0, mschm_f->length,
-                            0, files, 0, NULL);
+                            0, members[i].index, 0, NULL);
         if (ret) {
             if (ret == CL_VIRUS) {
                 virus_num++;
@@ -489,44 +487,18 @@ int cli_scanmschm(cli_ctx *ctx)
             }
         }
 
-        if (ctx->engine->maxscansize &&
-            ctx->scansize + ctx->engine->maxfilesize >=
-                ctx->engine->maxscansize)
-            max_size = ctx->engine->maxscansize -
-                       ctx->scansize;
-        else
-            max_size = ctx->engine->maxfilesize ? ctx->engine->maxfilesize : 0xffffffff;
-
-        ops_ex.max_size = max_size;
-
-        tmp_fname = cli_gentemp(ctx->sub_tmpdir);
-        if (!tmp_fname) {
-            ret = CL_EMEM;
-            break;
-        }
+        output.max_size = mspack_max_size(ctx);
 
         /* scan */
-        ret = mschm_d->extract(mschm_d, mschm_f, tmp_fname);
+        ret = mschm_d->extract(mschm_d, mschm_f, (char *)&output);
         if (ret)
             /* Failed to extract. Try to scan what is there */
             cli_dbgmsg("%s() failed to extract %d\n", __func__, ret);
 
-        ret = cli_magic_scan_file(tmp_fname, ctx, mschm_f->filename);
-        if (CL_EOPEN == ret) {
-            ret = CL_CLEAN;
-        } else if (CL_VIRUS == ret) {
+        ret = output.buf.len ? cli_magic_scan_buff(output.buf.data, output.buf.len, ctx, mschm_f->filename) : CL_CLEAN;
+        if (CL_VIRUS == ret)
             virus_num++;
-        }
 
-        if (!ctx->engine->keeptmp) {
-            if (!access(tmp_fname, R_OK) && cli_unlink(tmp_fname)) {
-                free(tmp_fname);
-                ret = CL_EUNLINK;
-                break;
-            }
-        }
-        free(tmp_fname);
-        files++;
         if (ret == CL_VIRUS && SCAN_ALLMATCHES)
             continue;
         if (ret)
@@ -534,6 +506,8 @@ int cli_scanmschm(cli_ctx *ctx)
     }
 
 out_close:
+    free(members);
+    cli_membuf_free(&output.buf);
     mschm_d->close(mschm_d, mschm_h);
 out_dest:
     mspack_destroy_chm_decompressor(mschm_d);
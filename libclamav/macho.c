@@ -171,6 +171,7 @@ struct macho_fat_arch {
 #define RETURN_BROKEN                                                          \
     if (matcher)                                                               \
         return -1;                                                             \
+    cli_exe_info_cache(map, 9, NULL);                                          \
     if (SCAN_HEURISTIC_BROKEN) {                                               \
         if (CL_VIRUS == cli_append_virus(ctx, "Heuristics.Broken.Executable")) \
             return CL_VIRUS;                                                   \
@@ -208,6 +209,7 @@ int cli_scanmacho(cli_ctx *ctx, struct cli_exe_info *fileinfo)
     unsigned int i, j, sect = 0, conv, m64, nsects, matcher = 0;
     unsigned int arch = 0, ep = 0, err;
     struct cli_exe_section *sections = NULL;
+    struct cli_exe_info exeinfo;
     char name[16];
     fmap_t *map = *ctx->fmap;
     ssize_t at;
@@ -493,7 +495,10 @@ int cli_scanmacho(cli_ctx *ctx, struct cli_exe_info *fileinfo)
             if (err) {
                 cli_dbgmsg("cli_scanmacho: Can't calculate EP offset\n");
                 free(sections);
-                return matcher ? -1 : CL_EFORMAT;
+                if (matcher)
+                    return -1;
+                cli_exe_info_cache(map, 9, NULL);
+                return CL_EFORMAT;
             }
             if (!matcher)
                 cli_dbgmsg("Entry Point file offset: %u\n", ep);
@@ -506,7 +511,12 @@ int cli_scanmacho(cli_ctx *ctx, struct cli_exe_info *fileinfo)
         fileinfo->sections  = sections;
         return 0;
     } else {
-        free(sections);
+        /* keep the header info for the matcher, see cli_exe_info_get() */
+        cli_exe_info_init(&exeinfo, 0);
+        exeinfo.ep        = ep;
+        exeinfo.nsections = sect;
+        exeinfo.sections  = sections;
+        cli_exe_info_cache(map, 9, &exeinfo);
         return CL_SUCCESS;
     }
 }
@@ -43,6 +43,7 @@
 #include "readdb.h"
 #include "default.h"
 #include "filtering.h"
+#include "telemetry.h"
 
 #include "mpool.h"
 
@@ -654,7 +655,7 @@ void cli_ac_free(struct cli_matcher *root)
     for (i = 0; i < root->ac_patterns; i++) {
         patt = root->ac_pattable[i];
         MPOOL_FREE(root->mempool, patt->prefix ? patt->prefix : patt->pattern);
-        MPOOL_FREE(root->mempool, patt->virname);
+        MPOOL_FREE_VIRNAME(root->mempool, patt->virname);
         if (patt->special)
             mpool_ac_free_special(root->mempool, patt);
         MPOOL_FREE(root->mempool, patt);
@@ -1561,6 +1562,16 @@ inline static int ac_addtype(struct cli_matched_type **list, cli_file_t type, of
         return CL_SUCCESS;
     }
 
+    /* several file type signatures may point at the same embedded object */
+    tnode_last = *list;
+    while (tnode_last) {
+        if (tnode_last->type == type && tnode_last->offset == offset)
+            return CL_SUCCESS;
+        if (!tnode_last->next)
+            break;
+        tnode_last = tnode_last->next;
+    }
+
     if (!(tnode = cli_calloc(1, sizeof(struct cli_matched_type)))) {
         cli_errmsg("cli_ac_addtype: Can't allocate memory for new type node\n");
         return CL_EMEM;
@@ -1569,10 +1580,6 @@ inline static int ac_addtype(struct cli_matched_type **list, cli_file_t type, of
     tnode->type   = type;
     tnode->offset = offset;
 
-    tnode_last = *list;
-    while (tnode_last && tnode_last->next)
-        tnode_last = tnode_last->next;
-
     if (tnode_last)
         tnode_last->next = tnode;
     else
@@ -1693,6 +1700,24 @@ cl_error_t cli_ac_chkmacro(struct cli_matcher *root, struct cli_ac_data *data, u
     return CL_SUCCESS;
 }
 
+/* ac_findmatch() for a sampled call, its time is charged to the signature owning the pattern */
+static int ac_findmatch_sampled(const unsigned char *buffer, uint32_t offset, uint32_t fileoffset, uint32_t length,
+                                const struct cli_ac_patt *pattern, const struct cli_matcher *root, cli_ctx *ctx,
+                                uint32_t *start, uint32_t *end)
+{
+    uint64_t sigprof_start = cli_sigprof_now();
+    const char *name       = pattern->virname;
+    int ret;
+
+    ret = ac_findmatch(buffer, offset, fileoffset, length, pattern, start, end);
+
+    if (pattern->lsigid[0] && pattern->lsigid[1] < root->ac_lsigs)
+        name = root->ac_lsigtable[pattern->lsigid[1]]->virname;
+    cli_sigprof_record(ctx->telemetry, name, SIGPROF_AC, sigprof_start);
+
+    return ret;
+}
+
 cl_error_t cli_ac_scanbuff(
     const unsigned char *buffer,
     uint32_t length,
@@ -1714,7 +1739,7 @@ cl_error_t cli_ac_scanbuff(
     uint16_t j;
     uint8_t found, viruses_found = 0;
     uint32_t **offmatrix, swp;
-    int type = CL_CLEAN;
+    int type = CL_CLEAN, matched;
     struct cli_ac_result *newres;
     int rc;
 
@@ -1763,7 +1788,11 @@ cl_error_t cli_ac_scanbuff(
                 }
 
                 ptN = pattN;
-                if (ac_findmatch(buffer, bp, offset + bp, length, patt, &matchstart, &matchend)) {
+                if (ctx && cli_sigprof_sample(ctx->telemetry))
+                    matched = ac_findmatch_sampled(buffer, bp, offset + bp, length, patt, root, ctx, &matchstart, &matchend);
+                else
+                    matched = ac_findmatch(buffer, bp, offset + bp, length, patt, &matchstart, &matchend);
+                if (matched) {
                     while (ptN) {
                         pt = ptN->me;
                         if (pt->partno > mdata->min_partno)
@@ -2902,14 +2931,14 @@ cl_error_t cli_ac_addsig(struct cli_matcher *root, const char *virname, const ch
     if (ret != CL_SUCCESS) {
         MPOOL_FREE(root->mempool, new->prefix ? new->prefix : new->pattern);
         mpool_ac_free_special(root->mempool, new);
-        MPOOL_FREE(root->mempool, new->virname);
+        MPOOL_FREE_VIRNAME(root->mempool, new->virname);
         MPOOL_FREE(root->mempool, new);
         return ret;
     }
 
     if ((ret = cli_ac_addpatt(root, new))) {
         MPOOL_FREE(root->mempool, new->prefix ? new->prefix : new->pattern);
-        MPOOL_FREE(root->mempool, new->virname);
+        MPOOL_FREE_VIRNAME(root->mempool, new->virname);
         mpool_ac_free_special(root->mempool, new);
         MPOOL_FREE(root->mempool, new);
         return ret;
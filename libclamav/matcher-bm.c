@@ -233,8 +233,12 @@ void cli_bm_free(struct cli_matcher *root)
                     MPOOL_FREE(root->mempool, prev->prefix);
                 else
                     MPOOL_FREE(root->mempool, prev->pattern);
-                if (prev->virname)
-                    MPOOL_FREE(root->mempool, prev->virname);
+                if (prev->virname) {
+                    if (root->bm_own_virnames)
+                        MPOOL_FREE(root->mempool, prev->virname);
+                    else
+                        MPOOL_FREE_VIRNAME(root->mempool, prev->virname);
+                }
                 MPOOL_FREE(root->mempool, prev);
             }
         }
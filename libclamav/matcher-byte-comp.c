@@ -1040,7 +1040,7 @@ void cli_bcomp_freemeta(struct cli_matcher *root, struct cli_bcomp_meta *bm)
     }
 
     if (bm->virname) {
-        MPOOL_FREE(root->mempool, bm->virname);
+        MPOOL_FREE_VIRNAME(root->mempool, bm->virname);
         bm->virname = NULL;
     }
 
@@ -319,7 +319,7 @@ void hm_free(struct cli_matcher *root)
 
             MPOOL_FREE(root->mempool, szh->hash_array);
             while (szh->items)
-                MPOOL_FREE(root->mempool, (void *)szh->virusnames[--szh->items]);
+                MPOOL_FREE_VIRNAME(root->mempool, (void *)szh->virusnames[--szh->items]);
             MPOOL_FREE(root->mempool, szh->virusnames);
             MPOOL_FREE(root->mempool, szh);
         }
@@ -334,7 +334,7 @@ void hm_free(struct cli_matcher *root)
 
         MPOOL_FREE(root->mempool, szh->hash_array);
         while (szh->items)
-            MPOOL_FREE(root->mempool, (void *)szh->virusnames[--szh->items]);
+            MPOOL_FREE_VIRNAME(root->mempool, (void *)szh->virusnames[--szh->items]);
         MPOOL_FREE(root->mempool, szh->virusnames);
     }
 }
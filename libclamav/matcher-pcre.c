@@ -791,7 +791,7 @@ void cli_pcre_freemeta(struct cli_matcher *root, struct cli_pcre_meta *pm)
     }
 
     if (pm->virname) {
-        MPOOL_FREE(root->mempool, pm->virname);
+        MPOOL_FREE_VIRNAME(root->mempool, pm->virname);
         pm->virname = NULL;
     }
 
@@ -51,6 +51,7 @@
 #include "regex/regex.h"
 #include "filtering.h"
 #include "perflogging.h"
+#include "telemetry.h"
 #include "bytecode_priv.h"
 #include "bytecode_api_impl.h"
 #ifdef HAVE_YARA
@@ -517,7 +518,8 @@ void cli_targetinfo_init(struct cli_target_info *info)
     if (NULL == info) {
         return;
     }
-    info->status = 0;
+    info->status   = 0;
+    info->borrowed = 0;
     cli_exe_info_init(&(info->exeinfo), 0);
 }
 
@@ -540,15 +542,27 @@ void cli_targetinfo_init(struct cli_target_info *info)
 void cli_targetinfo(struct cli_target_info *info, unsigned int target, fmap_t *map)
 {
     int (*einfo)(fmap_t *, struct cli_exe_info *) = NULL;
+    const struct cli_exe_info *cached;
 
     info->fsize = map->len;
 
+    if (target == 6 || target == 9) {
+        /* ELF and Mach-O headers are parsed once per map, see cli_exe_info_get().
+         * The sections stay with the map, which outlives this info. */
+        if (NULL == (cached = cli_exe_info_get(map, target))) {
+            info->status = -1;
+            return;
+        }
+        info->exeinfo.ep        = cached->ep;
+        info->exeinfo.nsections = cached->nsections;
+        info->exeinfo.sections  = cached->sections;
+        info->borrowed          = 1;
+        info->status            = 1;
+        return;
+    }
+
     if (target == 1)
         einfo = cli_pe_targetinfo;
-    else if (target == 6)
-        einfo = cli_elfheader;
-    else if (target == 9)
-        einfo = cli_machoheader;
     else
         return;
 
@@ -571,6 +585,11 @@ void cli_targetinfo_destroy(struct cli_target_info *info)
         return;
     }
 
+    if (info->borrowed) {
+        info->exeinfo.sections  = NULL;
+        info->exeinfo.nsections = 0;
+        info->borrowed          = 0;
+    }
     cli_exe_info_destroy(&(info->exeinfo));
     info->status = 0;
 }
@@ -778,6 +797,28 @@ cl_error_t cli_scan_desc(int desc, cli_ctx *ctx, cli_file_t ftype, uint8_t ftonl
     return ret;
 }
 
+cl_error_t cli_scan_mem(const void *buffer, size_t length, cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct cli_matched_type **ftoffset, unsigned int acmode, struct cli_ac_result **acres, const char *name)
+{
+    cl_error_t ret = CL_EMEM;
+    fmap_t *map    = *ctx->fmap; /* Store off the parent fmap for easy reference */
+
+    if (!length)
+        return CL_CLEAN;
+
+    ctx->fmap++; /* Perform scan with child fmap */
+    if (NULL != (*ctx->fmap = fmap_open_memory(buffer, length, name))) {
+        /* Calculate the fmap hash to be used by the FP check, as fmap() does */
+        if (CL_SUCCESS == (ret = fmap_get_MD5((*ctx->fmap)->maphash, *ctx->fmap))) {
+            ret                  = cli_scan_fmap(ctx, ftype, ftonly, ftoffset, acmode, acres, NULL);
+            map->dont_cache_flag = (*ctx->fmap)->dont_cache_flag;
+        }
+        funmap(*ctx->fmap);
+    }
+    ctx->fmap--; /* Restore the parent fmap */
+
+    return ret;
+}
+
 static int intermediates_eval(cli_ctx *ctx, struct cli_ac_lsig *ac_lsig)
 {
     uint32_t i, icnt = ac_lsig->tdb.intermediates[0];
@@ -795,6 +836,21 @@ static int intermediates_eval(cli_ctx *ctx, struct cli_ac_lsig *ac_lsig)
     return 1;
 }
 
+static int lsig_runbc(cli_ctx *ctx, struct cli_target_info *target_info, struct cli_ac_lsig *ac_lsig, struct cli_ac_data *acdata, uint32_t lsid, fmap_t *map)
+{
+    uint64_t sigprof_start;
+    int ret;
+
+    if (!ac_lsig->bc_idx || !cli_sigprof_sample(ctx->telemetry))
+        return cli_bytecode_runlsig(ctx, target_info, &ctx->engine->bcs, ac_lsig->bc_idx, acdata->lsigcnt[lsid], acdata->lsigsuboff_first[lsid], map);
+
+    sigprof_start = cli_sigprof_now();
+    ret           = cli_bytecode_runlsig(ctx, target_info, &ctx->engine->bcs, ac_lsig->bc_idx, acdata->lsigcnt[lsid], acdata->lsigsuboff_first[lsid], map);
+    cli_sigprof_record(ctx->telemetry, ac_lsig->virname, SIGPROF_BYTECODE, sigprof_start);
+
+    return ret;
+}
+
 static cl_error_t lsig_eval(cli_ctx *ctx, struct cli_matcher *root, struct cli_ac_data *acdata, struct cli_target_info *target_info, const char *hash, uint32_t lsid)
 {
     unsigned evalcnt            = 0;
@@ -846,7 +902,7 @@ static cl_error_t lsig_eval(cli_ctx *ctx, struct cli_matcher *root, struct cli_a
                     rc = cli_append_virus(ctx, ac_lsig->virname);
                     if (rc != CL_CLEAN)
                         return rc;
-                } else if (cli_bytecode_runlsig(ctx, target_info, &ctx->engine->bcs, ac_lsig->bc_idx, acdata->lsigcnt[lsid], acdata->lsigsuboff_first[lsid], map) == CL_VIRUS) {
+                } else if (lsig_runbc(ctx, target_info, ac_lsig, acdata, lsid, map) == CL_VIRUS) {
                     return CL_VIRUS;
                 }
             }
@@ -857,7 +913,7 @@ static cl_error_t lsig_eval(cli_ctx *ctx, struct cli_matcher *root, struct cli_a
             if (rc != CL_CLEAN)
                 return rc;
         }
-        if (cli_bytecode_runlsig(ctx, target_info, &ctx->engine->bcs, ac_lsig->bc_idx, acdata->lsigcnt[lsid], acdata->lsigsuboff_first[lsid], map) == CL_VIRUS) {
+        if (lsig_runbc(ctx, target_info, ac_lsig, acdata, lsid, map) == CL_VIRUS) {
             return CL_VIRUS;
         }
     }
@@ -900,13 +956,24 @@ cl_error_t cli_exp_eval(cli_ctx *ctx, struct cli_matcher *root, struct cli_ac_da
     uint8_t viruses_found = 0;
     uint32_t i;
     cl_error_t rc = CL_SUCCESS;
+    uint64_t sigprof_start = 0;
+    int sampled;
 
     for (i = 0; i < root->ac_lsigs; i++) {
-        if (root->ac_lsigtable[i]->type == CLI_LSIG_NORMAL)
+        sampled = cli_sigprof_sample(ctx->telemetry);
+        if (sampled)
+            sigprof_start = cli_sigprof_now();
+        if (root->ac_lsigtable[i]->type == CLI_LSIG_NORMAL) {
             rc = lsig_eval(ctx, root, acdata, target_info, hash, i);
+            if (sampled)
+                cli_sigprof_record(ctx->telemetry, root->ac_lsigtable[i]->virname, SIGPROF_LSIG, sigprof_start);
+        }
 #ifdef HAVE_YARA
-        else if (root->ac_lsigtable[i]->type == CLI_YARA_NORMAL || root->ac_lsigtable[i]->type == CLI_YARA_OFFSET)
+        else if (root->ac_lsigtable[i]->type == CLI_YARA_NORMAL || root->ac_lsigtable[i]->type == CLI_YARA_OFFSET) {
             rc = yara_eval(ctx, root, acdata, target_info, hash, i);
+            if (sampled)
+                cli_sigprof_record(ctx->telemetry, root->ac_lsigtable[i]->virname, SIGPROF_YARA, sigprof_start);
+        }
 #endif
         if (rc == CL_VIRUS) {
             viruses_found = 1;
@@ -976,6 +1043,20 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
         }
     }
 
+    /* Unless some signatures target graphics files, the image fast path only
+     * checks the hashes of images rather than running the generic signatures
+     * over all of the pixel data */
+    if (!ftonly && (ctx->engine->engine_options & ENGINE_OPTIONS_IMAGE_FASTPATH) &&
+        (ftype == CL_TYPE_GRAPHICS || ftype == CL_TYPE_GIF || ftype == CL_TYPE_PNG)) {
+        struct cli_matcher *iroot = ctx->engine->root[5];
+
+        if (!iroot || (!iroot->ac_patterns && !iroot->bm_patterns && !iroot->pcre_metas && !iroot->ac_lsigs)) {
+            cli_dbgmsg("cli_scan_fmap: no graphics signatures, matching hashes only\n");
+            groot = NULL;
+            troot = NULL;
+        }
+    }
+
     if (ftonly) {
         if (!troot) {
             cl_hash_destroy(md5ctx);
@@ -985,11 +1066,13 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
         }
 
         maxpatlen = troot->maxpatlen;
-    } else {
+    } else if (groot) {
         if (troot)
             maxpatlen = MAX(troot->maxpatlen, groot->maxpatlen);
         else
             maxpatlen = groot->maxpatlen;
+    } else {
+        maxpatlen = 0;
     }
 
     cli_targetinfo_init(&info);
@@ -1037,7 +1120,7 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
         ret = CL_CLEAN;
     }
 
-    if (!ftonly) {
+    if (groot) {
         if ((ret = cli_ac_initdata(&gdata, groot->ac_partsigs, groot->ac_lsigs, groot->ac_reloff_num, CLI_DEFAULT_AC_TRACKLEN)) ||
             (ret = cli_ac_caloff(groot, &gdata, &info))) {
             cli_targetinfo_destroy(&info);
@@ -1059,7 +1142,7 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
     if (troot) {
         if ((ret = cli_ac_initdata(&tdata, troot->ac_partsigs, troot->ac_lsigs, troot->ac_reloff_num, CLI_DEFAULT_AC_TRACKLEN)) ||
             (ret = cli_ac_caloff(troot, &tdata, &info))) {
-            if (!ftonly) {
+            if (groot) {
                 cli_ac_freedata(&gdata);
                 cli_pcre_freeoff(&gpoff);
             }
@@ -1072,7 +1155,7 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
         if (troot->bm_offmode) {
             if (map->len >= CLI_DEFAULT_BM_OFFMODE_FSIZE) {
                 if ((ret = cli_bm_initoff(troot, &toff, &info))) {
-                    if (!ftonly) {
+                    if (groot) {
                         cli_ac_freedata(&gdata);
                         cli_pcre_freeoff(&gpoff);
                     }
@@ -1089,7 +1172,7 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
             }
         }
         if ((ret = cli_pcre_recaloff(troot, &tpoff, &info, ctx))) {
-            if (!ftonly) {
+            if (groot) {
                 cli_ac_freedata(&gdata);
                 cli_pcre_freeoff(&gpoff);
             }
@@ -1158,7 +1241,7 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
                 viruses_found = 1;
             }
             if ((ret == CL_VIRUS && !SCAN_ALLMATCHES) || ret == CL_EMEM) {
-                if (!ftonly) {
+                if (groot) {
                     cli_ac_freedata(&gdata);
                     cli_pcre_freeoff(&gpoff);
                 }
@@ -1177,31 +1260,33 @@ cl_error_t cli_scan_fmap(cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct
         }
 
         if (!ftonly) {
-            virname = NULL;
-            ret     = matcher_run(groot, buff, bytes, &virname, &gdata, offset, &info, ftype, ftoffset, acmode, PCRE_SCAN_FMAP, acres, map, NULL, &gpoff, ctx);
+            if (groot) {
+                virname = NULL;
+                ret     = matcher_run(groot, buff, bytes, &virname, &gdata, offset, &info, ftype, ftoffset, acmode, PCRE_SCAN_FMAP, acres, map, NULL, &gpoff, ctx);
 
-            if (virname) {
-                /* virname already appended by matcher_run */
-                viruses_found = 1;
-            }
-            if ((ret == CL_VIRUS && !SCAN_ALLMATCHES) || ret == CL_EMEM) {
-                cli_ac_freedata(&gdata);
-                cli_pcre_freeoff(&gpoff);
-                if (troot) {
-                    cli_ac_freedata(&tdata);
-                    if (bm_offmode)
-                        cli_bm_freeoff(&toff);
-                    cli_pcre_freeoff(&tpoff);
+                if (virname) {
+                    /* virname already appended by matcher_run */
+                    viruses_found = 1;
                 }
+                if ((ret == CL_VIRUS && !SCAN_ALLMATCHES) || ret == CL_EMEM) {
+                    cli_ac_freedata(&gdata);
+                    cli_pcre_freeoff(&gpoff);
+                    if (troot) {
+                        cli_ac_freedata(&tdata);
+                        if (bm_offmode)
+                            cli_bm_freeoff(&toff);
+                        cli_pcre_freeoff(&tpoff);
+                    }
 
-                cli_targetinfo_destroy(&info);
-                cl_hash_destroy(md5ctx);
-                cl_hash_destroy(sha1ctx);
-                cl_hash_destroy(sha256ctx);
-                return ret;
-            } else if ((acmode & AC_SCAN_FT) && ((cli_file_t)ret >= CL_TYPENO)) {
-                if (ret > type)
-                    type = ret;
+                    cli_targetinfo_destroy(&info);
+                    cl_hash_destroy(md5ctx);
+                    cl_hash_destroy(sha1ctx);
+                    cl_hash_destroy(sha256ctx);
+                    return ret;
+                } else if ((acmode & AC_SCAN_FT) && ((cli_file_t)ret >= CL_TYPENO)) {
+                    if (ret > type)
+                        type = ret;
+                }
             }
 
             /* if (bytes <= (maxpatlen * (offset!=0))), it means the last window finished the file hashing *
@@ -32,7 +32,8 @@
 struct cli_target_info {
     off_t fsize;
     struct cli_exe_info exeinfo;
-    int status; /* 0 == not initialised, 1 == initialised OK, -1 == error */
+    int status;   /* 0 == not initialised, 1 == initialised OK, -1 == error */
+    int borrowed; /* exeinfo.sections belong to the map, see cli_exe_info_get() */
 };
 
 void cli_targetinfo_init(struct cli_target_info *info);
@@ -120,6 +121,7 @@ struct cli_matcher {
     struct cli_bm_patt **bm_suffix, **bm_pattab;
     uint32_t *soff, soff_len; /* for PE section sigs */
     uint32_t bm_offmode, bm_patterns, bm_reloff_num, bm_absoff_num;
+    uint8_t bm_own_virnames; /* BM virnames are private data, not from CLI_MPOOL_VIRNAME() */
 
     /* HASH */
     struct cli_hash_patt hm;
@@ -259,6 +261,24 @@ cl_error_t cli_scan_buff(const unsigned char *buffer, uint32_t length, uint32_t
  */
 cl_error_t cli_scan_desc(int desc, cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct cli_matched_type **ftoffset, unsigned int acmode, struct cli_ac_result **acres, const char *name);
 
+/**
+ * @brief Non-magic scan matching of a memory buffer.
+ *
+ * Same as cli_scan_desc(), for data that was decoded into memory.
+ *
+ * @param buffer    The data to scan
+ * @param length    Size of the data
+ * @param ctx       The scanning context.
+ * @param ftype     If specified, may limit signature matching trie by target type corresponding with the specified CL_TYPE
+ * @param ftonly    Boolean indicating if the scan is for file-type detection only.
+ * @param ftoffset  [out] A list of file type signature matches with their corresponding offsets.
+ * @param acmode    Use AC_SCAN_VIR and AC_SCAN_FT to set scanning modes.
+ * @param acres     [out] A list of cli_ac_result AC pattern matching results.
+ * @param name      (optional) Original name of the data (to set fmap name metadata)
+ * @return cl_error_t
+ */
+cl_error_t cli_scan_mem(const void *buffer, size_t length, cli_ctx *ctx, cli_file_t ftype, uint8_t ftonly, struct cli_matched_type **ftoffset, unsigned int acmode, struct cli_ac_result **acres, const char *name);
+
 /**
  * @brief Non-magic scan matching of the current fmap in the scan context.  Newer API.
  *
@@ -376,9 +376,21 @@ struct MPMAP {
     size_t usize;
 };
 
+/* deduplicated virus names handed out by cli_mpool_virname() */
+struct MPVNAMES {
+    const char **tab; /* open addressing, capacity is a power of 2 */
+    uint32_t capacity, count;
+    char *block; /* names are packed into blocks of VNAMES_BLOCKSZ */
+    size_t block_used;
+};
+
+#define VNAMES_BLOCKSZ 65536
+#define VNAMES_MINCAP 4096
+
 struct MP {
     size_t psize;
     struct FRAG *avail[FRAGSBITS];
+    struct MPVNAMES vnames;
     union {
         struct MPMAP mpm;
         uint64_t dummy_align;
@@ -553,6 +565,7 @@ void mpool_flush(struct MP *mp)
     }
     used += mp->u.mpm.size;
     cli_dbgmsg("pool memory used: %.3f MB\n", used / (1024 * 1024.0));
+    cli_dbgmsg("pool virus names: %u unique\n", mp->vnames.count);
     spam("Map flushed @%p, in use: %lu\n", mp, (unsigned long)used);
 }
 
@@ -822,6 +835,89 @@ char *cli_mpool_strndup(mpool_t *mp, const char *s, size_t n)
     return alloc;
 }
 
+static uint32_t vname_hash(const char *name, size_t namelen, const char *suffix, size_t suffixlen)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    size_t i;
+
+    for (i = 0; i < namelen; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    for (i = 0; i < suffixlen; i++)
+        h = (h ^ (unsigned char)suffix[i]) * 16777619u;
+    return h;
+}
+
+static int vname_grow(struct MP *mp)
+{
+    struct MPVNAMES *vn = &mp->vnames;
+    const char **newtab;
+    uint32_t newcap, i, j;
+
+    newcap = vn->capacity ? vn->capacity * 2 : VNAMES_MINCAP;
+    newtab = mpool_calloc(mp, newcap, sizeof(*newtab));
+    if (!newtab)
+        return -1;
+
+    for (i = 0; i < vn->capacity; i++) {
+        if (!vn->tab[i])
+            continue;
+        j = vname_hash(vn->tab[i], strlen(vn->tab[i]), NULL, 0) & (newcap - 1);
+        while (newtab[j])
+            j = (j + 1) & (newcap - 1);
+        newtab[j] = vn->tab[i];
+    }
+
+    if (vn->tab)
+        mpool_free(mp, vn->tab);
+    vn->tab      = newtab;
+    vn->capacity = newcap;
+    return 0;
+}
+
+/*
+ * Return the pool's single copy of name + suffix, adding it if needed.
+ * Names are packed back to back in large blocks rather than allocated one
+ * by one; they live as long as the pool and must never be mpool_free()d.
+ */
+static char *vname_intern(struct MP *mp, const char *name, const char *suffix)
+{
+    struct MPVNAMES *vn = &mp->vnames;
+    size_t namelen = strlen(name), suffixlen = strlen(suffix), len;
+    uint32_t i;
+    char *str;
+
+    if (vn->count >= vn->capacity / 4 * 3 && vname_grow(mp))
+        return NULL;
+
+    i = vname_hash(name, namelen, suffix, suffixlen) & (vn->capacity - 1);
+    while (vn->tab[i]) {
+        if (!strncmp(vn->tab[i], name, namelen) && !strcmp(vn->tab[i] + namelen, suffix))
+            return (char *)vn->tab[i];
+        i = (i + 1) & (vn->capacity - 1);
+    }
+
+    len = namelen + suffixlen + 1;
+    if (len > VNAMES_BLOCKSZ / 8) {
+        str = mpool_malloc(mp, len);
+    } else {
+        if (!vn->block || vn->block_used + len > VNAMES_BLOCKSZ) {
+            if (!(vn->block = mpool_malloc(mp, VNAMES_BLOCKSZ)))
+                return NULL;
+            vn->block_used = 0;
+        }
+        str = vn->block + vn->block_used;
+        vn->block_used += len;
+    }
+    if (!str)
+        return NULL;
+
+    memcpy(str, name, namelen);
+    memcpy(str + namelen, suffix, suffixlen + 1);
+    vn->tab[i] = str;
+    vn->count++;
+    return str;
+}
+
 /* #define EXPAND_PUA */
 char *cli_mpool_virname(mpool_t *mp, const char *virname, unsigned int official)
 {
@@ -849,15 +945,11 @@ char *cli_mpool_virname(mpool_t *mp, const char *virname, unsigned int official)
         virname              = buf;
     }
 #endif
-    if (official)
-        return cli_mpool_strdup(mp, virname);
-
-    newname = (char *)mpool_malloc(mp, strlen(virname) + 11 + 1);
+    newname = vname_intern(mp, virname, official ? "" : ".UNOFFICIAL");
     if (!newname) {
         cli_errmsg("cli_mpool_virname: Can't allocate memory for newname\n");
         return NULL;
     }
-    sprintf(newname, "%s.UNOFFICIAL", virname);
     return newname;
 }
 
@@ -59,6 +59,8 @@ int mpool_getstats(const struct cl_engine *engine, size_t *used, size_t *total);
 #define CLI_MPOOL_STRDUP(mpool, s) cli_mpool_strdup(mpool, s)
 #define CLI_MPOOL_STRNDUP(mpool, s, n) cli_mpool_strndup(mpool, s, n)
 #define CLI_MPOOL_VIRNAME(mpool, a, b) cli_mpool_virname(mpool, a, b)
+/* names from CLI_MPOOL_VIRNAME() are shared and released with the pool */
+#define MPOOL_FREE_VIRNAME(a, b) ((void)(b))
 #define CLI_MPOOL_HEX2UI(mpool, hex) cli_mpool_hex2ui(mpool, hex)
 #define MPOOL_FLUSH(val) mpool_flush(val)
 #define MPOOL_GETSTATS(mpool, used, total) mpool_getstats(mpool, used, total)
@@ -76,6 +78,7 @@ typedef void mpool_t;
 #define CLI_MPOOL_STRDUP(mpool, s) cli_strdup(s)
 #define CLI_MPOOL_STRNDUP(mpool, s, n) cli_strdup(s, n)
 #define CLI_MPOOL_VIRNAME(mpool, a, b) cli_virname(a, b)
+#define MPOOL_FREE_VIRNAME(a, b) free(b)
 #define CLI_MPOOL_HEX2UI(mpool, hex) cli_hex2ui(hex)
 #define MPOOL_FLUSH(val)
 #define MPOOL_GETSTATS(mpool, used, total) -1
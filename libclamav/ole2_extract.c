@@ -383,36 +383,50 @@ print_ole2_header(ole2_header_t *hdr)
     return;
 }
 
-static int
-ole2_read_block(ole2_header_t *hdr, void *buff, unsigned int size, int32_t blockno)
+/*
+ * Get the first *size bytes of a block straight from the map. *size is
+ * reduced if the file ends before the block does.
+ */
+static const unsigned char *
+ole2_map_block(ole2_header_t *hdr, int32_t blockno, size_t *size)
 {
     off_t offset, offend;
-    const void *pblock;
 
     if (blockno < 0) {
-        return FALSE;
+        return NULL;
     }
     /* other methods: (blockno+1) * 512 or (blockno * block_size) + 512; */
     if (((uint64_t)blockno << hdr->log2_big_block_size) < (INT32_MAX - MAX(512, (uint64_t)1 << hdr->log2_big_block_size))) {
         /* 512 is header size */
         offset = (blockno << hdr->log2_big_block_size) + MAX(512, 1 << hdr->log2_big_block_size);
-        offend = offset + size;
+        offend = offset + *size;
     } else {
-        offset = INT32_MAX - size;
+        offset = INT32_MAX - *size;
         offend = INT32_MAX;
     }
 
     if ((offend <= 0) || (offset < 0) || (offset >= hdr->m_length)) {
-        return FALSE;
+        return NULL;
     } else if (offend > hdr->m_length) {
         /* bb#11369 - ole2 files may not be a block multiple in size */
-        memset(buff, 0, size);
-        size = hdr->m_length - offset;
+        *size = hdr->m_length - offset;
     }
-    if (!(pblock = fmap_need_off_once(hdr->map, offset, size))) {
+    return fmap_need_off_once(hdr->map, offset, *size);
+}
+
+static int
+ole2_read_block(ole2_header_t *hdr, void *buff, unsigned int size, int32_t blockno)
+{
+    size_t avail = size;
+    const unsigned char *pblock;
+
+    if (!(pblock = ole2_map_block(hdr, blockno, &avail))) {
         return FALSE;
     }
-    memcpy(buff, pblock, size);
+    if (avail < size) {
+        memset(buff, 0, size);
+    }
+    memcpy(buff, pblock, avail);
     return TRUE;
 }
 
@@ -509,18 +523,18 @@ ole2_get_next_sbat_block(ole2_header_t *hdr, int32_t current_block)
     return ole2_endian_convert_32(sbat[current_block % 128]);
 }
 
-/* Retrieve the block containing the data for the given sbat index */
+/* Returns the number of the big block holding a small block, -1 on error */
 static int32_t
-ole2_get_sbat_data_block(ole2_header_t *hdr, void *buff, int32_t sbat_index)
+ole2_get_sbat_data_block_number(ole2_header_t *hdr, int32_t sbat_index)
 {
     int32_t block_count, current_block;
 
     if (sbat_index < 0) {
-        return FALSE;
+        return -1;
     }
     if (hdr->sbat_root_start < 0) {
         cli_dbgmsg("No root start block\n");
-        return FALSE;
+        return -1;
     }
     block_count   = sbat_index / (1 << (hdr->log2_big_block_size - hdr->log2_small_block_size));
     current_block = hdr->sbat_root_start;
@@ -533,7 +547,18 @@ ole2_get_sbat_data_block(ole2_header_t *hdr, void *buff, int32_t sbat_index)
      * current_block now contains the block number of the sbat array
      * containing the entry for the required small block
      */
+    return current_block;
+}
 
+/* Retrieve the block containing the data for the given sbat index */
+static int32_t
+ole2_get_sbat_data_block(ole2_header_t *hdr, void *buff, int32_t sbat_index)
+{
+    int32_t current_block = ole2_get_sbat_data_block_number(hdr, sbat_index);
+
+    if (current_block < 0) {
+        return FALSE;
+    }
     return (ole2_read_block(hdr, buff, 1 << hdr->log2_big_block_size, current_block));
 }
 
@@ -952,7 +977,7 @@ struct biff_parser_state {
  * \returns true if a macro has been found, false otherwise.
  */
 static bool
-scan_biff_for_xlm_macros(struct biff_parser_state *state, unsigned char *buff, size_t len, cli_ctx *ctx)
+scan_biff_for_xlm_macros(struct biff_parser_state *state, const unsigned char *buff, size_t len, cli_ctx *ctx)
 {
     size_t i;
     bool found_macro = false;
@@ -1059,14 +1084,15 @@ scan_biff_for_xlm_macros(struct biff_parser_state *state, unsigned char *buff, s
 
 /**
  * Scan for XLM (Excel 4.0) macro sheets in an OLE2 Workbook stream.
- * The stream should be encoded with <= BIFF8.
+ * The stream should be encoded with <= BIFF8. Its blocks are parsed
+ * where they are in the map, nothing is copied.
  */
 static int
 scan_for_xlm_macros(ole2_header_t *hdr, property_t *prop, const char *dir, cli_ctx *ctx)
 {
-    unsigned char *buff = NULL;
+    const unsigned char *block;
     int32_t current_block;
-    size_t len, offset;
+    size_t len, offset, block_size;
     bitset_t *blk_bitset = NULL;
     struct biff_parser_state state;
     bool found_macro = false;
@@ -1084,11 +1110,6 @@ scan_for_xlm_macros(ole2_header_t *hdr, property_t *prop, const char *dir, cli_c
     current_block = prop->start_block;
     len           = prop->size;
 
-    buff = (unsigned char *)cli_malloc(1 << hdr->log2_big_block_size);
-    if (!buff) {
-        cli_errmsg("OLE2 [scan_for_xlm_macros]: Unable to allocate memory for buff: %u\n", 1 << hdr->log2_big_block_size);
-        goto done;
-    }
     blk_bitset = cli_bitset_init();
     if (!blk_bitset) {
         cli_errmsg("OLE2 [scan_for_xlm_macros]: init bitset failed\n");
@@ -1110,32 +1131,36 @@ scan_for_xlm_macros(ole2_header_t *hdr, property_t *prop, const char *dir, cli_c
         }
         if (prop->size < (int64_t)hdr->sbat_cutoff) {
             /* Small block file */
-            if (!ole2_get_sbat_data_block(hdr, buff, current_block)) {
-                cli_dbgmsg("OLE2 [scan_for_xlm_macros]: ole2_get_sbat_data_block failed\n");
+            block_size = 1 << hdr->log2_big_block_size;
+            block      = ole2_map_block(hdr, ole2_get_sbat_data_block_number(hdr, current_block), &block_size);
+            if (!block) {
+                cli_dbgmsg("OLE2 [scan_for_xlm_macros]: ole2_map_block failed for small block\n");
                 goto done;
             }
-            /* buff now contains the block with N small blocks in it */
+            /* block now contains the block with N small blocks in it */
             offset = (1 << hdr->log2_small_block_size) * (current_block % (1 << (hdr->log2_big_block_size - hdr->log2_small_block_size)));
+            if (offset >= block_size) {
+                cli_dbgmsg("OLE2 [scan_for_xlm_macros]: small block is past the end of the file\n");
+                goto done;
+            }
 
-            found_macro = scan_biff_for_xlm_macros(&state, &buff[offset], MIN(len, 1 << hdr->log2_small_block_size), ctx) || found_macro;
+            found_macro = scan_biff_for_xlm_macros(&state, &block[offset], MIN(MIN(len, 1 << hdr->log2_small_block_size), block_size - offset), ctx) || found_macro;
             len -= MIN(len, 1 << hdr->log2_small_block_size);
             current_block = ole2_get_next_sbat_block(hdr, current_block);
         } else {
             /* Big block file */
-            if (!ole2_read_block(hdr, buff, 1 << hdr->log2_big_block_size, current_block)) {
+            block_size = MIN(len, (1 << hdr->log2_big_block_size));
+            if (!(block = ole2_map_block(hdr, current_block, &block_size))) {
                 goto done;
             }
 
-            found_macro   = scan_biff_for_xlm_macros(&state, buff, MIN(len, (1 << hdr->log2_big_block_size)), ctx) || found_macro;
+            found_macro   = scan_biff_for_xlm_macros(&state, block, block_size, ctx) || found_macro;
             current_block = ole2_get_next_block_number(hdr, current_block);
             len -= MIN(len, (1 << hdr->log2_big_block_size));
         }
     }
 
 done:
-    if (buff) {
-        free(buff);
-    }
     if (blk_bitset) {
         cli_bitset_free(blk_bitset);
     }
@@ -74,6 +74,7 @@
 #include "cache.h"
 #include "readdb.h"
 #include "stats.h"
+#include "telemetry.h"
 
 cl_unrar_error_t (*cli_unrar_open)(const char *filename, void **hArchive, char **comment, uint32_t *comment_size, uint8_t debug_flag);
 cl_unrar_error_t (*cli_unrar_peek_file_header)(void *hArchive, unrar_metadata_t *file_metadata);
@@ -425,6 +426,8 @@ struct cl_engine *cl_engine_new(void)
         new->stats_data = NULL;
     }
 
+    new->counters = cli_counters_new();
+
     new->cb_stats_add_sample      = NULL;
     new->cb_stats_submit          = NULL;
     new->cb_stats_flush           = clamav_stats_flush;
@@ -540,6 +543,12 @@ cl_error_t cl_engine_set_num(struct cl_engine *engine, enum cl_engine_field fiel
         case CL_ENGINE_DB_OPTIONS:
         case CL_ENGINE_DB_VERSION:
         case CL_ENGINE_DB_TIME:
+        case CL_ENGINE_SCANS:
+        case CL_ENGINE_SCANNED_BYTES:
+        case CL_ENGINE_CACHE_LOOKUPS:
+        case CL_ENGINE_CACHE_HITS:
+        case CL_ENGINE_CACHE_MEMORY:
+        case CL_ENGINE_TEMPFILES:
             cli_warnmsg("cl_engine_set_num: The field is read only\n");
             return CL_EARG;
         case CL_ENGINE_AC_ONLY:
@@ -641,6 +650,33 @@ cl_error_t cl_engine_set_num(struct cl_engine *engine, enum cl_engine_field fiel
                 engine->engine_options &= ~(ENGINE_OPTIONS_PE_DUMPCERTS);
             }
             break;
+        case CL_ENGINE_TELEMETRY:
+            if (num) {
+                /* kept until the engine is freed, so scans in flight never lose it */
+                if (!engine->telemetry && !(engine->telemetry = cli_telemetry_new()))
+                    return CL_EMEM;
+                engine->engine_options |= ENGINE_OPTIONS_TELEMETRY;
+            } else {
+                engine->engine_options &= ~(ENGINE_OPTIONS_TELEMETRY);
+            }
+            break;
+        case CL_ENGINE_TELEMETRY_SIGNATURES:
+            engine->telemetry_signatures = (uint32_t)num;
+            break;
+        case CL_ENGINE_BUDGET_RESERVE:
+            if (num < 0 || num > 90) {
+                cli_errmsg("cl_engine_set_num: CL_ENGINE_BUDGET_RESERVE must be between 0 and 90\n");
+                return CL_EARG;
+            }
+            engine->budget_reserve = (uint32_t)num;
+            break;
+        case CL_ENGINE_IMAGE_FASTPATH:
+            if (num) {
+                engine->engine_options |= ENGINE_OPTIONS_IMAGE_FASTPATH;
+            } else {
+                engine->engine_options &= ~(ENGINE_OPTIONS_IMAGE_FASTPATH);
+            }
+            break;
         default:
             cli_errmsg("cl_engine_set_num: Incorrect field number\n");
             return CL_EARG;
@@ -724,6 +760,23 @@ long long cl_engine_get_num(const struct cl_engine *engine, enum cl_engine_field
             return engine->pcre_recmatch_limit;
         case CL_ENGINE_PCRE_MAX_FILESIZE:
             return engine->pcre_max_filesize;
+        case CL_ENGINE_TELEMETRY:
+            return (engine->engine_options & ENGINE_OPTIONS_TELEMETRY) ? 1 : 0;
+        case CL_ENGINE_TELEMETRY_SIGNATURES:
+            return engine->telemetry_signatures;
+        case CL_ENGINE_BUDGET_RESERVE:
+            return engine->budget_reserve;
+        case CL_ENGINE_IMAGE_FASTPATH:
+            return (engine->engine_options & ENGINE_OPTIONS_IMAGE_FASTPATH) ? 1 : 0;
+        case CL_ENGINE_SCANS:
+        case CL_ENGINE_SCANNED_BYTES:
+        case CL_ENGINE_CACHE_LOOKUPS:
+        case CL_ENGINE_CACHE_HITS:
+            return cli_counters_get(engine->counters, field);
+        case CL_ENGINE_CACHE_MEMORY:
+            return cli_cache_memory(engine);
+        case CL_ENGINE_TEMPFILES:
+            return cli_gentemp_count();
         default:
             cli_errmsg("cl_engine_get: Incorrect field number\n");
             if (err)
@@ -810,6 +863,7 @@ struct cl_settings *cl_engine_settings_copy(const struct cl_engine *engine)
     settings->maxfilesize        = engine->maxfilesize;
     settings->maxreclevel        = engine->maxreclevel;
     settings->maxfiles           = engine->maxfiles;
+    settings->budget_reserve     = engine->budget_reserve;
     settings->maxembeddedpe      = engine->maxembeddedpe;
     settings->maxhtmlnormalize   = engine->maxhtmlnormalize;
     settings->maxhtmlnotags      = engine->maxhtmlnotags;
@@ -831,8 +885,11 @@ struct cl_settings *cl_engine_settings_copy(const struct cl_engine *engine)
     settings->cb_hash        = engine->cb_hash;
     settings->cb_meta        = engine->cb_meta;
     settings->cb_file_props  = engine->cb_file_props;
+    settings->cb_trace       = engine->cb_trace;
     settings->engine_options = engine->engine_options;
 
+    settings->telemetry_signatures = engine->telemetry_signatures;
+
     settings->cb_stats_add_sample      = engine->cb_stats_add_sample;
     settings->cb_stats_remove_sample   = engine->cb_stats_remove_sample;
     settings->cb_stats_decrement_count = engine->cb_stats_decrement_count;
@@ -865,6 +922,7 @@ cl_error_t cl_engine_settings_apply(struct cl_engine *engine, const struct cl_se
     engine->maxfilesize        = settings->maxfilesize;
     engine->maxreclevel        = settings->maxreclevel;
     engine->maxfiles           = settings->maxfiles;
+    engine->budget_reserve     = settings->budget_reserve;
     engine->maxembeddedpe      = settings->maxembeddedpe;
     engine->maxhtmlnormalize   = settings->maxhtmlnormalize;
     engine->maxhtmlnotags      = settings->maxhtmlnotags;
@@ -877,6 +935,15 @@ cl_error_t cl_engine_settings_apply(struct cl_engine *engine, const struct cl_se
     engine->bytecode_mode      = settings->bytecode_mode;
     engine->engine_options     = settings->engine_options;
 
+    engine->telemetry_signatures = settings->telemetry_signatures;
+
+    /* counters are not carried over, the new engine starts its own */
+    if ((engine->engine_options & ENGINE_OPTIONS_TELEMETRY) && !engine->telemetry) {
+        engine->telemetry = cli_telemetry_new();
+        if (!engine->telemetry)
+            return CL_EMEM;
+    }
+
     if (engine->tmpdir)
         MPOOL_FREE(engine->mempool, engine->tmpdir);
     if (settings->tmpdir) {
@@ -906,6 +973,7 @@ cl_error_t cl_engine_settings_apply(struct cl_engine *engine, const struct cl_se
     engine->cb_hash        = settings->cb_hash;
     engine->cb_meta        = settings->cb_meta;
     engine->cb_file_props  = settings->cb_file_props;
+    engine->cb_trace       = settings->cb_trace;
 
     engine->cb_stats_add_sample      = settings->cb_stats_add_sample;
     engine->cb_stats_remove_sample   = settings->cb_stats_remove_sample;
@@ -1003,6 +1071,96 @@ cl_error_t cli_updatelimits(cli_ctx *ctx, unsigned long needed)
     return CL_CLEAN;
 }
 
+enum budget_class {
+    BUDGET_LOW,    /* yields first: images */
+    BUDGET_NORMAL, /* containers, text (often scripts) and everything not listed */
+    BUDGET_HIGH    /* never yields: executables, documents with macros, scripts */
+};
+
+static enum budget_class budget_class(cli_file_t type)
+{
+    switch (type) {
+        case CL_TYPE_GRAPHICS:
+        case CL_TYPE_GIF:
+        case CL_TYPE_PNG:
+            return BUDGET_LOW;
+        case CL_TYPE_MSEXE:
+        case CL_TYPE_ELF:
+        case CL_TYPE_MACHO:
+        case CL_TYPE_MACHO_UNIBIN:
+        case CL_TYPE_JAVA:
+        case CL_TYPE_MSOLE2:
+        case CL_TYPE_HWPOLE2:
+        case CL_TYPE_OOXML_WORD:
+        case CL_TYPE_OOXML_PPT:
+        case CL_TYPE_OOXML_XL:
+        case CL_TYPE_XML_WORD:
+        case CL_TYPE_XML_XL:
+        case CL_TYPE_PDF:
+        case CL_TYPE_RTF:
+        case CL_TYPE_SWF:
+        case CL_TYPE_SCRIPT:
+        case CL_TYPE_SCRENC:
+        case CL_TYPE_HTML:
+        case CL_TYPE_HTML_UTF16:
+        case CL_TYPE_PS:
+        case CL_TYPE_AUTOIT:
+        case CL_TYPE_LNK:
+            return BUDGET_HIGH;
+        default:
+            return BUDGET_NORMAL;
+    }
+}
+
+/*
+ * Soft limit applied to nested files once their type is known. When
+ * CL_ENGINE_BUDGET_RESERVE is set to R, low value files are skipped once the
+ * scan has used (100 - R)% of its size, file count or time limit, and
+ * everything but high value files once it has used (100 - R/2)%, so what is
+ * left of the limits goes to the content most likely to be malicious.
+ *
+ * A skipped file gives back what cli_updatelimits() accounted for it.
+ */
+cl_error_t cli_checkbudget(cli_ctx *ctx, cli_file_t type, unsigned long size)
+{
+    const struct cl_engine *engine = ctx->engine;
+    enum budget_class class        = budget_class(type);
+    uint64_t used = 0, threshold;
+
+    if (!engine->budget_reserve || class == BUDGET_HIGH)
+        return CL_SUCCESS;
+
+    threshold = 100 - (class == BUDGET_LOW ? engine->budget_reserve : engine->budget_reserve / 2);
+
+    if (engine->maxscansize)
+        used = (uint64_t)ctx->scansize * 100 / engine->maxscansize;
+    if (engine->maxfiles && (uint64_t)ctx->scannedfiles * 100 / engine->maxfiles > used)
+        used = (uint64_t)ctx->scannedfiles * 100 / engine->maxfiles;
+    if (engine->maxscantime && ctx->time_limit.tv_sec) {
+        struct timeval now;
+        int64_t left;
+
+        if (gettimeofday(&now, NULL) == 0) {
+            left = (int64_t)(ctx->time_limit.tv_sec - now.tv_sec) * 1000 + (ctx->time_limit.tv_usec - now.tv_usec) / 1000;
+            if (left < 0)
+                left = 0;
+            if (left < engine->maxscantime && (engine->maxscantime - (uint64_t)left) * 100 / engine->maxscantime > used)
+                used = (engine->maxscantime - (uint64_t)left) * 100 / engine->maxscantime;
+        }
+    }
+
+    if (used < threshold)
+        return CL_SUCCESS;
+
+    cli_dbgmsg("cli_checkbudget: %u%% of the scan limits used, skipping %s (%lu bytes) to keep the rest for high value files\n",
+               (unsigned int)used, cli_ftname(type) ? cli_ftname(type) : "unknown file", size);
+    if (ctx->scannedfiles)
+        ctx->scannedfiles--;
+    ctx->scansize = ctx->scansize > size ? ctx->scansize - size : 0;
+
+    return CL_EMAXSIZE;
+}
+
 /**
  * @brief Check if we've exceeded the time limit.
  * If ctx is NULL, there can be no timelimit so just return success.
@@ -1512,3 +1670,8 @@ void cl_engine_set_clcb_file_props(struct cl_engine *engine, clcb_file_props cal
 {
     engine->cb_file_props = callback;
 }
+
+void cl_engine_set_clcb_trace(struct cl_engine *engine, clcb_trace callback)
+{
+    engine->cb_trace = callback;
+}
@@ -172,6 +172,10 @@ typedef struct cli_ctx_tag {
     bitset_t *hook_lsig_matches;
     void *cb_ctx;
     cli_events_t *perf;
+    struct cli_telemetry_scan *telemetry; /* NULL unless the engine collects telemetry */
+    struct cli_trace *trace;              /* NULL unless the engine has a trace callback */
+    uint32_t cache_lookups;
+    uint32_t cache_hits;
 #ifdef HAVE__INTERNAL__SHA_COLLECT
     int sha_collect;
 #endif
@@ -297,6 +301,7 @@ struct cl_engine {
     uint32_t maxfiles;    /* maximum number of files to be scanned
 				           * within a single archive
 				           */
+    uint32_t budget_reserve; /* percent of the limits above kept for high value files */
     /* This is for structured data detection.  You can set the minimum
      * number of occurrences of an CC# or SSN before the system will
      * generate a notification.
@@ -330,6 +335,8 @@ struct cl_engine {
     /* Filetype definitions */
     struct cli_ftype *ftypes;
     struct cli_ftype *ptypes;
+    struct cli_ftindex *ftindex; /* built from ftypes/ptypes by cl_engine_compile() */
+    struct cli_ftindex *ptindex;
 
     /* Container password storage */
     struct cli_pwdb **pwdbs;
@@ -370,6 +377,7 @@ struct cl_engine {
     clcb_hash cb_hash;
     clcb_meta cb_meta;
     clcb_file_props cb_file_props;
+    clcb_trace cb_trace;
 
     /* Used for bytecode */
     struct cli_all_bc bcs;
@@ -398,6 +406,13 @@ struct cl_engine {
     clcb_stats_get_size cb_stats_get_size;
     clcb_stats_get_hostid cb_stats_get_hostid;
 
+    /* Scan telemetry, allocated when CL_ENGINE_TELEMETRY is first enabled */
+    struct cli_telemetry *telemetry;
+    uint32_t telemetry_signatures; /* signatures listed in the profile, 0 disables profiling */
+
+    /* Scan counters, NULL if they couldn't be allocated */
+    struct cli_counters *counters;
+
     /* Raw disk image max settings */
     uint32_t maxpartitions; /* max number of partitions to scan in a disk image */
 
@@ -431,6 +446,7 @@ struct cl_settings {
     uint64_t maxfilesize;
     uint32_t maxreclevel;
     uint32_t maxfiles;
+    uint32_t budget_reserve;
     uint32_t min_cc_count;
     uint32_t min_ssn_count;
     enum bytecode_security bytecode_security;
@@ -438,6 +454,7 @@ struct cl_settings {
     enum bytecode_mode bytecode_mode;
     char *pua_cats;
     uint64_t engine_options;
+    uint32_t telemetry_signatures;
 
     /* callbacks */
     clcb_pre_cache cb_pre_cache;
@@ -450,6 +467,7 @@ struct cl_settings {
     clcb_hash cb_hash;
     clcb_meta cb_meta;
     clcb_file_props cb_file_props;
+    clcb_trace cb_trace;
 
     /* Engine max settings */
     uint64_t maxembeddedpe;      /* max size to scan MSEXE for PE */
@@ -790,6 +808,26 @@ size_t cli_readn(int fd, void *buff, size_t count);
 size_t cli_writen(int fd, const void *buff, size_t count);
 const char *cli_gettmpdir(void);
 
+/*
+ * Growable buffer that unpackers write their output to instead of a temp
+ * file. The result is scanned in place with cli_magic_scan_buff().
+ */
+struct cli_membuf {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+};
+
+/**
+ * @brief Append @len bytes to a memory buffer.
+ *
+ * @return CL_SUCCESS, CL_EMEM if out of memory, or CL_EMAXSIZE if the
+ *         buffer would grow past CLI_MAX_ALLOCATION. The buffer is left
+ *         unchanged on error.
+ */
+cl_error_t cli_membuf_append(struct cli_membuf *buf, const void *data, size_t len);
+void cli_membuf_free(struct cli_membuf *buf);
+
 /**
  * @brief Sanitize a relative path, so it cannot have a negative depth.
  *
@@ -842,6 +880,13 @@ cl_error_t cli_newfilepathfd(const char *dir, char *fname, char **name, int *fd)
  */
 char *cli_gentemp_with_prefix(const char *dir, const char *prefix);
 
+/**
+ * @brief Number of temporary paths generated by cli_gentemp*() so far.
+ *
+ * @return uint64_t count, for the whole process.
+ */
+uint64_t cli_gentemp_count(void);
+
 /**
  * @brief Generate a full tempfile filepath with a random MD5 hash.
  *
@@ -883,6 +928,7 @@ const char *cli_ctime(const time_t *timep, char *buf, const size_t bufsize);
 void cli_check_blockmax(cli_ctx *, int);
 cl_error_t cli_checklimits(const char *, cli_ctx *, unsigned long, unsigned long, unsigned long);
 cl_error_t cli_updatelimits(cli_ctx *, unsigned long);
+cl_error_t cli_checkbudget(cli_ctx *ctx, cli_file_t type, unsigned long size);
 unsigned long cli_getsizelimit(cli_ctx *, unsigned long);
 int cli_matchregex(const char *str, const char *regex);
 void cli_qsort(void *a, size_t n, size_t es, int (*cmp)(const void *, const void *));
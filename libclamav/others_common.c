@@ -59,10 +59,12 @@
 #include "regex/regex.h"
 #include "ltdl.h"
 #include "matcher-ac.h"
+#include "telemetry.h"
 
 #define MSGBUFSIZ 8192
 
 static unsigned char name_salt[16] = {16, 38, 97, 12, 8, 4, 72, 196, 217, 144, 33, 124, 18, 11, 17, 253};
+static uint64_t gentemp_count; /* protected by cli_gentemp_mutex */
 
 #ifdef CL_NOTHREADS
 #undef CL_THREAD_SAFE
@@ -102,6 +104,15 @@ static inline void *cli_getctx(void)
     ctx = pthread_getspecific(cli_ctx_tls_key);
     return ctx ? ctx->cb_ctx : NULL;
 }
+
+/* Trace of the scan running in this thread, if any */
+static inline struct cli_trace *cli_gettrace(void)
+{
+    cli_ctx *ctx;
+    pthread_once(&cli_ctx_tls_key_once, cli_ctx_tls_key_alloc);
+    ctx = pthread_getspecific(cli_ctx_tls_key);
+    return ctx ? ctx->trace : NULL;
+}
 #else
 
 static const cli_ctx *current_ctx = NULL;
@@ -115,6 +126,11 @@ static inline void *cli_getctx(void)
     return current_ctx ? current_ctx->cb_ctx : NULL;
 }
 
+static inline struct cli_trace *cli_gettrace(void)
+{
+    return current_ctx ? current_ctx->trace : NULL;
+}
+
 void cli_logg_unsetup(void)
 {
 }
@@ -421,6 +437,40 @@ size_t cli_writen(int fd, const void *buff, size_t count)
     return count;
 }
 
+cl_error_t cli_membuf_append(struct cli_membuf *buf, const void *data, size_t len)
+{
+    unsigned char *data_new;
+    size_t size;
+
+    if (len > CLI_MAX_ALLOCATION - buf->len) {
+        cli_dbgmsg("cli_membuf_append: buffer would exceed %u bytes\n", CLI_MAX_ALLOCATION);
+        return CL_EMAXSIZE;
+    }
+
+    if (buf->len + len > buf->size) {
+        size = buf->size ? buf->size * 2 : 65536;
+        if (size < buf->len + len)
+            size = buf->len + len;
+        if (size > CLI_MAX_ALLOCATION)
+            size = CLI_MAX_ALLOCATION;
+
+        if (!(data_new = cli_realloc(buf->data, size)))
+            return CL_EMEM;
+        buf->data = data_new;
+        buf->size = size;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return CL_SUCCESS;
+}
+
+void cli_membuf_free(struct cli_membuf *buf)
+{
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
 int cli_filecopy(const char *src, const char *dest)
 {
 
@@ -1093,9 +1143,33 @@ char *cli_gentemp_with_prefix(const char *dir, const char *prefix)
     snprintf(fullpath, len, "%s" PATHSEP "%s", mdir, fname);
     free(fname);
 
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_lock(&cli_gentemp_mutex);
+#endif
+    gentemp_count++;
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_unlock(&cli_gentemp_mutex);
+#endif
+    cli_trace_tempfile(cli_gettrace());
+
     return (fullpath);
 }
 
+uint64_t cli_gentemp_count(void)
+{
+    uint64_t count;
+
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_lock(&cli_gentemp_mutex);
+#endif
+    count = gentemp_count;
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_unlock(&cli_gentemp_mutex);
+#endif
+
+    return count;
+}
+
 char *cli_gentemp(const char *dir)
 {
     return cli_gentemp_with_prefix(dir, NULL);
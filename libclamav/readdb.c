@@ -75,6 +75,7 @@
 #include "bytecode_priv.h"
 #include "cache.h"
 #include "openioc.h"
+#include "telemetry.h"
 
 #ifdef CL_THREAD_SAFE
 #include <pthread.h>
@@ -625,7 +626,7 @@ cl_error_t cli_parse_add(struct cli_matcher *root, const char *virname, const ch
         if (CL_SUCCESS != (ret = cli_bm_addpatt(root, bm_new, offset))) {
             cli_errmsg("cli_parse_add(): Problem adding signature (4).\n");
             MPOOL_FREE(root->mempool, bm_new->pattern);
-            MPOOL_FREE(root->mempool, bm_new->virname);
+            MPOOL_FREE_VIRNAME(root->mempool, bm_new->virname);
             MPOOL_FREE(root->mempool, bm_new);
             return ret;
         }
@@ -681,6 +682,36 @@ char *cli_dbgets(char *buff, unsigned int size, FILE *fs, struct cli_dbio *dbio)
     if (fs)
         return fgets(buff, size, fs);
 
+    if (dbio->mem) {
+        const char *pt, *nl;
+        unsigned int len;
+
+        if (!dbio->size)
+            return NULL;
+
+        if (dbio->chkonly) {
+            dbio->bread += dbio->size;
+            dbio->size = 0;
+            return NULL;
+        }
+
+        pt  = dbio->mem + dbio->bread;
+        nl  = memchr(pt, '\n', dbio->size);
+        len = nl ? (unsigned int)(nl - pt) : dbio->size;
+        if (len >= size) {
+            cli_errmsg("cli_dbgets: Line too long for provided buffer\n");
+            return NULL;
+        }
+        memcpy(buff, pt, len);
+        buff[len] = 0;
+
+        if (nl)
+            len++;
+        dbio->size -= len;
+        dbio->bread += len;
+        return buff;
+    }
+
     if (dbio->usebuf) {
         int bread;
         char *nl;
@@ -773,6 +804,44 @@ char *cli_dbgets(char *buff, unsigned int size, FILE *fs, struct cli_dbio *dbio)
     }
 }
 
+/*
+ * Like cli_dbgets(), but when the database is held in memory the line is
+ * terminated inside the database buffer and returned without being copied.
+ * Callers must use the returned pointer rather than buff.
+ */
+char *cli_dbgets_inplace(char *buff, unsigned int size, FILE *fs, struct cli_dbio *dbio)
+{
+    char *pt, *nl;
+    unsigned int len;
+
+    if (fs || !dbio->mem || dbio->chkonly)
+        return cli_dbgets(buff, size, fs, dbio);
+
+    if (!dbio->size)
+        return NULL;
+
+    pt  = dbio->mem + dbio->bread;
+    nl  = memchr(pt, '\n', dbio->size);
+    len = nl ? (unsigned int)(nl - pt) : dbio->size;
+    if (len >= size) {
+        cli_errmsg("cli_dbgets: Line too long for provided buffer\n");
+        return NULL;
+    }
+
+    if (nl) {
+        *nl = 0;
+        len++;
+    } else {
+        /* unterminated last line, there is no room for the NUL */
+        memcpy(buff, pt, len);
+        buff[len] = 0;
+        pt        = buff;
+    }
+    dbio->size -= len;
+    dbio->bread += len;
+    return pt;
+}
+
 static char *cli_signorm(const char *signame)
 {
     char *new_signame = NULL;
@@ -816,12 +885,21 @@ static char *cli_signorm(const char *signame)
     return new_signame;
 }
 
-static int cli_chkign(const struct cli_matcher *ignored, const char *signame, const char *entry)
+/*
+ * Check a signature against the ignore list. The entry is the signature's
+ * database line; when delim is set the line has already been tokenized and
+ * the NULs within the first entry_len bytes stand for delim, so the original
+ * line is hashed without being copied.
+ */
+static int cli_chkign_entry(const struct cli_matcher *ignored, const char *signame, const char *entry, size_t entry_len, char delim)
 {
 
     const char *md5_expected = NULL;
     char *norm_signame;
     unsigned char digest[16];
+    const char *pt, *end;
+    size_t seglen;
+    void *ctx;
     int ret = 0;
 
     if (!ignored || !signame || !entry)
@@ -834,7 +912,19 @@ static int cli_chkign(const struct cli_matcher *ignored, const char *signame, co
     if (cli_bm_scanbuff((const unsigned char *)signame, strlen(signame), &md5_expected, NULL, ignored, 0, NULL, NULL, NULL) == CL_VIRUS)
         do {
             if (md5_expected) {
-                cl_hash_data("md5", entry, strlen(entry), digest, NULL);
+                if (!delim) {
+                    cl_hash_data("md5", entry, entry_len, digest, NULL);
+                } else {
+                    if (!(ctx = cl_hash_init("md5")))
+                        break;
+                    for (pt = entry, end = entry + entry_len; pt < end; pt += seglen + 1) {
+                        seglen = strlen(pt);
+                        cl_update_hash(ctx, pt, seglen);
+                        if (pt + seglen < end)
+                            cl_update_hash(ctx, &delim, 1);
+                    }
+                    cl_finish_hash(ctx, digest);
+                }
                 if (memcmp(digest, (const unsigned char *)md5_expected, 16))
                     break;
             }
@@ -848,6 +938,11 @@ static int cli_chkign(const struct cli_matcher *ignored, const char *signame, co
     return ret;
 }
 
+static int cli_chkign(const struct cli_matcher *ignored, const char *signame, const char *entry)
+{
+    return cli_chkign_entry(ignored, signame, entry, entry ? strlen(entry) : 0, 0);
+}
+
 static int cli_chkpua(const char *signame, const char *pua_cats, unsigned int options)
 {
     char cat[32], *pt;
@@ -1236,10 +1331,10 @@ static int cli_loadpdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
 static int cli_loadndb(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigned short sdb, unsigned int options, struct cli_dbio *dbio, const char *dbname)
 {
     const char *tokens[NDB_TOKENS + 1];
-    char buffer[FILEBUFF], *buffer_cpy = NULL;
+    char buff[FILEBUFF], *buffer;
     const char *sig, *virname, *offset, *pt;
     struct cli_matcher *root;
-    int line = 0, sigs = 0, ret = 0, tokens_count;
+    int line = 0, sigs = 0, ret = 0, tokens_count, len;
     unsigned short target;
     unsigned int phish = options & CL_DB_PHISHING;
 
@@ -1248,13 +1343,7 @@ static int cli_loadndb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
     if (CL_SUCCESS != (ret = cli_initroots(engine, options)))
         return ret;
 
-    if (engine->ignored)
-        if (!(buffer_cpy = cli_malloc(FILEBUFF))) {
-            cli_errmsg("cli_loadndb: Can't allocate memory for buffer_cpy\n");
-            return CL_EMEM;
-        }
-
-    while (cli_dbgets(buffer, FILEBUFF, fs, dbio)) {
+    while ((buffer = cli_dbgets_inplace(buff, FILEBUFF, fs, dbio))) {
         line++;
         if (buffer[0] == '#')
             continue;
@@ -1263,9 +1352,7 @@ static int cli_loadndb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
             if (!strncmp(buffer, "HTML.Phishing", 13) || !strncmp(buffer, "Email.Phishing", 14))
                 continue;
 
-        cli_chomp(buffer);
-        if (engine->ignored)
-            strcpy(buffer_cpy, buffer);
+        len = cli_chomp(buffer);
 
         tokens_count = cli_strtokenize(buffer, ':', NDB_TOKENS + 1, tokens);
         if (tokens_count < 4 || tokens_count > 6) {
@@ -1279,7 +1366,7 @@ static int cli_loadndb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
             if (cli_chkpua(virname, engine->pua_cats, options))
                 continue;
 
-        if (engine->ignored && cli_chkign(engine->ignored, virname, buffer_cpy))
+        if (engine->ignored && cli_chkign_entry(engine->ignored, virname, buffer, len, ':'))
             continue;
 
         if (!sdb && engine->cb_sigload && engine->cb_sigload("ndb", virname, ~options & CL_DB_OFFICIAL, engine->cb_sigload_ctx)) {
@@ -1335,8 +1422,6 @@ static int cli_loadndb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
         }
         sigs++;
     }
-    if (engine->ignored)
-        free(buffer_cpy);
 
     if (!line) {
         cli_errmsg("Empty database file\n");
@@ -1690,7 +1775,7 @@ static inline int init_tdb(struct cli_lsig_tdb *tdb, struct cl_engine *engine, c
  */
 #define LDB_TOKENS 67
 #define SUB_TOKENS 4
-static int load_oneldb(char *buffer, int chkpua, struct cl_engine *engine, unsigned int options, const char *dbname, unsigned int line, unsigned int *sigs, unsigned bc_idx, const char *buffer_cpy, int *skip)
+static int load_oneldb(char *buffer, size_t buffer_len, int chkpua, struct cl_engine *engine, unsigned int options, const char *dbname, unsigned int line, unsigned int *sigs, unsigned bc_idx, int *skip)
 {
     const char *sig, *virname, *offset, *logic, *sigopts;
     struct cli_ac_lsig **newtable, *lsig;
@@ -1717,7 +1802,7 @@ static int load_oneldb(char *buffer, int chkpua, struct cl_engine *engine, unsig
     if (chkpua && cli_chkpua(virname, engine->pua_cats, options))
         return CL_SUCCESS;
 
-    if (engine->ignored && cli_chkign(engine->ignored, virname, buffer_cpy ? buffer_cpy : virname)) {
+    if (engine->ignored && (buffer_len ? cli_chkign_entry(engine->ignored, virname, buffer, buffer_len, ';') : cli_chkign(engine->ignored, virname, virname))) {
         if (skip)
             *skip = 1;
         return CL_SUCCESS;
@@ -1887,41 +1972,28 @@ static int load_oneldb(char *buffer, int chkpua, struct cl_engine *engine, unsig
 
 static int cli_loadldb(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigned int options, struct cli_dbio *dbio, const char *dbname)
 {
-    char buffer[CLI_DEFAULT_LSIG_BUFSIZE + 1], *buffer_cpy = NULL;
+    char buff[CLI_DEFAULT_LSIG_BUFSIZE + 1], *buffer;
     unsigned int line = 0, sigs = 0;
-    int ret;
+    int ret, len;
 
     if (CL_SUCCESS != (ret = cli_initroots(engine, options)))
         return ret;
 
-    if (engine->ignored) {
-        if (!(buffer_cpy = cli_malloc(sizeof(buffer)))) {
-            cli_errmsg("cli_loadldb: Can't allocate memory for buffer_cpy\n");
-            return CL_EMEM;
-        }
-    }
-
-    while (cli_dbgets(buffer, sizeof(buffer), fs, dbio)) {
+    while ((buffer = cli_dbgets_inplace(buff, sizeof(buff), fs, dbio))) {
         line++;
         if (buffer[0] == '#')
             continue;
 
         sigs++;
-        cli_chomp(buffer);
+        len = cli_chomp(buffer);
 
-        if (engine->ignored)
-            strcpy(buffer_cpy, buffer);
-
-        ret = load_oneldb(buffer,
+        ret = load_oneldb(buffer, len,
                           engine->pua_cats && (options & CL_DB_PUA_MODE) && (options & (CL_DB_PUA_INCLUDE | CL_DB_PUA_EXCLUDE)),
-                          engine, options, dbname, line, &sigs, 0, buffer_cpy, NULL);
+                          engine, options, dbname, line, &sigs, 0, NULL);
         if (ret)
             break;
     }
 
-    if (engine->ignored)
-        free(buffer_cpy);
-
     if (!line) {
         cli_errmsg("Empty database file\n");
         return CL_EMALFDB;
@@ -2009,7 +2081,7 @@ static int cli_loadcbc(FILE *fs, struct cl_engine *engine, unsigned int *signo,
             return CL_EMALFDB;
         }
         cli_dbgmsg("Bytecode %s(%u) has logical signature: %s\n", dbname, bc->id, bc->lsig);
-        rc = load_oneldb(bc->lsig, 0, engine, options, dbname, 0, &sigs, bcs->count, NULL, &skip);
+        rc = load_oneldb(bc->lsig, 0, 0, engine, options, dbname, 0, &sigs, bcs->count, &skip);
         if (rc != CL_SUCCESS) {
             cli_errmsg("Problem parsing logical signature %s for bytecode %s: %s\n",
                        bc->lsig, dbname, cl_strerror(rc));
@@ -2345,6 +2417,8 @@ static int cli_loadign(FILE *fs, struct cl_engine *engine, unsigned int options,
 #ifdef USE_MPOOL
         engine->ignored->mempool = engine->mempool;
 #endif
+        /* the BM virname slot holds the optional MD5 of the signature */
+        engine->ignored->bm_own_virnames = 1;
         if (CL_SUCCESS != (ret = cli_bm_init(engine->ignored))) {
             cli_errmsg("cli_loadign: Can't initialise AC pattern matcher\n");
             return ret;
@@ -2438,9 +2512,9 @@ static int cli_loadign(FILE *fs, struct cl_engine *engine, unsigned int options,
 static int cli_loadhash(FILE *fs, struct cl_engine *engine, unsigned int *signo, unsigned int mode, unsigned int options, struct cli_dbio *dbio, const char *dbname)
 {
     const char *tokens[MD5_TOKENS + 1];
-    char buffer[FILEBUFF], *buffer_cpy = NULL;
+    char buff[FILEBUFF], *buffer;
     const char *pt, *virname;
-    int ret                 = CL_SUCCESS;
+    int ret                 = CL_SUCCESS, len;
     unsigned int size_field = 1, md5_field = 0, line = 0, sigs = 0, tokens_count;
     unsigned int req_fl = 0;
     struct cli_matcher *db;
@@ -2473,19 +2547,11 @@ static int cli_loadhash(FILE *fs, struct cl_engine *engine, unsigned int *signo,
             engine->hm_fp = db;
     }
 
-    if (engine->ignored)
-        if (!(buffer_cpy = cli_malloc(FILEBUFF))) {
-            cli_errmsg("cli_loadhash: Can't allocate memory for buffer_cpy\n");
-            return CL_EMEM;
-        }
-
-    while (cli_dbgets(buffer, FILEBUFF, fs, dbio)) {
+    while ((buffer = cli_dbgets_inplace(buff, FILEBUFF, fs, dbio))) {
         line++;
         if (buffer[0] == '#')
             continue;
-        cli_chomp(buffer);
-        if (engine->ignored)
-            strcpy(buffer_cpy, buffer);
+        len = cli_chomp(buffer);
 
         tokens_count = cli_strtokenize(buffer, ':', MD5_TOKENS + 1, tokens);
         if (tokens_count < 3) {
@@ -2537,7 +2603,7 @@ static int cli_loadhash(FILE *fs, struct cl_engine *engine, unsigned int *signo,
             if (cli_chkpua(pt, engine->pua_cats, options))
                 continue;
 
-        if (engine->ignored && cli_chkign(engine->ignored, pt, buffer_cpy))
+        if (engine->ignored && cli_chkign_entry(engine->ignored, pt, buffer, len, ':'))
             continue;
 
         if (engine->cb_sigload) {
@@ -2560,14 +2626,12 @@ static int cli_loadhash(FILE *fs, struct cl_engine *engine, unsigned int *signo,
 
         if (CL_SUCCESS != (ret = hm_addhash_str(db, tokens[md5_field], size, virname))) {
             cli_errmsg("cli_loadhash: Malformed hash string at line %u\n", line);
-            MPOOL_FREE(engine->mempool, (void *)virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, (void *)virname);
             break;
         }
 
         sigs++;
     }
-    if (engine->ignored)
-        free(buffer_cpy);
 
     if (!line) {
         cli_errmsg("cli_loadhash: Empty database file\n");
@@ -2589,27 +2653,19 @@ static int cli_loadhash(FILE *fs, struct cl_engine *engine, unsigned int *signo,
 static int cli_loadmd(FILE *fs, struct cl_engine *engine, unsigned int *signo, int type, unsigned int options, struct cli_dbio *dbio, const char *dbname)
 {
     const char *tokens[MD_TOKENS + 1];
-    char buffer[FILEBUFF], *buffer_cpy = NULL;
+    char buff[FILEBUFF], *buffer;
     unsigned int line = 0, sigs = 0, tokens_count;
     int ret = CL_SUCCESS;
     struct cli_cdb *new;
 
     UNUSEDPARAM(dbname);
 
-    if (engine->ignored)
-        if (!(buffer_cpy = cli_malloc(FILEBUFF))) {
-            cli_errmsg("cli_loadmd: Can't allocate memory for buffer_cpy\n");
-            return CL_EMEM;
-        }
-
-    while (cli_dbgets(buffer, FILEBUFF, fs, dbio)) {
+    while ((buffer = cli_dbgets_inplace(buff, FILEBUFF, fs, dbio))) {
         line++;
         if (buffer[0] == '#')
             continue;
 
         cli_chomp(buffer);
-        if (engine->ignored)
-            strcpy(buffer_cpy, buffer);
 
         tokens_count = cli_strtokenize(buffer, ':', MD_TOKENS + 1, tokens);
         if (tokens_count != MD_TOKENS) {
@@ -2662,15 +2718,15 @@ static int cli_loadmd(FILE *fs, struct cl_engine *engine, unsigned int *signo, i
         }
         new->ctype = (type == 1) ? CL_TYPE_ZIP : CL_TYPE_RAR;
 
-        if (engine->ignored && cli_chkign(engine->ignored, new->virname, buffer /*_cpy*/)) {
-            MPOOL_FREE(engine->mempool, new->virname);
+        if (engine->ignored && cli_chkign(engine->ignored, new->virname, tokens[0])) {
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             continue;
         }
 
         if (engine->cb_sigload && engine->cb_sigload("md", new->virname, ~options & CL_DB_OFFICIAL, engine->cb_sigload_ctx)) {
             cli_dbgmsg("cli_loadmd: skipping %s due to callback\n", new->virname);
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             continue;
         }
@@ -2679,7 +2735,7 @@ static int cli_loadmd(FILE *fs, struct cl_engine *engine, unsigned int *signo, i
 
         if (strcmp(tokens[2], "*") && cli_regcomp(&new->name, tokens[2], REG_EXTENDED | REG_NOSUB)) {
             cli_errmsg("cli_loadmd: Can't compile regular expression %s in signature for %s\n", tokens[2], tokens[0]);
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             ret = CL_EMEM;
             break;
@@ -2699,7 +2755,7 @@ static int cli_loadmd(FILE *fs, struct cl_engine *engine, unsigned int *signo, i
         if (strcmp(tokens[5], "*")) {
             new->res1 = cli_hex2num(tokens[5]);
             if (new->res1 == -1) {
-                MPOOL_FREE(engine->mempool, new->virname);
+                MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
                 MPOOL_FREE(engine->mempool, new);
                 if (new->name.re_magic)
                     cli_regfree(&new->name);
@@ -2718,8 +2774,6 @@ static int cli_loadmd(FILE *fs, struct cl_engine *engine, unsigned int *signo, i
         engine->cdb = new;
         sigs++;
     }
-    if (engine->ignored)
-        free(buffer_cpy);
 
     if (!line) {
         cli_errmsg("Empty database file\n");
@@ -2804,14 +2858,14 @@ static int cli_loadcdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
         }
 
         if (engine->ignored && cli_chkign(engine->ignored, new->virname, buffer /*_cpy*/)) {
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             continue;
         }
 
         if (engine->cb_sigload && engine->cb_sigload("cdb", new->virname, ~options & CL_DB_OFFICIAL, engine->cb_sigload_ctx)) {
             cli_dbgmsg("cli_loadcdb: skipping %s due to callback\n", new->virname);
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             continue;
         }
@@ -2821,14 +2875,14 @@ static int cli_loadcdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
         } else if ((new->ctype = cli_ftcode(tokens[1])) == CL_TYPE_ERROR) {
             cli_errmsg("cli_loadcdb: Unknown container type %s in signature for %s, skipping\n", tokens[1], tokens[0]);
             ret = CL_EMALFDB;
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             break;
         }
 
         if (strcmp(tokens[3], "*") && cli_regcomp(&new->name, tokens[3], REG_EXTENDED | REG_NOSUB)) {
             cli_errmsg("cli_loadcdb: Can't compile regular expression %s in signature for %s\n", tokens[3], tokens[0]);
-            MPOOL_FREE(engine->mempool, new->virname);
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
             MPOOL_FREE(engine->mempool, new);
             ret = CL_EMEM;
             break;
@@ -2854,7 +2908,7 @@ static int cli_loadcdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
                        token_str, tokens[0]);                                 \
             if (new->name.re_magic)                                           \
                 cli_regfree(&new->name);                                      \
-            MPOOL_FREE(engine->mempool, new->virname);                        \
+            MPOOL_FREE_VIRNAME(engine->mempool, new->virname);                        \
             MPOOL_FREE(engine->mempool, new);                                 \
             ret = CL_EMEM;                                                    \
             break;                                                            \
@@ -2875,7 +2929,7 @@ static int cli_loadcdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
                 cli_errmsg("cli_loadcdb: Invalid encryption flag value in signature for %s\n", tokens[0]);
                 if (new->name.re_magic)
                     cli_regfree(&new->name);
-                MPOOL_FREE(engine->mempool, new->virname);
+                MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
                 MPOOL_FREE(engine->mempool, new);
                 ret = CL_EMEM;
                 break;
@@ -2889,7 +2943,7 @@ static int cli_loadcdb(FILE *fs, struct cl_engine *engine, unsigned int *signo,
                 cli_errmsg("cli_loadcdb: Can't allocate memory for res2 in signature for %s\n", tokens[0]);
                 if (new->name.re_magic)
                     cli_regfree(&new->name);
-                MPOOL_FREE(engine->mempool, new->virname);
+                MPOOL_FREE_VIRNAME(engine->mempool, new->virname);
                 MPOOL_FREE(engine->mempool, new);
                 ret = CL_EMEM;
                 break;
@@ -5028,6 +5082,9 @@ cl_error_t cl_engine_free(struct cl_engine *engine)
     if (engine->stats_data)
         free(engine->stats_data);
 
+    cli_telemetry_free(engine->telemetry);
+    cli_counters_free(engine->counters);
+
     if (engine->root) {
         for (i = 0; i < CLI_MTARGETS; i++) {
             if ((root = engine->root[i])) {
@@ -5080,7 +5137,7 @@ cl_error_t cl_engine_free(struct cl_engine *engine)
         if (pt->name.re_magic)
             cli_regfree(&pt->name);
         MPOOL_FREE(engine->mempool, pt->res2);
-        MPOOL_FREE(engine->mempool, pt->virname);
+        MPOOL_FREE_VIRNAME(engine->mempool, pt->virname);
         MPOOL_FREE(engine->mempool, pt);
     }
 
@@ -5212,6 +5269,9 @@ cl_error_t cl_engine_compile(struct cl_engine *engine)
         if ((ret = cli_loadftm(NULL, engine, 0, 1, NULL)))
             return ret;
 
+    if ((ret = cli_ftindex_build(engine)))
+        return ret;
+
     /* handle default passwords */
     if (!engine->pwdbs[0] && !engine->pwdbs[1] && !engine->pwdbs[2])
         if ((ret = cli_loadpwdb(NULL, engine, 0, 1, NULL)))
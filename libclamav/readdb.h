@@ -131,6 +131,8 @@ cl_error_t cli_load(const char *filename, struct cl_engine *engine, unsigned int
 
 char *cli_dbgets(char *buff, unsigned int size, FILE *fs, struct cli_dbio *dbio);
 
+char *cli_dbgets_inplace(char *buff, unsigned int size, FILE *fs, struct cli_dbio *dbio);
+
 cl_error_t cli_initroots(struct cl_engine *engine, unsigned int options);
 
 #ifdef HAVE_YARA
@@ -310,6 +310,9 @@ cl_error_t init_regex_list(struct regex_matcher *matcher, uint8_t dconf_prefilte
     matcher->sha256_hashes.mempool  = mp;
     matcher->hostkey_prefix.mempool = mp;
 #endif
+    /* the BM virname slot holds the hash flags */
+    matcher->sha256_hashes.bm_own_virnames  = 1;
+    matcher->hostkey_prefix.bm_own_virnames = 1;
     if ((rc = cli_bm_init(&matcher->sha256_hashes))) {
         return rc;
     }
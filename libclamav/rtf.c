@@ -54,7 +54,7 @@ enum rtf_action {
 };
 
 struct rtf_state;
-typedef int (*rtf_callback_begin)(struct rtf_state*, cli_ctx* ctx, const char* tmpdir);
+typedef int (*rtf_callback_begin)(struct rtf_state*, cli_ctx* ctx, struct cli_membuf* buf);
 typedef int (*rtf_callback_process)(struct rtf_state*, const unsigned char* data, const size_t len);
 typedef int (*rtf_callback_end)(struct rtf_state*, cli_ctx*);
 
@@ -104,19 +104,21 @@ static const unsigned char rtf_data_magic[] = {0x01, 0x05, 0x00, 0x00, 0x02, 0x0
 static const size_t rtf_data_magic_len      = sizeof(rtf_data_magic);
 
 struct rtf_object_data {
-    char* name;
-    int fd;
+    struct cli_membuf* buf; /* decoded object, shared by all objects of the document */
+    int dumping;
     int partial;
     int has_partial;
     enum rtf_objdata_state internal_state;
     char* desc_name;
-    const char* tmpdir;
     cli_ctx* ctx;
     size_t desc_len;
     size_t bread;
 };
 
 #define BUFF_SIZE 8192
+
+/* group stack entries allocated up front, deeper nesting doubles it */
+#define RTF_STACK_PREALLOC 256
 /* generated by contrib/phishing/generate_tables.c */
 static const short int hextable[256] = {
     0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
@@ -136,6 +138,81 @@ static const short int hextable[256] = {
     0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
     0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
 
+#define ONES 0x0101010101010101ULL
+
+/*
+ * Decodes 8 hex digits into 4 bytes at @out. Returns 0 without writing
+ * anything unless all 8 characters are hex digits, which they are for
+ * most of a typical \objdata group.
+ */
+static inline int rtf_unhex8(const unsigned char* in, unsigned char* out)
+{
+    uint64_t word, lower, digit, alpha;
+    unsigned char nibbles[8];
+
+    memcpy(&word, in, 8);
+    if (word & (0x80 * ONES))
+        return 0;
+
+    /* bytes are below 0x80, so none of the additions carry into the next one */
+    lower = word | (0x20 * ONES);
+    digit = (word + (0x80 - '0') * ONES) & ~(word + (0x80 - '9' - 1) * ONES);
+    alpha = (lower + (0x80 - 'a') * ONES) & ~(lower + (0x80 - 'f' - 1) * ONES);
+    if (((digit | alpha) & (0x80 * ONES)) != 0x80 * ONES)
+        return 0;
+
+    /* '0' - '9' keep their low nibble, letters have bit 6 set and need 9 added */
+    word = (word & (0x0f * ONES)) + ((word >> 6) & ONES) * 9;
+    memcpy(nibbles, &word, 8);
+
+    out[0] = nibbles[0] << 4 | nibbles[1];
+    out[1] = nibbles[2] << 4 | nibbles[3];
+    out[2] = nibbles[4] << 4 | nibbles[5];
+    out[3] = nibbles[6] << 4 | nibbles[7];
+    return 1;
+}
+
+/*
+ * Decodes the hex digits in @input into @outdata, which must hold
+ * len / 2 + 1 bytes, skipping everything else. A digit left without its
+ * pair is kept in @partial for the next call.
+ */
+size_t cli_rtf_unhex(const unsigned char* input, size_t len, unsigned char* outdata, int* has_partial, int* partial)
+{
+    size_t out_cnt = 0;
+    size_t i       = 0;
+
+    if (*has_partial) {
+        while (i < len && !isxdigit(input[i]))
+            i++;
+        if (i == len)
+            return 0;
+        outdata[out_cnt++] = *partial | hextable[input[i++]];
+        *has_partial       = 0;
+    }
+
+    for (; i < len; i++) {
+        if (i + 8 <= len && rtf_unhex8(input + i, outdata + out_cnt)) {
+            out_cnt += 4;
+            i += 7;
+            continue;
+        }
+        if (isxdigit(input[i])) {
+            const unsigned char byte = hextable[input[i++]] << 4;
+            while (i < len && !isxdigit(input[i]))
+                i++;
+            if (i == len) {
+                *partial     = byte;
+                *has_partial = 1;
+                break;
+            }
+            outdata[out_cnt++] = byte | hextable[input[i]];
+        }
+    }
+
+    return out_cnt;
+}
+
 static void init_rtf_state(struct rtf_state* state)
 {
     *state                 = base_state;
@@ -167,7 +244,7 @@ static int push_state(struct stack* stack, struct rtf_state* state)
     if (stack->stack_cnt >= stack->stack_size) {
         /* grow stack */
         struct rtf_state* states;
-        stack->stack_size += 128;
+        stack->stack_size *= 2;
         states = cli_realloc2(stack->states, stack->stack_size * sizeof(*stack->states));
         if (!states)
             return CL_EMEM;
@@ -216,21 +293,20 @@ static int load_actions(table_t* t)
     return 0;
 }
 
-static int rtf_object_begin(struct rtf_state* state, cli_ctx* ctx, const char* tmpdir)
+static int rtf_object_begin(struct rtf_state* state, cli_ctx* ctx, struct cli_membuf* buf)
 {
     struct rtf_object_data* data = cli_malloc(sizeof(*data));
     if (!data) {
         cli_errmsg("rtf_object_begin: Unable to allocate memory for object data\n");
         return CL_EMEM;
     }
-    data->fd             = -1;
+    data->buf            = buf;
+    data->dumping        = 0;
     data->partial        = 0;
     data->has_partial    = 0;
     data->bread          = 0;
     data->internal_state = WAIT_MAGIC;
-    data->tmpdir         = tmpdir;
     data->ctx            = ctx;
-    data->name           = NULL;
     data->desc_name      = NULL;
 
     state->cb_data = data;
@@ -241,21 +317,14 @@ static int decode_and_scan(struct rtf_object_data* data, cli_ctx* ctx)
 {
     int ret = CL_CLEAN;
 
-    cli_dbgmsg("RTF:Scanning embedded object:%s\n", data->name);
-    if (data->bread == 1 && data->fd > 0) {
+    cli_dbgmsg("RTF:Scanning embedded object of %zu bytes\n", data->buf->len);
+    if (data->bread == 1 && data->dumping) {
         cli_dbgmsg("Decoding ole object\n");
-        ret = cli_scan_ole10(data->fd, ctx);
-    } else if (data->fd > 0)
-        ret = cli_magic_scan_desc(data->fd, data->name, ctx, NULL);
-    if (data->fd > 0)
-        close(data->fd);
-    data->fd = -1;
-    if (data->name) {
-        if (!ctx->engine->keeptmp)
-            if (cli_unlink(data->name)) ret = CL_EUNLINK;
-        free(data->name);
-        data->name = NULL;
-    }
+        ret = cli_scan_ole10_buff(data->buf->data, data->buf->len, ctx);
+    } else if (data->dumping && data->buf->len)
+        ret = cli_magic_scan_buff(data->buf->data, data->buf->len, ctx, NULL);
+    data->dumping  = 0;
+    data->buf->len = 0;
 
     if (ret != CL_CLEAN)
         return ret;
@@ -267,37 +336,14 @@ static int rtf_object_process(struct rtf_state* state, const unsigned char* inpu
     struct rtf_object_data* data = state->cb_data;
     unsigned char outdata[BUFF_SIZE];
     const unsigned char* out_data;
-    size_t out_cnt = 0;
+    size_t out_cnt;
     size_t i;
     int ret;
 
     if (!data || !len)
         return 0;
 
-    if (data->has_partial) {
-        for (i = 0; i < len && !isxdigit(input[i]); i++)
-            ;
-        if (i < len) {
-            outdata[out_cnt++] = data->partial | hextable[input[i++]];
-            data->has_partial  = 0;
-        } else
-            return 0;
-    } else
-        i = 0;
-
-    for (; i < len; i++) {
-        if (isxdigit(input[i])) {
-            const unsigned char byte = hextable[input[i++]] << 4;
-            while (i < len && !isxdigit(input[i]))
-                i++;
-            if (i == len) {
-                data->partial     = byte;
-                data->has_partial = 1;
-                break;
-            }
-            outdata[out_cnt++] = byte | hextable[input[i]];
-        }
-    }
+    out_cnt = cli_rtf_unhex(input, len, outdata, &data->has_partial, &data->partial);
 
     out_data = outdata;
     while (out_data && out_cnt) {
@@ -394,8 +440,8 @@ static int rtf_object_process(struct rtf_state* state, const unsigned char* inpu
                     out_data += i;
                     data->bread = 0;
                     cli_dbgmsg("Dumping rtf embedded object of size:%lu\n", (unsigned long int)data->desc_len);
-                    if ((ret = cli_gentempfd(data->tmpdir, &data->name, &data->fd)))
-                        return ret;
+                    data->dumping        = 1;
+                    data->buf->len       = 0;
                     data->internal_state = DUMP_DATA;
                     cli_dbgmsg("RTF: next state: DUMP_DATA\n");
                 }
@@ -410,16 +456,16 @@ static int rtf_object_process(struct rtf_state* state, const unsigned char* inpu
                         char out[4];
                         data->bread = 1; /* flag to indicate this needs to be scanned with cli_decode_ole_object*/
                         cli_writeint32(out, data->desc_len);
-                        if (cli_writen(data->fd, out, 4) != 4)
-                            return CL_EWRITE;
+                        if ((ret = cli_membuf_append(data->buf, out, 4)) != CL_SUCCESS)
+                            return ret;
                     } else
                         data->bread = 2;
                 }
 
                 data->desc_len -= out_want;
-                if (cli_writen(data->fd, out_data, out_want) != out_want) {
-                    return CL_EWRITE;
-                }
+                /* an object too big to keep in memory is scanned truncated */
+                if ((ret = cli_membuf_append(data->buf, out_data, out_want)) == CL_EMEM)
+                    return ret;
                 out_data += out_want;
                 out_cnt -= out_want;
                 if (!data->desc_len) {
@@ -446,11 +492,9 @@ static int rtf_object_end(struct rtf_state* state, cli_ctx* ctx)
     int rc                       = 0;
     if (!data)
         return 0;
-    if (data->fd > 0) {
+    if (data->dumping) {
         rc = decode_and_scan(data, ctx);
     }
-    if (data->name)
-        free(data->name);
     if (data->desc_name)
         free(data->desc_name);
     free(data);
@@ -490,16 +534,12 @@ static void cleanup_stack(struct stack* stack, struct rtf_state* state, cli_ctx*
         ret = state.cb_end(&state, ctx); \
     tableDestroy(actiontable);           \
     cleanup_stack(&stack, &state, ctx);  \
-    if (!ctx->engine->keeptmp)           \
-        cli_rmdirs(tempname);            \
-    else                                 \
-        rmdir(tempname);                 \
-    free(tempname);                      \
+    cli_membuf_free(&objbuf);            \
     free(stack.states);
 
 int cli_scanrtf(cli_ctx* ctx)
 {
-    char* tempname;
+    struct cli_membuf objbuf;
     const unsigned char* ptr;
     const unsigned char* ptr_end;
     int ret = CL_CLEAN;
@@ -518,7 +558,7 @@ int cli_scanrtf(cli_ctx* ctx)
     main_symbols['\\'] = 1;
 
     stack.stack_cnt  = 0;
-    stack.stack_size = 16;
+    stack.stack_size = RTF_STACK_PREALLOC;
     stack.elements   = 0;
     stack.warned     = 0;
     stack.states     = cli_malloc(stack.stack_size * sizeof(*stack.states));
@@ -528,23 +568,12 @@ int cli_scanrtf(cli_ctx* ctx)
         return CL_EMEM;
     }
 
-    if (!(tempname = cli_gentemp_with_prefix(ctx->sub_tmpdir, "rtf-tmp")))
-        return CL_EMEM;
-
-    if (mkdir(tempname, 0700)) {
-        cli_dbgmsg("ScanRTF -> Can't create temporary directory %s\n", tempname);
-        free(stack.states);
-        free(tempname);
-        return CL_ETMPDIR;
-    }
+    memset(&objbuf, 0, sizeof(objbuf));
 
     actiontable = tableCreate();
     if ((ret = load_actions(actiontable))) {
         cli_dbgmsg("RTF: Unable to load rtf action table\n");
         free(stack.states);
-        if (!ctx->engine->keeptmp)
-            cli_rmdirs(tempname);
-        free(tempname);
         tableDestroy(actiontable);
         return ret;
     }
@@ -592,7 +621,7 @@ int cli_scanrtf(cli_ctx* ctx)
                                     }
                                 if (state.cb_begin) {
                                     if (!state.cb_data)
-                                        if ((ret = state.cb_begin(&state, ctx, tempname))) {
+                                        if ((ret = state.cb_begin(&state, ctx, &objbuf))) {
                                             SCAN_CLEANUP;
                                             return ret;
                                         }
@@ -26,4 +26,6 @@
 
 int cli_scanrtf(cli_ctx *ctx);
 
+size_t cli_rtf_unhex(const unsigned char *input, size_t len, unsigned char *outdata, int *has_partial, int *partial);
+
 #endif
@@ -114,6 +114,7 @@
 #include "msdoc.h"
 #include "execs.h"
 #include "egg.h"
+#include "telemetry.h"
 
 #ifdef HAVE_BZLIB_H
 #include <bzlib.h>
@@ -2527,32 +2528,6 @@ static cl_error_t cli_scanpdf(cli_ctx *ctx, off_t offset)
     return ret;
 }
 
-static cl_error_t cli_scantnef(cli_ctx *ctx)
-{
-    cl_error_t ret;
-    char *dir = cli_gentemp_with_prefix(ctx->sub_tmpdir, "tnef-tmp");
-
-    if (!dir)
-        return CL_EMEM;
-
-    if (mkdir(dir, 0700)) {
-        cli_dbgmsg("Can't create temporary directory for tnef file %s\n", dir);
-        free(dir);
-        return CL_ETMPDIR;
-    }
-
-    ret = cli_tnef(dir, ctx);
-
-    if (ret == CL_CLEAN)
-        ret = cli_magic_scan_dir(dir, ctx);
-
-    if (!ctx->engine->keeptmp)
-        cli_rmdirs(dir);
-
-    free(dir);
-    return ret;
-}
-
 static cl_error_t cli_scanuuencoded(cli_ctx *ctx)
 {
     cl_error_t ret;
@@ -2622,17 +2597,17 @@ static cl_error_t cli_scanmail(cli_ctx *ctx)
     return ret;
 }
 
+/* bytes of the map cli_scan_structured() looks at per fmap_need call */
+#define STRUCTURED_WINDOW (1024 * 1024)
+
 static cl_error_t cli_scan_structured(cli_ctx *ctx)
 {
-    char buf[8192];
-    size_t result          = 0;
-    unsigned int cc_count  = 0;
-    unsigned int ssn_count = 0;
-    int done               = 0;
+    struct dlp_scan scan;
+    const unsigned char *buf;
+    unsigned int cc_count;
+    unsigned int ssn_count;
     fmap_t *map;
-    size_t pos = 0;
-    int (*ccfunc)(const unsigned char *buffer, size_t length, int cc_only);
-    int (*ssnfunc)(const unsigned char *buffer, size_t length);
+    size_t pos, base, end;
     unsigned int viruses_found = 0;
 
     if (ctx == NULL)
@@ -2640,48 +2615,30 @@ static cl_error_t cli_scan_structured(cli_ctx *ctx)
 
     map = *ctx->fmap;
 
-    if (ctx->engine->min_cc_count == 1)
-        ccfunc = dlp_has_cc;
-    else
-        ccfunc = dlp_get_cc_count;
-
-    switch (SCAN_HEURISTIC_STRUCTURED_SSN_NORMAL | SCAN_HEURISTIC_STRUCTURED_SSN_STRIPPED) {
-        case (CL_SCAN_HEURISTIC_STRUCTURED_SSN_NORMAL | CL_SCAN_HEURISTIC_STRUCTURED_SSN_STRIPPED):
-            if (ctx->engine->min_ssn_count == 1)
-                ssnfunc = dlp_has_ssn;
-            else
-                ssnfunc = dlp_get_ssn_count;
-            break;
-
-        case CL_SCAN_HEURISTIC_STRUCTURED_SSN_NORMAL:
-            if (ctx->engine->min_ssn_count == 1)
-                ssnfunc = dlp_has_normal_ssn;
-            else
-                ssnfunc = dlp_get_normal_ssn_count;
+    memset(&scan, 0, sizeof(scan));
+    scan.what    = DLP_CC;
+    scan.cc_only = (ctx->options->heuristic & CL_SCAN_HEURISTIC_STRUCTURED_CC) ? 1 : 0;
+    scan.min_cc  = ctx->engine->min_cc_count;
+    if (SCAN_HEURISTIC_STRUCTURED_SSN_NORMAL)
+        scan.what |= DLP_SSN_NORMAL;
+    if (SCAN_HEURISTIC_STRUCTURED_SSN_STRIPPED)
+        scan.what |= DLP_SSN_STRIPPED;
+    if (scan.what != DLP_CC)
+        scan.min_ssn = ctx->engine->min_ssn_count;
+
+    /* The map is scanned in place, a window at a time. Each window is mapped
+     * along with the byte before it and enough bytes after it to validate
+     * numbers starting at its very end. */
+    for (pos = 0; pos < map->len; pos += STRUCTURED_WINDOW) {
+        base = pos ? pos - 1 : 0;
+        end  = min(pos + STRUCTURED_WINDOW + DLP_MAX_CANDIDATE, map->len) - base;
+        if (!(buf = fmap_need_off_once(map, base, end)))
             break;
-
-        case CL_SCAN_HEURISTIC_STRUCTURED_SSN_STRIPPED:
-            if (ctx->engine->min_ssn_count == 1)
-                ssnfunc = dlp_has_stripped_ssn;
-            else
-                ssnfunc = dlp_get_stripped_ssn_count;
+        if (dlp_scan(&scan, buf, end, base, pos - base, min(pos + STRUCTURED_WINDOW, map->len) - base))
             break;
-
-        default:
-            ssnfunc = NULL;
-    }
-
-    while (!done && ((result = fmap_readn(map, buf, pos, 8191)) > 0) && (result != (size_t)-1)) {
-        pos += result;
-        if ((cc_count += ccfunc((const unsigned char *)buf, result,
-                                (ctx->options->heuristic & CL_SCAN_HEURISTIC_STRUCTURED_CC) ? 1 : 0)) >= ctx->engine->min_cc_count) {
-            done = 1;
-        }
-
-        if (ssnfunc && ((ssn_count += ssnfunc((const unsigned char *)buf, result)) >= ctx->engine->min_ssn_count)) {
-            done = 1;
-        }
     }
+    cc_count  = scan.cc_count;
+    ssn_count = scan.ssn_count;
 
     if (cc_count != 0 && cc_count >= ctx->engine->min_cc_count) {
         cli_dbgmsg("cli_scan_structured: %u credit card numbers detected\n", cc_count);
@@ -2712,94 +2669,40 @@ static cl_error_t cli_scan_structured(cli_ctx *ctx)
 
 static cl_error_t cli_scanembpe(cli_ctx *ctx, off_t offset)
 {
-    cl_error_t ret = CL_CLEAN;
-    int fd;
-    size_t bytes;
-    size_t size = 0;
-    size_t todo;
-    const char *buff;
-    char *tmpname;
-    fmap_t *map = *ctx->fmap;
+    cl_error_t ret;
+    fmap_t *map   = *ctx->fmap;
+    size_t length = map->len - offset;
     unsigned int corrupted_input;
 
-    tmpname = cli_gentemp_with_prefix(ctx->sub_tmpdir, "embedded-pe");
-    if (!tmpname)
-        return CL_EMEM;
-
-    if ((fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR)) < 0) {
-        cli_errmsg("cli_scanembpe: Can't create file %s\n", tmpname);
-        free(tmpname);
-        return CL_ECREAT;
-    }
-
-    todo = map->len - offset;
-    while (1) {
-        bytes = MIN(todo, map->pgsz);
-        if (!bytes)
-            break;
-
-        if (!(buff = fmap_need_off_once(map, offset + size, bytes))) {
-            close(fd);
-            if (!ctx->engine->keeptmp) {
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-            }
-            free(tmpname);
-            return CL_EREAD;
-        }
-        size += bytes;
-        todo -= bytes;
-
-        if (cli_checklimits("cli_scanembpe", ctx, size, 0, 0) != CL_CLEAN)
-            break;
-
-        if (cli_writen(fd, buff, bytes) != bytes) {
-            cli_dbgmsg("cli_scanembpe: Can't write to temporary file\n");
-            close(fd);
-            if (!ctx->engine->keeptmp) {
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-            }
-            free(tmpname);
-            return CL_EWRITE;
+    /* The embedded PE is scanned in place, but still only up to the scan limits */
+    if (cli_checklimits("cli_scanembpe", ctx, length, 0, 0) != CL_CLEAN) {
+        if (ctx->engine->maxfiles && ctx->scannedfiles >= ctx->engine->maxfiles)
+            return CL_CLEAN;
+        if (ctx->engine->maxfilesize && length > ctx->engine->maxfilesize)
+            length = ctx->engine->maxfilesize;
+        if (ctx->engine->maxscansize) {
+            if (ctx->scansize >= ctx->engine->maxscansize)
+                return CL_CLEAN;
+            if (length > ctx->engine->maxscansize - ctx->scansize)
+                length = ctx->engine->maxscansize - ctx->scansize;
         }
+        if (!length)
+            return CL_CLEAN;
     }
 
     ctx->recursion++;
     corrupted_input      = ctx->corrupted_input;
     ctx->corrupted_input = 1;
-    ret                  = cli_magic_scan_desc(fd, tmpname, ctx, NULL);
+    ret                  = cli_magic_scan_nested_fmap_type(map, offset, length, ctx, CL_TYPE_ANY, NULL);
     ctx->corrupted_input = corrupted_input;
+    ctx->recursion--;
+
     if (ret == CL_VIRUS) {
         cli_dbgmsg("cli_scanembpe: Infected with %s\n", cli_get_last_virus(ctx));
-        close(fd);
-        if (!ctx->engine->keeptmp) {
-            if (cli_unlink(tmpname)) {
-                free(tmpname);
-                ctx->recursion--;
-                return CL_EUNLINK;
-            }
-        }
-        free(tmpname);
-        ctx->recursion--;
         return CL_VIRUS;
     }
-    ctx->recursion--;
-
-    close(fd);
-    if (!ctx->engine->keeptmp) {
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-    }
-    free(tmpname);
 
-    /* intentionally ignore possible errors from cli_magic_scan_desc */
+    /* intentionally ignore possible errors from cli_magic_scan_nested_fmap_type */
     return CL_CLEAN;
 }
 
@@ -2828,7 +2731,9 @@ static struct
     {PERFT_MAP, "map", ev_time},
     {PERFT_BYTECODE, "bytecode", ev_time},
     {PERFT_KTIME, "kernel", ev_int},
-    {PERFT_UTIME, "user", ev_int}};
+    {PERFT_UTIME, "user", ev_int},
+    {PERFT_ELF, "elf", ev_time},
+    {PERFT_MACHO, "macho", ev_time}};
 
 static void get_thread_times(uint64_t *kt, uint64_t *ut)
 {
@@ -2862,7 +2767,7 @@ static inline void perf_init(cli_ctx *ctx)
     uint64_t kt, ut;
     unsigned i;
 
-    if (!SCAN_DEV_COLLECT_PERF_INFO)
+    if (!SCAN_DEV_COLLECT_PERF_INFO && !ctx->telemetry)
         return;
 
     ctx->perf = cli_events_new(PERFT_LAST);
@@ -2903,13 +2808,17 @@ static inline void perf_done(cli_ctx *ctx)
         unsigned count;
 
         cli_event_get(perf, perf_events[i].id, &val, &count);
+        if (ctx->telemetry && count)
+            cli_telemetry_stage(ctx->telemetry, perf_events[i].id, perf_events[i].name,
+                                perf_events[i].type == ev_time ? count : 1, val.v_int);
         if (p < pend)
             p += snprintf(p, pend - p, "%s: %d.%03ums, ", perf_events[i].name,
                           (signed)(val.v_int / 1000),
                           (unsigned)(val.v_int % 1000));
     }
     *p = 0;
-    cli_infomsg(ctx, "performance: %s\n", timestr);
+    if (SCAN_DEV_COLLECT_PERF_INFO)
+        cli_infomsg(ctx, "performance: %s\n", timestr);
 
     cli_events_free(perf);
     ctx->perf = NULL;
@@ -2978,9 +2887,12 @@ static inline void perf_done(cli_ctx *ctx)
  * @param dettype   [out] If typercg enabled and scan detects HTML or MAIL types,
  *                  will output HTML or MAIL types after performing HTML/MAIL scans
  * @param refhash   Hash of current fmap
+ * @param rawdone   [out] Set to 1 once the generic signatures and hashes have been
+ *                  matched against the whole fmap, so later passes over the same
+ *                  fmap only need the type specific signatures.
  * @return cl_error_t
  */
-static cl_error_t scanraw(cli_ctx *ctx, cli_file_t type, uint8_t typercg, cli_file_t *dettype, unsigned char *refhash)
+static cl_error_t scanraw(cli_ctx *ctx, cli_file_t type, uint8_t typercg, cli_file_t *dettype, unsigned char *refhash, uint8_t *rawdone)
 {
     cl_error_t ret = CL_CLEAN, nret = CL_CLEAN;
     struct cli_matched_type *ftoffset = NULL, *fpt;
@@ -3005,6 +2917,9 @@ static cl_error_t scanraw(cli_ctx *ctx, cli_file_t type, uint8_t typercg, cli_fi
     ret = cli_scan_fmap(ctx, type == CL_TYPE_TEXT_ASCII ? CL_TYPE_ANY : type, 0, &ftoffset, acmode, NULL, refhash);
     perf_stop(ctx, PERFT_RAW);
 
+    if (ret == CL_CLEAN || ret == CL_VIRUS || ret >= CL_TYPENO)
+        *rawdone = 1;
+
     // TODO I think this causes embedded file extraction to stop when a
     // signature has matched in cli_scan_fmap, which wouldn't be what
     // we want if allmatch is specified.
@@ -3458,6 +3373,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
     cl_error_t ret = CL_CLEAN;
     cl_error_t cb_retcode;
     cli_file_t dettype = 0;
+    uint8_t rawdone    = 0;
     uint8_t typercg    = 1;
     size_t hashed_size;
     unsigned char *hash = NULL;
@@ -3475,6 +3391,10 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
     char *old_temp_path = NULL;
     char *new_temp_path = NULL;
 
+    struct cli_telemetry_timer telemetry_timer;
+    uint8_t timed  = 0;
+    uint8_t traced = 0;
+
     if (!ctx->engine) {
         cli_errmsg("CRITICAL: engine == NULL\n");
         ret = CL_ENULLARG;
@@ -3508,6 +3428,15 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
         goto early_ret;
     }
 
+    if (ctx->telemetry) {
+        cli_telemetry_file_start(ctx->telemetry, &telemetry_timer);
+        timed = 1;
+    }
+    if (ctx->trace) {
+        cli_trace_file_start(ctx->trace, *ctx->fmap);
+        traced = 1;
+    }
+
     if (ctx->engine->keeptmp) {
         /*
          * Keep-temp enabled, so create a sub-directory to provide extraction directory recursion.
@@ -3565,6 +3494,15 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
         goto early_ret;
     }
     filetype = cli_ftname(type);
+    if (traced)
+        cli_trace_file_type(ctx->trace, type);
+
+    if (ctx->recursion && cli_checkbudget(ctx, type, (*ctx->fmap)->len) != CL_SUCCESS) {
+        emax_reached(ctx);
+        ret = CL_CLEAN;
+        cli_dbgmsg("cli_magic_scan: returning %d %s (no post, no cache)\n", ret, __AT__);
+        goto early_ret;
+    }
 
 #if HAVE_JSON
     if (SCAN_COLLECT_METADATA) {
@@ -3732,7 +3670,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
     }
 
     if (type != CL_TYPE_IGNORED && ctx->engine->sdb) {
-        ret = scanraw(ctx, type, 0, &dettype, (ctx->engine->engine_options & ENGINE_OPTIONS_DISABLE_CACHE) ? NULL : hash);
+        ret = scanraw(ctx, type, 0, &dettype, (ctx->engine->engine_options & ENGINE_OPTIONS_DISABLE_CACHE) ? NULL : hash, &rawdone);
         if (ret == CL_EMEM || ret == CL_VIRUS) {
             ret = cli_checkfp(hash, hashed_size, ctx);
             cli_bitset_free(ctx->hook_lsig_matches);
@@ -3962,7 +3900,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
 
         case CL_TYPE_TNEF:
             if (SCAN_PARSE_MAIL && (DCONF_MAIL & MAIL_CONF_TNEF))
-                ret = cli_scantnef(ctx);
+                ret = cli_tnef(ctx);
             break;
 
         case CL_TYPE_UUENCODED:
@@ -4136,7 +4074,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
 
     /* CL_TYPE_HTML: raw HTML files are not scanned, unless safety measure activated via DCONF */
     if (type != CL_TYPE_IGNORED && (type != CL_TYPE_HTML || !(SCAN_PARSE_HTML) || !(DCONF_DOC & DOC_CONF_HTML_SKIPRAW)) && !ctx->engine->sdb) {
-        res = scanraw(ctx, type, typercg, &dettype, (ctx->engine->engine_options & ENGINE_OPTIONS_DISABLE_CACHE) ? NULL : hash);
+        res = scanraw(ctx, type, typercg, &dettype, (ctx->engine->engine_options & ENGINE_OPTIONS_DISABLE_CACHE) ? NULL : hash, &rawdone);
         if (res != CL_CLEAN) {
             switch (res) {
                 /* List of scan halts, runtime errors only! */
@@ -4212,7 +4150,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
             if ((DCONF_DOC & DOC_CONF_SCRIPT) && dettype != CL_TYPE_HTML && (ret != CL_VIRUS || SCAN_ALLMATCHES) && SCAN_PARSE_HTML)
                 ret = cli_scanscript(ctx);
             if (SCAN_PARSE_MAIL && (DCONF_MAIL & MAIL_CONF_MBOX) && ret != CL_VIRUS && (cli_get_container(ctx, -1) == CL_TYPE_MAIL || dettype == CL_TYPE_MAIL)) {
-                ret = cli_scan_fmap(ctx, CL_TYPE_MAIL, 0, NULL, AC_SCAN_VIR, NULL, NULL);
+                ret = cli_scan_fmap(ctx, CL_TYPE_MAIL, rawdone, NULL, AC_SCAN_VIR, NULL, NULL);
             }
             perf_nested_stop(ctx, PERFT_SCRIPT, PERFT_SCAN);
             break;
@@ -4240,7 +4178,7 @@ cl_error_t cli_magic_scan(cli_ctx *ctx, cli_file_t type)
             perf_nested_stop(ctx, PERFT_MACHO, PERFT_SCAN);
             break;
         case CL_TYPE_BINARY_DATA:
-            ret = cli_scan_fmap(ctx, CL_TYPE_OTHER, 0, NULL, AC_SCAN_VIR, NULL, NULL);
+            ret = cli_scan_fmap(ctx, CL_TYPE_OTHER, rawdone, NULL, AC_SCAN_VIR, NULL, NULL);
             break;
         default:
             break;
@@ -4326,6 +4264,11 @@ done:
 
 early_ret:
 
+    if (timed)
+        cli_telemetry_file_done(ctx->telemetry, &telemetry_timer, type, (*ctx->fmap)->len, ctx->recursion);
+    if (traced)
+        cli_trace_file_done(ctx->trace, *ctx->fmap, ctx->recursion, ret);
+
     if ((ctx->engine->keeptmp) && (NULL != old_temp_path)) {
         /* Use rmdir to remove empty tmp subdirectories. If rmdir fails, it wasn't empty. */
         (void)rmdir(ctx->sub_tmpdir);
@@ -4621,6 +4564,8 @@ static cl_error_t scan_common(cl_fmap_t *map, const char *filepath, const char *
     ctx.fmap++;
     *ctx.fmap = map;
 
+    ctx.telemetry = cli_telemetry_scan_new(ctx.engine);
+    ctx.trace     = cli_trace_new(ctx.engine, filepath);
     perf_init(&ctx);
 
     if (ctx.engine->maxscantime != 0) {
@@ -4811,13 +4756,16 @@ static cl_error_t scan_common(cl_fmap_t *map, const char *filepath, const char *
     if (NULL != ctx.target_filepath) {
         free(ctx.target_filepath);
     }
+    perf_done(&ctx);
+    cli_telemetry_scan_done(ctx.engine, ctx.telemetry);
+    cli_trace_scan_done(ctx.engine, ctx.trace, ctx.cb_ctx);
+    cli_counters_scan_done(ctx.engine->counters, map->len, ctx.cache_lookups, ctx.cache_hits);
     free(ctx.containers);
     cli_bitset_free(ctx.hook_lsig_matches);
     ctx.fmap--; /* Restore original fmap pointer */
     free(ctx.fmap);
     free(ctx.options);
     cli_logg_unsetup();
-    perf_done(&ctx);
 
     return rc;
 }
@@ -130,36 +130,19 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
     size_t outsize = 8;
     int ret, lret;
     size_t count;
-    char *tmpname;
-    int fd;
+    struct cli_membuf out;
 
-    if ((ret = cli_gentempfd(ctx->sub_tmpdir, &tmpname, &fd)) != CL_SUCCESS) {
-        cli_errmsg("scanzws: Can't generate temporary file\n");
-        return ret;
-    }
+    memset(&out, 0, sizeof(out));
 
     hdr->signature[0] = 'F';
-    if (cli_writen(fd, hdr, sizeof(struct swf_file_hdr)) != sizeof(struct swf_file_hdr)) {
-        cli_errmsg("scanzws: Can't write to file %s\n", tmpname);
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EWRITE;
-    }
+    if ((ret = cli_membuf_append(&out, hdr, sizeof(struct swf_file_hdr))) != CL_SUCCESS)
+        return ret;
 
     /* read 4 bytes (for compressed 32-bit filesize) [not used for LZMA] */
     if (fmap_readn(map, &d_insize, offset, sizeof(d_insize)) != sizeof(d_insize)) {
         cli_errmsg("scanzws: Error reading SWF file\n");
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EREAD;
+        ret = CL_EREAD;
+        goto done;
     }
     offset += sizeof(d_insize);
 
@@ -177,24 +160,14 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
     ret = fmap_readn(map, inbuff, offset, FILEBUFF);
     if (ret < 0) {
         cli_errmsg("scanzws: Error reading SWF file\n");
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EUNPACK;
+        ret = CL_EUNPACK;
+        goto done;
     }
     /* nothing written, likely truncated */
     if (!ret) {
         cli_errmsg("scanzws: possibly truncated file\n");
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EFORMAT;
+        ret = CL_EFORMAT;
+        goto done;
     }
     offset += ret;
 
@@ -207,13 +180,8 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
     lret = cli_LzmaInit(&lz, hdr->filesize);
     if (lret != LZMA_RESULT_OK) {
         cli_errmsg("scanzws: LzmaInit() failed\n");
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EUNPACK;
+        ret = CL_EUNPACK;
+        goto done;
     }
 
     while (lret == LZMA_RESULT_OK) {
@@ -224,13 +192,8 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
             if (ret < 0) {
                 cli_errmsg("scanzws: Error reading SWF file\n");
                 cli_LzmaShutdown(&lz);
-                close(fd);
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-                free(tmpname);
-                return CL_EUNPACK;
+                ret = CL_EUNPACK;
+                goto done;
             }
             if (!ret)
                 break;
@@ -242,16 +205,9 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
         if (count) {
             if (cli_checklimits("SWF", ctx, outsize + count, 0, 0) != CL_SUCCESS)
                 break;
-            if (cli_writen(fd, outbuff, count) != count) {
-                cli_errmsg("scanzws: Can't write to file %s\n", tmpname);
-                cli_LzmaShutdown(&lz);
-                close(fd);
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-                free(tmpname);
-                return CL_EWRITE;
+            if (cli_membuf_append(&out, outbuff, count) != CL_SUCCESS) {
+                cli_dbgmsg("scanzws: Can't keep more decompressed data, scanning what we have\n");
+                break;
             }
             outsize += count;
         }
@@ -265,17 +221,12 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
         /* outsize starts at 8, therefore, if its still 8, nothing was decompressed */
         if (outsize == 8) {
             cli_infomsg(ctx, "scanzws: Error decompressing SWF file. No data decompressed.\n");
-            close(fd);
-            if (cli_unlink(tmpname)) {
-                free(tmpname);
-                return CL_EUNLINK;
-            }
-            free(tmpname);
-            return CL_EUNPACK;
+            ret = CL_EUNPACK;
+            goto done;
         }
         cli_infomsg(ctx, "scanzws: Error decompressing SWF file. Scanning what was decompressed.\n");
     }
-    cli_dbgmsg("SWF: Decompressed[LZMA] to %s, size %llu\n", tmpname, (long long unsigned)outsize);
+    cli_dbgmsg("SWF: Decompressed[LZMA], size %llu\n", (long long unsigned)outsize);
 
     /* check if declared output size matches actual output size */
     if (hdr->filesize != outsize) {
@@ -286,16 +237,10 @@ static int scanzws(cli_ctx *ctx, struct swf_file_hdr *hdr)
                    hdr->filesize, (long long unsigned)outsize);
     }
 
-    ret = cli_magic_scan_desc(fd, tmpname, ctx, NULL);
+    ret = cli_magic_scan_buff(out.data, out.len, ctx, NULL);
 
-    close(fd);
-    if (!(ctx->engine->keeptmp)) {
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-    }
-    free(tmpname);
+done:
+    cli_membuf_free(&out);
     return ret;
 }
 
@@ -307,25 +252,13 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
     int offset     = 8, ret, zret, zend;
     size_t outsize = 8;
     size_t count;
-    char *tmpname;
-    int fd;
+    struct cli_membuf out;
 
-    if ((ret = cli_gentempfd(ctx->sub_tmpdir, &tmpname, &fd)) != CL_SUCCESS) {
-        cli_errmsg("scancws: Can't generate temporary file\n");
-        return ret;
-    }
+    memset(&out, 0, sizeof(out));
 
     hdr->signature[0] = 'F';
-    if (cli_writen(fd, hdr, sizeof(struct swf_file_hdr)) != sizeof(struct swf_file_hdr)) {
-        cli_errmsg("scancws: Can't write to file %s\n", tmpname);
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EWRITE;
-    }
+    if ((ret = cli_membuf_append(&out, hdr, sizeof(struct swf_file_hdr))) != CL_SUCCESS)
+        return ret;
 
     stream.avail_in  = 0;
     stream.next_in   = (Bytef *)inbuff;
@@ -338,13 +271,8 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
     zret = inflateInit(&stream);
     if (zret != Z_OK) {
         cli_errmsg("scancws: inflateInit() failed\n");
-        close(fd);
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-        free(tmpname);
-        return CL_EUNPACK;
+        ret = CL_EUNPACK;
+        goto done;
     }
 
     do {
@@ -353,14 +281,9 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
             ret            = fmap_readn(map, inbuff, offset, FILEBUFF);
             if (ret < 0) {
                 cli_errmsg("scancws: Error reading SWF file\n");
-                close(fd);
                 inflateEnd(&stream);
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-                free(tmpname);
-                return CL_EUNPACK;
+                ret = CL_EUNPACK;
+                goto done;
             }
             if (!ret)
                 break;
@@ -372,16 +295,9 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
         if (count) {
             if (cli_checklimits("SWF", ctx, outsize + count, 0, 0) != CL_SUCCESS)
                 break;
-            if (cli_writen(fd, outbuff, count) != count) {
-                cli_errmsg("scancws: Can't write to file %s\n", tmpname);
-                inflateEnd(&stream);
-                close(fd);
-                if (cli_unlink(tmpname)) {
-                    free(tmpname);
-                    return CL_EUNLINK;
-                }
-                free(tmpname);
-                return CL_EWRITE;
+            if (cli_membuf_append(&out, outbuff, count) != CL_SUCCESS) {
+                cli_dbgmsg("scancws: Can't keep more decompressed data, scanning what we have\n");
+                break;
             }
             outsize += count;
         }
@@ -398,17 +314,12 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
          */
         if (outsize == 8) {
             cli_infomsg(ctx, "scancws: Error decompressing SWF file. No data decompressed.\n");
-            close(fd);
-            if (cli_unlink(tmpname)) {
-                free(tmpname);
-                return CL_EUNLINK;
-            }
-            free(tmpname);
-            return CL_EUNPACK;
+            ret = CL_EUNPACK;
+            goto done;
         }
         cli_infomsg(ctx, "scancws: Error decompressing SWF file. Scanning what was decompressed.\n");
     }
-    cli_dbgmsg("SWF: Decompressed[zlib] to %s, size %zu\n", tmpname, outsize);
+    cli_dbgmsg("SWF: Decompressed[zlib], size %zu\n", outsize);
 
     /* check if declared output size matches actual output size */
     if (hdr->filesize != outsize) {
@@ -419,16 +330,10 @@ static int scancws(cli_ctx *ctx, struct swf_file_hdr *hdr)
                    hdr->filesize, outsize);
     }
 
-    ret = cli_magic_scan_desc(fd, tmpname, ctx, NULL);
+    ret = cli_magic_scan_buff(out.data, out.len, ctx, NULL);
 
-    close(fd);
-    if (!ctx->engine->keeptmp) {
-        if (cli_unlink(tmpname)) {
-            free(tmpname);
-            return CL_EUNLINK;
-        }
-    }
-    free(tmpname);
+done:
+    cli_membuf_free(&out);
     return ret;
 }
 
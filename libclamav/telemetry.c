@@ -0,0 +1,684 @@
+/*
+ *  Engine-wide scan telemetry
+ *
+ *  Copyright (C) 2013-2020 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include "clamav-config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clamav.h"
+#include "others.h"
+#include "telemetry.h"
+
+/* longest line is a type name followed by three 20 digit counters */
+#define TELEMETRY_LINE_MAX 160
+
+/* first table size, grown by doubling once three quarters are used */
+#define SIGPROF_INITIAL_SIZE 256
+
+/* first trace buffer size, grown by doubling */
+#define TRACE_INITIAL_SIZE 4096
+
+/* first object stack size, grown by doubling */
+#define TRACE_INITIAL_DEPTH 16
+
+static const char *sigprof_kinds[SIGPROF_LAST] = {"ac", "lsig", "bytecode", "yara"};
+
+static void telemetry_add(struct cli_telemetry_counter *dst, const struct cli_telemetry_counter *src)
+{
+    dst->count += src->count;
+    dst->bytes += src->bytes;
+    dst->usec += src->usec;
+}
+
+static uint32_t sigprof_hash(const char *name, uint32_t kind)
+{
+    uint64_t key = (uint64_t)(uintptr_t)name ^ ((uint64_t)kind << 60);
+
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+static struct cli_sigprof_entry *sigprof_find(struct cli_sigprof_entry *entries, uint32_t size,
+                                              const char *name, uint32_t kind)
+{
+    uint32_t i = sigprof_hash(name, kind) & (size - 1);
+
+    while (entries[i].name && (entries[i].name != name || entries[i].kind != kind))
+        i = (i + 1) & (size - 1);
+
+    return &entries[i];
+}
+
+/* Returns the entry for name/kind, adding it if needed, or NULL if out of memory */
+static struct cli_sigprof_entry *sigprof_get(struct cli_sigprof *sigprof, const char *name, uint32_t kind)
+{
+    struct cli_sigprof_entry *entry, *entries;
+    uint32_t i, size;
+
+    if ((sigprof->used + 1) * 4 > sigprof->size * 3) {
+        size    = sigprof->size ? sigprof->size * 2 : SIGPROF_INITIAL_SIZE;
+        entries = cli_calloc(size, sizeof(*entries));
+        if (!entries) {
+            cli_dbgmsg("sigprof_get: Can't grow signature profile to %u entries\n", size);
+            return NULL;
+        }
+        for (i = 0; i < sigprof->size; i++) {
+            if (sigprof->entries[i].name)
+                *sigprof_find(entries, size, sigprof->entries[i].name, sigprof->entries[i].kind) = sigprof->entries[i];
+        }
+        free(sigprof->entries);
+        sigprof->entries = entries;
+        sigprof->size    = size;
+    }
+
+    entry = sigprof_find(sigprof->entries, sigprof->size, name, kind);
+    if (!entry->name) {
+        entry->name = name;
+        entry->kind = kind;
+        sigprof->used++;
+    }
+
+    return entry;
+}
+
+static void sigprof_clear(struct cli_sigprof *sigprof)
+{
+    free(sigprof->entries);
+    memset(sigprof, 0, sizeof(*sigprof));
+}
+
+/* qsort() callback, costliest first */
+static int sigprof_cmp(const void *a, const void *b)
+{
+    const struct cli_sigprof_entry *ea = a, *eb = b;
+
+    if (ea->nsec != eb->nsec)
+        return ea->nsec < eb->nsec ? 1 : -1;
+    return 0;
+}
+
+struct cli_telemetry *cli_telemetry_new(void)
+{
+    struct cli_telemetry *telemetry;
+
+    telemetry = cli_calloc(1, sizeof(*telemetry));
+    if (!telemetry) {
+        cli_errmsg("cli_telemetry_new: Can't allocate memory for telemetry\n");
+        return NULL;
+    }
+#ifdef CL_THREAD_SAFE
+    if (pthread_mutex_init(&telemetry->mutex, NULL)) {
+        cli_errmsg("cli_telemetry_new: Can't initialize telemetry mutex\n");
+        free(telemetry);
+        return NULL;
+    }
+#endif
+    telemetry->since = time(NULL);
+
+    return telemetry;
+}
+
+void cli_telemetry_free(struct cli_telemetry *telemetry)
+{
+    if (!telemetry)
+        return;
+
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_destroy(&telemetry->mutex);
+#endif
+    sigprof_clear(&telemetry->sigprof);
+    free(telemetry);
+}
+
+struct cli_counters *cli_counters_new(void)
+{
+    struct cli_counters *counters;
+
+    counters = cli_calloc(1, sizeof(*counters));
+    if (!counters) {
+        cli_errmsg("cli_counters_new: Can't allocate memory for scan counters\n");
+        return NULL;
+    }
+#ifdef CL_THREAD_SAFE
+    if (pthread_mutex_init(&counters->mutex, NULL)) {
+        cli_errmsg("cli_counters_new: Can't initialize scan counters mutex\n");
+        free(counters);
+        return NULL;
+    }
+#endif
+
+    return counters;
+}
+
+void cli_counters_free(struct cli_counters *counters)
+{
+    if (!counters)
+        return;
+
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_destroy(&counters->mutex);
+#endif
+    free(counters);
+}
+
+void cli_counters_scan_done(struct cli_counters *counters, uint64_t bytes, uint32_t cache_lookups, uint32_t cache_hits)
+{
+    if (!counters)
+        return;
+
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_lock(&counters->mutex);
+#endif
+    counters->scans++;
+    counters->bytes += bytes;
+    counters->cache_lookups += cache_lookups;
+    counters->cache_hits += cache_hits;
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_unlock(&counters->mutex);
+#endif
+}
+
+uint64_t cli_counters_get(struct cli_counters *counters, enum cl_engine_field field)
+{
+    uint64_t value = 0;
+
+    if (!counters)
+        return 0;
+
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_lock(&counters->mutex);
+#endif
+    switch (field) {
+        case CL_ENGINE_SCANS:
+            value = counters->scans;
+            break;
+        case CL_ENGINE_SCANNED_BYTES:
+            value = counters->bytes;
+            break;
+        case CL_ENGINE_CACHE_LOOKUPS:
+            value = counters->cache_lookups;
+            break;
+        case CL_ENGINE_CACHE_HITS:
+            value = counters->cache_hits;
+            break;
+        default:
+            break;
+    }
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_unlock(&counters->mutex);
+#endif
+
+    return value;
+}
+
+struct cli_telemetry_scan *cli_telemetry_scan_new(const struct cl_engine *engine)
+{
+    struct cli_telemetry_scan *scan;
+
+    if (!engine->telemetry || !(engine->engine_options & ENGINE_OPTIONS_TELEMETRY))
+        return NULL;
+
+    scan = cli_calloc(1, sizeof(*scan));
+    if (!scan) {
+        cli_dbgmsg("cli_telemetry_scan_new: Can't allocate memory, scan will not be accounted\n");
+        return NULL;
+    }
+    scan->sigprof_enabled = engine->telemetry_signatures != 0;
+    /* random phase, or scans shorter than the interval would never be sampled */
+    scan->sigprof_tick = cli_rndnum(CLI_SIGPROF_INTERVAL);
+
+    return scan;
+}
+
+void cli_telemetry_scan_done(const struct cl_engine *engine, struct cli_telemetry_scan *scan)
+{
+    struct cli_telemetry *telemetry;
+    unsigned int i;
+
+    if (!scan)
+        return;
+
+    telemetry = engine->telemetry;
+    if (telemetry) {
+#ifdef CL_THREAD_SAFE
+        pthread_mutex_lock(&telemetry->mutex);
+#endif
+        telemetry->scans++;
+        for (i = 0; i < CLI_TELEMETRY_NTYPES; i++)
+            telemetry_add(&telemetry->counters.types[i], &scan->counters.types[i]);
+        for (i = 0; i < CLI_TELEMETRY_MAXDEPTH; i++)
+            telemetry_add(&telemetry->counters.depth[i], &scan->counters.depth[i]);
+        for (i = 0; i < PERFT_LAST; i++) {
+            telemetry_add(&telemetry->counters.stages[i], &scan->counters.stages[i]);
+            if (scan->counters.stage_names[i])
+                telemetry->counters.stage_names[i] = scan->counters.stage_names[i];
+        }
+        for (i = 0; i < scan->sigprof.size; i++) {
+            struct cli_sigprof_entry *src = &scan->sigprof.entries[i], *dst;
+
+            if (!src->name)
+                continue;
+            dst = sigprof_get(&telemetry->sigprof, src->name, src->kind);
+            if (!dst)
+                break;
+            dst->samples += src->samples;
+            dst->nsec += src->nsec;
+        }
+#ifdef CL_THREAD_SAFE
+        pthread_mutex_unlock(&telemetry->mutex);
+#endif
+    }
+
+    sigprof_clear(&scan->sigprof);
+    free(scan);
+}
+
+void cli_telemetry_file_start(struct cli_telemetry_scan *scan, struct cli_telemetry_timer *timer)
+{
+    gettimeofday(&timer->start, NULL);
+    timer->accounted = scan->accounted;
+}
+
+void cli_telemetry_file_done(struct cli_telemetry_scan *scan, const struct cli_telemetry_timer *timer,
+                             cli_file_t type, size_t bytes, unsigned int depth)
+{
+    struct timeval now;
+    struct cli_telemetry_counter *counter;
+    int64_t delta;
+    uint64_t elapsed, nested;
+    unsigned int slot = 0;
+
+    gettimeofday(&now, NULL);
+    delta   = ((int64_t)now.tv_sec - timer->start.tv_sec) * 1000000 + now.tv_usec - timer->start.tv_usec;
+    elapsed = delta > 0 ? (uint64_t)delta : 0;
+
+    /* files scanned while this one was open already accounted for their time */
+    nested = scan->accounted - timer->accounted;
+    if (nested > elapsed)
+        nested = elapsed;
+
+    if (type >= CL_TYPENO && type <= CL_TYPE_IGNORED)
+        slot = type - CL_TYPENO + 1;
+
+    counter = &scan->counters.types[slot];
+    counter->count++;
+    counter->bytes += bytes;
+    counter->usec += elapsed - nested;
+
+    if (depth >= CLI_TELEMETRY_MAXDEPTH)
+        depth = CLI_TELEMETRY_MAXDEPTH - 1;
+
+    counter = &scan->counters.depth[depth];
+    counter->count++;
+    counter->bytes += bytes;
+    counter->usec += elapsed;
+
+    scan->accounted = timer->accounted + elapsed;
+}
+
+void cli_telemetry_stage(struct cli_telemetry_scan *scan, unsigned int id, const char *name,
+                         uint64_t calls, uint64_t usec)
+{
+    if (id >= PERFT_LAST)
+        return;
+
+    scan->counters.stages[id].count += calls;
+    scan->counters.stages[id].usec += usec;
+    scan->counters.stage_names[id] = name;
+}
+
+void cli_sigprof_record(struct cli_telemetry_scan *scan, const char *name, unsigned int kind, uint64_t start)
+{
+    struct cli_sigprof_entry *entry;
+    uint64_t now = cli_sigprof_now();
+
+    if (!name || kind >= SIGPROF_LAST)
+        return;
+
+    entry = sigprof_get(&scan->sigprof, name, kind);
+    if (!entry)
+        return;
+
+    entry->samples++;
+    if (now > start)
+        entry->nsec += now - start;
+}
+
+cl_error_t cl_engine_get_telemetry(const struct cl_engine *engine, char **report, int reset)
+{
+    struct cli_telemetry *telemetry;
+    struct cli_telemetry_counters *counters = NULL;
+    struct cli_telemetry_counter *counter;
+    struct cli_sigprof_entry *sigs = NULL;
+    uint32_t nsigs = 0, top;
+    time_t since;
+    uint64_t scans;
+    size_t size, len = 0;
+    char *buf = NULL;
+    unsigned int i;
+
+    if (!engine || !report)
+        return CL_ENULLARG;
+
+    *report = NULL;
+
+    telemetry = engine->telemetry;
+    if (!telemetry || !(engine->engine_options & ENGINE_OPTIONS_TELEMETRY)) {
+        cli_dbgmsg("cl_engine_get_telemetry: telemetry is not enabled\n");
+        return CL_EARG;
+    }
+
+    counters = cli_malloc(sizeof(*counters));
+    if (!counters) {
+        cli_errmsg("cl_engine_get_telemetry: Can't allocate memory for counters\n");
+        return CL_EMEM;
+    }
+
+    /* copy out under the lock, format without it */
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_lock(&telemetry->mutex);
+#endif
+    memcpy(counters, &telemetry->counters, sizeof(*counters));
+    since = telemetry->since;
+    scans = telemetry->scans;
+    if (telemetry->sigprof.used) {
+        sigs = cli_malloc(telemetry->sigprof.used * sizeof(*sigs));
+        if (sigs) {
+            for (i = 0; i < telemetry->sigprof.size; i++) {
+                if (telemetry->sigprof.entries[i].name)
+                    sigs[nsigs++] = telemetry->sigprof.entries[i];
+            }
+        } else {
+            cli_dbgmsg("cl_engine_get_telemetry: Can't copy the signature profile, it will be skipped\n");
+        }
+    }
+    if (reset) {
+        memset(&telemetry->counters, 0, sizeof(telemetry->counters));
+        sigprof_clear(&telemetry->sigprof);
+        telemetry->since = time(NULL);
+        telemetry->scans = 0;
+    }
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_unlock(&telemetry->mutex);
+#endif
+
+    top = engine->telemetry_signatures;
+    if (top > nsigs)
+        top = nsigs;
+    if (top)
+        qsort(sigs, nsigs, sizeof(*sigs), sigprof_cmp);
+
+    size = (1 + CLI_TELEMETRY_NTYPES + CLI_TELEMETRY_MAXDEPTH + PERFT_LAST + top) * TELEMETRY_LINE_MAX;
+    for (i = 0; i < top; i++)
+        size += strlen(sigs[i].name);
+    buf = cli_malloc(size);
+    if (!buf) {
+        cli_errmsg("cl_engine_get_telemetry: Can't allocate memory for report\n");
+        free(counters);
+        free(sigs);
+        return CL_EMEM;
+    }
+
+    len += snprintf(buf + len, size - len, "TELEMETRY: since %llu scans %llu\n",
+                    (unsigned long long)since, (unsigned long long)scans);
+
+    for (i = 0; i < CLI_TELEMETRY_NTYPES; i++) {
+        const char *name = NULL;
+
+        counter = &counters->types[i];
+        if (!counter->count)
+            continue;
+        if (i)
+            name = cli_ftname((cli_file_t)(i - 1 + CL_TYPENO));
+        len += snprintf(buf + len, size - len, "TYPE: %s files %llu bytes %llu usec %llu\n",
+                        name ? name : "CL_TYPE_UNKNOWN",
+                        (unsigned long long)counter->count,
+                        (unsigned long long)counter->bytes,
+                        (unsigned long long)counter->usec);
+    }
+
+    for (i = 0; i < CLI_TELEMETRY_MAXDEPTH; i++) {
+        counter = &counters->depth[i];
+        if (!counter->count)
+            continue;
+        len += snprintf(buf + len, size - len, "DEPTH: %u files %llu bytes %llu usec %llu\n", i,
+                        (unsigned long long)counter->count,
+                        (unsigned long long)counter->bytes,
+                        (unsigned long long)counter->usec);
+    }
+
+    for (i = 0; i < PERFT_LAST; i++) {
+        counter = &counters->stages[i];
+        if (!counter->count || !counters->stage_names[i])
+            continue;
+        len += snprintf(buf + len, size - len, "STAGE: %s calls %llu usec %llu\n",
+                        counters->stage_names[i],
+                        (unsigned long long)counter->count,
+                        (unsigned long long)counter->usec);
+    }
+
+    for (i = 0; i < top; i++) {
+        len += snprintf(buf + len, size - len, "SIGNATURE: %s %s samples %llu usec %llu\n",
+                        sigs[i].name, sigprof_kinds[sigs[i].kind],
+                        (unsigned long long)sigs[i].samples,
+                        (unsigned long long)(sigs[i].nsec * CLI_SIGPROF_INTERVAL / 1000));
+    }
+
+    free(counters);
+    free(sigs);
+    *report = buf;
+
+    return CL_SUCCESS;
+}
+
+struct cli_trace *cli_trace_new(const struct cl_engine *engine, const char *filepath)
+{
+    struct cli_trace *trace;
+
+    if (!engine->cb_trace)
+        return NULL;
+
+    trace = cli_calloc(1, sizeof(*trace));
+    if (!trace) {
+        cli_dbgmsg("cli_trace_new: Can't allocate memory, scan will not be traced\n");
+        return NULL;
+    }
+    trace->start = cli_sigprof_now();
+    if (filepath && !(trace->path = cli_strdup(filepath))) {
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+static void trace_vprintf(struct cli_trace *trace, const char *fmt, va_list ap)
+{
+    va_list copy;
+    size_t size;
+    char *buf;
+    int n;
+
+    if (trace->failed)
+        return;
+
+    va_copy(copy, ap);
+    n = vsnprintf(trace->buf + trace->len, trace->size - trace->len, fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        trace->failed = 1;
+        return;
+    }
+
+    if ((size_t)n >= trace->size - trace->len) {
+        size = trace->size ? trace->size : TRACE_INITIAL_SIZE;
+        while (size - trace->len <= (size_t)n)
+            size *= 2;
+        buf = cli_realloc(trace->buf, size);
+        if (!buf) {
+            cli_dbgmsg("trace_vprintf: Can't grow trace to %zu bytes, dropping it\n", size);
+            trace->failed = 1;
+            return;
+        }
+        trace->buf  = buf;
+        trace->size = size;
+        vsnprintf(trace->buf + trace->len, trace->size - trace->len, fmt, ap);
+    }
+    trace->len += n;
+}
+
+static void trace_printf(struct cli_trace *trace, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    trace_vprintf(trace, fmt, ap);
+    va_end(ap);
+}
+
+/* Append str as the contents of a JSON string */
+static void trace_escape(struct cli_trace *trace, const char *str)
+{
+    const unsigned char *p;
+    size_t run;
+
+    for (p = (const unsigned char *)str; *p; p += run) {
+        for (run = 0; p[run] >= 0x20 && p[run] != '"' && p[run] != '\\'; run++)
+            ;
+        if (run) {
+            trace_printf(trace, "%.*s", (int)run, (const char *)p);
+            continue;
+        }
+        if (*p == '"' || *p == '\\')
+            trace_printf(trace, "\\%c", *p);
+        else
+            trace_printf(trace, "\\u%04x", *p);
+        run = 1;
+    }
+}
+
+static const char *trace_typename(cli_file_t type)
+{
+    const char *name = cli_ftname(type);
+
+    return name ? name : "CL_TYPE_ANY";
+}
+
+void cli_trace_file_start(struct cli_trace *trace, const fmap_t *map)
+{
+    struct cli_trace_node *node;
+
+    /* a failed trace is dropped, don't keep pushing objects nobody pops */
+    if (trace->failed)
+        return;
+
+    if (trace->depth == trace->stack_size) {
+        uint32_t size = trace->stack_size ? trace->stack_size * 2 : TRACE_INITIAL_DEPTH;
+
+        node = cli_realloc(trace->stack, size * sizeof(*node));
+        if (!node) {
+            cli_dbgmsg("cli_trace_file_start: Can't grow object stack, dropping the trace\n");
+            trace->failed = 1;
+            return;
+        }
+        trace->stack      = node;
+        trace->stack_size = size;
+    }
+
+    node             = &trace->stack[trace->depth++];
+    node->id         = ++trace->next_id;
+    node->type       = CL_TYPE_ANY;
+    node->start      = cli_sigprof_now();
+    node->children   = 0;
+    node->fmap_bytes = map->need_bytes;
+    node->tempfiles  = trace->tempfiles;
+}
+
+void cli_trace_file_type(struct cli_trace *trace, cli_file_t type)
+{
+    if (trace->failed || !trace->depth)
+        return;
+
+    trace->stack[trace->depth - 1].type = type;
+}
+
+void cli_trace_file_done(struct cli_trace *trace, const fmap_t *map, unsigned int depth, cl_error_t ret)
+{
+    struct cli_trace_node *node;
+    uint64_t elapsed;
+    uint32_t i;
+
+    if (trace->failed || !trace->depth)
+        return;
+
+    node    = &trace->stack[trace->depth - 1];
+    elapsed = cli_sigprof_now() - node->start;
+    if (trace->depth > 1)
+        trace->stack[trace->depth - 2].children += elapsed;
+
+    trace_printf(trace, "{\"id\":%u,\"parent\":%u,\"depth\":%u,\"type\":\"%s\",\"size\":%zu,",
+                 node->id, trace->depth > 1 ? trace->stack[trace->depth - 2].id : 0, depth,
+                 trace_typename(node->type), map->len);
+    trace_printf(trace, "\"start_usec\":%llu,\"usec\":%llu,\"self_usec\":%llu,\"fmap_bytes\":%llu,\"tempfiles\":%llu,",
+                 (unsigned long long)((node->start - trace->start) / 1000),
+                 (unsigned long long)(elapsed / 1000),
+                 (unsigned long long)((node->children < elapsed ? elapsed - node->children : 0) / 1000),
+                 (unsigned long long)(map->need_bytes - node->fmap_bytes),
+                 (unsigned long long)(trace->tempfiles - node->tempfiles));
+    trace_printf(trace, "\"result\":\"%s\",\"stack\":\"", cl_strerror(ret));
+    for (i = 0; i < trace->depth; i++)
+        trace_printf(trace, "%s%s", i ? ";" : "", trace_typename(trace->stack[i].type));
+    trace_printf(trace, "\"");
+    if (map->name) {
+        trace_printf(trace, ",\"name\":\"");
+        trace_escape(trace, map->name);
+        trace_printf(trace, "\"");
+    }
+    if (trace->depth == 1 && trace->path) {
+        trace_printf(trace, ",\"path\":\"");
+        trace_escape(trace, trace->path);
+        trace_printf(trace, "\"");
+    }
+    trace_printf(trace, "}\n");
+
+    trace->depth--;
+}
+
+void cli_trace_scan_done(const struct cl_engine *engine, struct cli_trace *trace, void *context)
+{
+    if (!trace)
+        return;
+
+    if (!trace->failed && trace->len && engine->cb_trace)
+        engine->cb_trace(trace->buf, trace->len, context);
+
+    free(trace->buf);
+    free(trace->stack);
+    free(trace->path);
+    free(trace);
+}
@@ -0,0 +1,281 @@
+/*
+ *  Engine-wide scan telemetry
+ *
+ *  Copyright (C) 2013-2020 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#if HAVE_CONFIG_H
+#include "clamav-config.h"
+#endif
+
+#include <sys/types.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+#ifdef CL_THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#include "clamav.h"
+#include "events.h"
+#include "filetypes.h"
+#include "fmap.h"
+
+/* one signature evaluation in this many is timed, must be a power of two */
+#define CLI_SIGPROF_INTERVAL 64
+
+/* nested files deeper than this are accounted to the last depth bucket */
+#define CLI_TELEMETRY_MAXDEPTH 16
+
+/* slot 0 holds files that never got a type, the rest are CL_TYPENO based */
+#define CLI_TELEMETRY_NTYPES (CL_TYPE_IGNORED - CL_TYPENO + 2)
+
+struct cli_telemetry_counter {
+    uint64_t count; /* files for type/depth counters, calls for stages */
+    uint64_t bytes;
+    uint64_t usec;
+};
+
+struct cli_telemetry_counters {
+    struct cli_telemetry_counter types[CLI_TELEMETRY_NTYPES]; /* self time, children excluded */
+    struct cli_telemetry_counter depth[CLI_TELEMETRY_MAXDEPTH]; /* time including children */
+    struct cli_telemetry_counter stages[PERFT_LAST];
+    const char *stage_names[PERFT_LAST];
+};
+
+enum cli_sigprof_kind {
+    SIGPROF_AC = 0,   /* pattern verification in ac_findmatch() */
+    SIGPROF_LSIG,     /* logical expression and lsig conditions */
+    SIGPROF_BYTECODE, /* cli_bytecode_runlsig() */
+    SIGPROF_YARA,     /* yr_execute_code() */
+    SIGPROF_LAST
+};
+
+struct cli_sigprof_entry {
+    const char *name; /* owned by the engine, compared by address */
+    uint32_t kind;
+    uint64_t samples;
+    uint64_t nsec;
+};
+
+/* Open addressing table of sampled signatures */
+struct cli_sigprof {
+    struct cli_sigprof_entry *entries;
+    uint32_t size; /* power of two */
+    uint32_t used;
+};
+
+/*
+ * Counters for a single cl_scan*() call. These belong to the scanning
+ * thread alone and are folded into the engine totals once the scan is over,
+ * so the engine lock is taken once per scan rather than once per file.
+ */
+struct cli_telemetry_scan {
+    uint64_t accounted; /* usec already attributed to files of this scan */
+    struct cli_telemetry_counters counters;
+    int sigprof_enabled;
+    uint32_t sigprof_tick;
+    struct cli_sigprof sigprof;
+};
+
+/* Totals kept by the engine since telemetry was enabled or last reset */
+struct cli_telemetry {
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_t mutex;
+#endif
+    time_t since;
+    uint64_t scans;
+    struct cli_telemetry_counters counters;
+    struct cli_sigprof sigprof;
+};
+
+/*
+ * Counters every engine keeps whether telemetry is enabled or not. They are
+ * updated once per top-level scan, see CL_ENGINE_SCANS and friends.
+ */
+struct cli_counters {
+#ifdef CL_THREAD_SAFE
+    pthread_mutex_t mutex;
+#endif
+    uint64_t scans;
+    uint64_t bytes;
+    uint64_t cache_lookups;
+    uint64_t cache_hits;
+};
+
+/* Time stamp taken when cli_magic_scan() starts on a file */
+struct cli_telemetry_timer {
+    struct timeval start;
+    uint64_t accounted;
+};
+
+/* An object of a traced scan that cli_magic_scan() hasn't finished yet */
+struct cli_trace_node {
+    uint32_t id;
+    cli_file_t type;
+    uint64_t start;      /* cli_sigprof_now() when the object was entered */
+    uint64_t children;   /* nsec spent in nested objects */
+    uint64_t fmap_bytes; /* need_bytes of the object's fmap when it was entered */
+    uint64_t tempfiles;  /* temp files of the scan when the object was entered */
+};
+
+/*
+ * Trace of a single cl_scan*() call, collected when the engine has a trace
+ * callback. Every object cli_magic_scan() finishes adds one JSON line to
+ * the buffer, which is handed to the callback once the scan is over.
+ */
+struct cli_trace {
+    char *buf;
+    size_t len;
+    size_t size;
+    struct cli_trace_node *stack; /* objects being scanned, outermost first */
+    uint32_t depth;
+    uint32_t stack_size;
+    uint32_t next_id;
+    uint64_t start;     /* cli_sigprof_now() when the scan started */
+    uint64_t tempfiles; /* temp files created by the scan so far */
+    char *path;         /* of the scanned file, if known */
+    int failed;         /* out of memory, nothing is reported */
+};
+
+struct cli_telemetry *cli_telemetry_new(void);
+void cli_telemetry_free(struct cli_telemetry *telemetry);
+
+struct cli_telemetry_scan *cli_telemetry_scan_new(const struct cl_engine *engine);
+
+struct cli_counters *cli_counters_new(void);
+void cli_counters_free(struct cli_counters *counters);
+
+/**
+ * @brief Account a finished top-level scan.
+ *
+ * @param counters      The engine counters, may be NULL.
+ * @param bytes         Size of the scanned file.
+ * @param cache_lookups Cache lookups made by the scan, nested files included.
+ * @param cache_hits    How many of them found the file in the cache.
+ */
+void cli_counters_scan_done(struct cli_counters *counters, uint64_t bytes, uint32_t cache_lookups, uint32_t cache_hits);
+
+/* Value of a CL_ENGINE_SCANS, CL_ENGINE_SCANNED_BYTES or CL_ENGINE_CACHE_* counter */
+uint64_t cli_counters_get(struct cli_counters *counters, enum cl_engine_field field);
+
+/**
+ * @brief Fold the counters of a finished scan into the engine totals.
+ *
+ * @param engine    The engine the scan ran with.
+ * @param scan      Counters of the scan. Freed by this call.
+ */
+void cli_telemetry_scan_done(const struct cl_engine *engine, struct cli_telemetry_scan *scan);
+
+void cli_telemetry_file_start(struct cli_telemetry_scan *scan, struct cli_telemetry_timer *timer);
+
+/**
+ * @brief Account a file once cli_magic_scan() is done with it.
+ *
+ * The file type counter gets the time spent on this file minus the time
+ * already attributed to files nested inside it. The depth counter gets the
+ * full time.
+ *
+ * @param scan      Counters of the current scan.
+ * @param timer     Timer started by cli_telemetry_file_start().
+ * @param type      Detected type of the file, or CL_TYPE_ANY if unknown.
+ * @param bytes     Size of the file.
+ * @param depth     Recursion level of the file.
+ */
+void cli_telemetry_file_done(struct cli_telemetry_scan *scan, const struct cli_telemetry_timer *timer,
+                             cli_file_t type, size_t bytes, unsigned int depth);
+
+void cli_telemetry_stage(struct cli_telemetry_scan *scan, unsigned int id, const char *name,
+                         uint64_t calls, uint64_t usec);
+
+/**
+ * @brief Decide whether the next signature evaluation gets timed.
+ *
+ * Cheap enough for the Aho-Corasick verification loop. Returns non-zero
+ * for one call in CLI_SIGPROF_INTERVAL when signature profiling is on.
+ */
+static inline int cli_sigprof_sample(struct cli_telemetry_scan *scan)
+{
+    return scan && scan->sigprof_enabled && !(++scan->sigprof_tick & (CLI_SIGPROF_INTERVAL - 1));
+}
+
+/* Monotonic time stamp in nanoseconds */
+static inline uint64_t cli_sigprof_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+    }
+}
+
+/**
+ * @brief Account a sampled signature evaluation started at @start.
+ *
+ * @param scan      Counters of the current scan.
+ * @param name      Signature name, owned by the engine.
+ * @param kind      One of enum cli_sigprof_kind.
+ * @param start     Value of cli_sigprof_now() taken before the evaluation.
+ */
+void cli_sigprof_record(struct cli_telemetry_scan *scan, const char *name, unsigned int kind, uint64_t start);
+
+/* Returns a new trace if the engine has a trace callback, NULL otherwise */
+struct cli_trace *cli_trace_new(const struct cl_engine *engine, const char *filepath);
+
+/**
+ * @brief Hand the trace of a finished scan to the engine's trace callback.
+ *
+ * @param engine    The engine the scan ran with.
+ * @param trace     Trace of the scan, may be NULL. Freed by this call.
+ * @param context   The scan's callback context.
+ */
+void cli_trace_scan_done(const struct cl_engine *engine, struct cli_trace *trace, void *context);
+
+void cli_trace_file_start(struct cli_trace *trace, const fmap_t *map);
+
+/* Record the type of the innermost object once it is known */
+void cli_trace_file_type(struct cli_trace *trace, cli_file_t type);
+
+/**
+ * @brief Add the line of the innermost object once cli_magic_scan() is done with it.
+ *
+ * @param trace     Trace of the current scan.
+ * @param map       The object's fmap, as passed to cli_trace_file_start().
+ * @param depth     Recursion level of the object.
+ * @param ret       What cli_magic_scan() returns for it.
+ */
+void cli_trace_file_done(struct cli_trace *trace, const fmap_t *map, unsigned int depth, cl_error_t ret);
+
+/* Account a temp file created on behalf of the traced scan */
+static inline void cli_trace_tempfile(struct cli_trace *trace)
+{
+    if (trace)
+        trace->tempfiles++;
+}
+
+#endif
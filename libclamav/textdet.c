@@ -78,6 +78,29 @@ static char text_chars[256] = {
 };
 // clang-format on
 
+#define ONES 0x0101010101010101ULL
+
+/*
+ * Checks 8 bytes at once for printable ASCII (0x20 - 0x7e), or for any byte
+ * that isn't a control character when @high is set. Returns 0 whenever the
+ * bytes need a closer look, the callers then fall back to the table.
+ */
+static inline int td_isprint8(const unsigned char *buf, int high)
+{
+    uint64_t word, low;
+
+    memcpy(&word, buf, 8);
+    low = word & (0x7f * ONES);
+
+    /* a byte below 0x20 or equal to 0x7f */
+    if (((word - 0x20 * ONES) & ~word) & (0x80 * ONES))
+        return 0;
+    if ((low + ONES) & ~word & (0x80 * ONES))
+        return 0;
+
+    return high || !(word & (0x80 * ONES));
+}
+
 static int td_isascii(const unsigned char *buf, unsigned int len)
 {
     unsigned int i;
@@ -94,9 +117,14 @@ static int td_isascii(const unsigned char *buf, unsigned int len)
     /* Validate that the data all falls within the bounds of
 	 * plain ASCII, ISO-8859 text, and non-ISO extended ASCII (Mac, IBM PC)
 	 */
-    for (i = 0; i < len; i++)
+    for (i = 0; i < len; i++) {
+        if (i + 8 <= len && td_isprint8(buf + i, 1)) {
+            i += 7;
+            continue;
+        }
         if (text_chars[buf[i]] == F)
             return 0;
+    }
 
     return 1;
 }
@@ -106,6 +134,11 @@ static int td_isutf8(const unsigned char *buf, unsigned int len)
     unsigned int i, j, gotone = 0;
 
     for (i = 0; i < len; i++) {
+        if (i + 8 <= len && td_isprint8(buf + i, 0)) {
+            i += 7;
+            continue;
+        }
+
         if ((buf[i] & 0x80) == 0) { /* 0xxxxxxx is plain ASCII */
             /*
 	     * Even if the whole file is valid UTF-8 sequences,
@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include "clamav.h"
 #include "textnorm.h"
@@ -88,6 +89,29 @@ static const enum normalize_action char_action[256] = {
     IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN,
     IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN};
 
+#define ONES 0x0101010101010101ULL
+
+/* Lowercases 8 bytes from @in into @out if they are all NORMALIZE_COPY or
+ * NORMALIZE_ADD_32, ie. within 0x21 - 0x7e. Returns 0 and writes nothing
+ * otherwise. */
+static inline int text_normalize_word(const unsigned char *in, unsigned char *out)
+{
+    uint64_t word, upper;
+
+    memcpy(&word, in, 8);
+
+    /* any byte below 0x21, above 0x7e, or with the high bit set */
+    if ((((word - 0x21 * ONES) & ~word) | word | ((word & 0x7f * ONES) + ONES)) & (0x80 * ONES))
+        return 0;
+
+    /* high bit set for 'A' - 'Z', the additions can't carry as all bytes are below 0x7f */
+    upper = (word + (0x80 - 'A') * ONES) & ~(word + (0x80 - 'Z' - 1) * ONES) & (0x80 * ONES);
+    word |= upper >> 2;
+
+    memcpy(out, &word, 8);
+    return 1;
+}
+
 /* Normalizes the text at @buf of length @buf_len, @buf can include \0 characters.
  * Stores the normalized text in @state's buffer.
  * Returns how many bytes it consumed of the input. */
@@ -98,7 +122,17 @@ size_t text_normalize_buffer(struct text_norm_state *state, const unsigned char
     unsigned char *p             = state->out + state->out_pos;
 
     for (i = 0; i < buf_len && p < out_end; i++) {
-        unsigned char c = buf[i];
+        unsigned char c;
+
+        /* runs of plain characters are copied and lowercased 8 at a time */
+        if (i + 8 <= buf_len && p + 8 <= out_end && text_normalize_word(buf + i, p)) {
+            state->space_written = 0;
+            p += 8;
+            i += 7;
+            continue;
+        }
+
+        c = buf[i];
         switch (char_action[c]) {
             case NORMALIZE_SKIP:
                 continue;
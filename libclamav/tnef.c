@@ -36,11 +36,19 @@
 #include "clamav.h"
 #include "others.h"
 
-#include "mbox.h"
+#include "scanners.h"
 #include "tnef.h"
 
+/* Attachment being decoded, scanned when the next message starts or at the end of the file */
+struct tnef_part {
+    struct cli_membuf buf;
+    char *name;
+    int full; /* stopped keeping data, the rest of the attachment is dropped */
+};
+
 static int tnef_message(fmap_t *map, off_t *pos, uint16_t type, uint16_t tag, int32_t length, off_t fsize);
-static int tnef_attachment(fmap_t *map, off_t *pos, uint16_t type, uint16_t tag, int32_t length, const char *dir, fileblob **fbref, off_t fsize);
+static int tnef_attachment(cli_ctx *ctx, off_t *pos, uint16_t type, uint16_t tag, int32_t length, struct tnef_part *part, off_t fsize);
+static cl_error_t tnef_flush(cli_ctx *ctx, struct tnef_part *part);
 static int tnef_header(fmap_t *map, off_t *pos, uint8_t *part, uint16_t *type, uint16_t *tag, int32_t *length);
 
 #define TNEF_SIGNATURE 0x223E9f78
@@ -61,12 +69,13 @@ static int tnef_header(fmap_t *map, off_t *pos, uint8_t *part, uint16_t *type, u
 /* a TNEF file must be at least this size */
 #define MIN_SIZE (sizeof(uint32_t) + sizeof(uint16_t))
 
-int cli_tnef(const char *dir, cli_ctx *ctx)
+int cli_tnef(cli_ctx *ctx)
 {
     uint32_t i32;
     uint16_t i16;
-    fileblob *fb;
-    int ret, alldone;
+    struct tnef_part attachment;
+    int ret, alldone, infected = 0;
+    cl_error_t rc;
     off_t fsize, pos = 0;
 
     fsize = ctx->fmap[0]->len;
@@ -92,7 +101,7 @@ int cli_tnef(const char *dir, cli_ctx *ctx)
     }
     pos += sizeof(uint16_t);
 
-    fb      = NULL;
+    memset(&attachment, 0, sizeof(attachment));
     ret     = CL_CLEAN; /* we don't know if it's clean or not :-) */
     alldone = 0;
 
@@ -129,11 +138,15 @@ int cli_tnef(const char *dir, cli_ctx *ctx)
         switch (part) {
             case LVL_MESSAGE:
                 cli_dbgmsg("TNEF - found message\n");
-                if (fb != NULL) {
-                    fileblobDestroy(fb);
-                    fb = NULL;
+                if ((rc = tnef_flush(ctx, &attachment)) != CL_SUCCESS) {
+                    if (rc == CL_VIRUS)
+                        infected = 1;
+                    if (rc != CL_VIRUS || !SCAN_ALLMATCHES) {
+                        ret     = rc;
+                        alldone = 1;
+                        break;
+                    }
                 }
-                fb = fileblobCreate();
                 if (tnef_message(*ctx->fmap, &pos, type, tag, length, fsize) != 0) {
                     cli_dbgmsg("TNEF: Error reading TNEF message\n");
                     ret     = CL_EFORMAT;
@@ -142,7 +155,7 @@ int cli_tnef(const char *dir, cli_ctx *ctx)
                 break;
             case LVL_ATTACHMENT:
                 cli_dbgmsg("TNEF - found attachment\n");
-                if (tnef_attachment(*ctx->fmap, &pos, type, tag, length, dir, &fb, fsize) != 0) {
+                if (tnef_attachment(ctx, &pos, type, tag, length, &attachment, fsize) != 0) {
                     cli_dbgmsg("TNEF: Error reading TNEF attachment\n");
                     ret     = CL_EFORMAT;
                     alldone = 1;
@@ -185,15 +198,18 @@ int cli_tnef(const char *dir, cli_ctx *ctx)
         }
     } while (!alldone);
 
-    if (fb) {
+    if (attachment.buf.len && (!infected || SCAN_ALLMATCHES)) {
         cli_dbgmsg("cli_tnef: flushing final data\n");
-        if (fileblobGetFilename(fb) == NULL) {
-            cli_dbgmsg("Saving TNEF portion with an unknown name\n");
-            fileblobSetFilename(fb, dir, "tnef");
-        }
-        fileblobDestroy(fb);
-        fb = NULL;
+        if ((rc = tnef_flush(ctx, &attachment)) == CL_VIRUS)
+            infected = 1;
+        else if (rc != CL_SUCCESS)
+            ret = rc;
     }
+    cli_membuf_free(&attachment.buf);
+    free(attachment.name);
+
+    if (infected)
+        ret = CL_VIRUS;
 
     cli_dbgmsg("cli_tnef: returning %d\n", ret);
     return ret;
@@ -278,9 +294,34 @@ tnef_message(fmap_t *map, off_t *pos, uint16_t type, uint16_t tag, int32_t lengt
     return 0;
 }
 
+/*
+ * Scan the attachment decoded so far and start a new one. Returns CL_SUCCESS
+ * unless the scan found something or failed.
+ */
+static cl_error_t
+tnef_flush(cli_ctx *ctx, struct tnef_part *part)
+{
+    cl_error_t ret = CL_SUCCESS;
+
+    if (part->buf.len) {
+        if (part->name == NULL)
+            cli_dbgmsg("Scanning TNEF portion with an unknown name\n");
+        ret = cli_magic_scan_buff(part->buf.data, part->buf.len, ctx, part->name ? part->name : "tnef");
+        if (ret == CL_CLEAN)
+            ret = CL_SUCCESS;
+    }
+    part->buf.len = 0;
+    part->full    = 0;
+    free(part->name);
+    part->name = NULL;
+
+    return ret;
+}
+
 static int
-tnef_attachment(fmap_t *map, off_t *pos, uint16_t type, uint16_t tag, int32_t length, const char *dir, fileblob **fbref, off_t fsize)
+tnef_attachment(cli_ctx *ctx, off_t *pos, uint16_t type, uint16_t tag, int32_t length, struct tnef_part *part, off_t fsize)
 {
+    fmap_t *map = *ctx->fmap;
     uint32_t todo;
     off_t offset;
     char *string;
@@ -306,31 +347,30 @@ tnef_attachment(fmap_t *map, off_t *pos, uint16_t type, uint16_t tag, int32_t le
             (*pos) += (uint32_t)length;
             string[length] = '\0';
             cli_dbgmsg("TNEF filename %s\n", string);
-            if (*fbref == NULL) {
-                *fbref = fileblobCreate();
-                if (*fbref == NULL) {
-                    free(string);
-                    return -1;
-                }
-            }
-            fileblobSetFilename(*fbref, dir, string);
-            free(string);
+            /* like a file name, the first title of an attachment sticks */
+            if (part->name == NULL)
+                part->name = string;
+            else
+                free(string);
             break;
         case attATTACHDATA:
-            if (*fbref == NULL) {
-                *fbref = fileblobCreate();
-                if (*fbref == NULL)
-                    return -1;
-            }
             todo = length;
-            while (todo) {
-                unsigned char buf[BUFSIZ];
-                int32_t got = fmap_readn(map, buf, *pos, MIN(sizeof(buf), todo));
-                if (got <= 0)
+            while (todo && !part->full) {
+                const unsigned char *data;
+                uint32_t got = MIN(todo, map->pgsz);
+
+                if (!CLI_ISCONTAINED2(0, fsize, *pos, (off_t)got))
+                    got = (*pos < fsize) ? (uint32_t)(fsize - *pos) : 0;
+                if (!got || (data = fmap_need_off_once(map, *pos, got)) == NULL)
                     break;
-                (*pos) += got;
 
-                fileblobAddData(*fbref, buf, got);
+                if (cli_checklimits("cli_tnef", ctx, part->buf.len + got, 0, 0) != CL_CLEAN ||
+                    cli_membuf_append(&part->buf, data, got) != CL_SUCCESS) {
+                    cli_dbgmsg("TNEF: Can't keep more attachment data, scanning what we have\n");
+                    part->full = 1;
+                    break;
+                }
+                (*pos) += got;
                 todo -= got;
             }
             break;
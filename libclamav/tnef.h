@@ -27,6 +27,6 @@
 
 #include "others.h"
 
-int cli_tnef(const char *dir, cli_ctx *ctx);
+int cli_tnef(cli_ctx *ctx);
 
 #endif
@@ -1607,6 +1607,50 @@ int cli_scan_ole10(int fd, cli_ctx *ctx)
     return ret;
 }
 
+/*
+ * Same as cli_scan_ole10(), for an Ole10Native stream that is already in
+ * memory. The embedded object is scanned in place.
+ */
+int cli_scan_ole10_buff(const unsigned char *buf, size_t len, cli_ctx *ctx)
+{
+    const unsigned char *end;
+    size_t pos = 4;
+    uint32_t object_size;
+    int i;
+
+    if (len < 4)
+        return CL_CLEAN;
+    object_size = le32_to_host(cli_readint32(buf));
+
+    if ((int64_t)len - object_size >= 4) {
+        /* Probably the OLE type id */
+        pos += 2;
+
+        /* Attachment name, attachment full path, 8 unknown bytes, attachment full path */
+        for (i = 0; i < 3; i++) {
+            if (pos >= len || !(end = memchr(buf + pos, '\0', len - pos)))
+                return CL_CLEAN;
+            pos = end - buf + 1;
+            if (i == 1)
+                pos += 8;
+        }
+
+        if (pos + 4 > len)
+            return CL_CLEAN;
+        object_size = le32_to_host(cli_readint32(buf + pos));
+        pos += 4;
+    }
+
+    len -= pos;
+    if (len > object_size)
+        len = object_size;
+    if (!len)
+        return CL_CLEAN;
+
+    cli_dbgmsg("cli_scan_ole10_buff: scanning %zu bytes\n", len);
+    return cli_magic_scan_buff(buf + pos, len, ctx, NULL);
+}
+
 /*
  * Powerpoint files
  */
@@ -4081,10 +4081,13 @@ cl_error_t
 cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash, uint32_t which)
 {
     char fullname[PATH_MAX];
-    int in_fd = -1, out_fd = -1;
+    int in_fd = -1;
+    STATBUF statbuf;
+    fmap_t *in_map = NULL;
+    size_t in_pos  = 0;
+    struct cli_membuf out;
     cl_error_t ret = CL_SUCCESS;
     const char *opcode_name;
-    char *tempfile = NULL;
     char buf[1024];
     char *data = NULL;
     int len;
@@ -4097,6 +4100,8 @@ cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash
 
     UNUSEDPARAM(U);
 
+    memset(&out, 0, sizeof(out));
+
     snprintf(fullname, sizeof(fullname), "%s" PATHSEP "%s_%u", dir, hash, which);
     fullname[sizeof(fullname) - 1] = '\0';
     in_fd                          = open(fullname, O_RDONLY | O_BINARY);
@@ -4107,8 +4112,15 @@ cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash
         goto done;
     }
 
-    if ((ret = cli_gentempfd(dir, &tempfile, &out_fd)) != CL_SUCCESS) {
-        cli_dbgmsg("[cli_xlm_extract_macros] Failed to open output file\n");
+    if (FSTAT(in_fd, &statbuf) == -1) {
+        cli_dbgmsg("[cli_xlm_extract_macros] Failed to stat input file\n");
+        ret = CL_ESTAT;
+        goto done;
+    }
+
+    if ((in_map = fmap(in_fd, 0, statbuf.st_size, NULL)) == NULL) {
+        cli_dbgmsg("[cli_xlm_extract_macros] Failed to map input file\n");
+        ret = CL_EMAP;
         goto done;
     }
 
@@ -4118,15 +4130,15 @@ cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash
         goto done;
     }
 
-    if (cli_writen(out_fd, FILE_HEADER, sizeof(FILE_HEADER) - 1) != sizeof(FILE_HEADER) - 1) {
+    if ((ret = cli_membuf_append(&out, FILE_HEADER, sizeof(FILE_HEADER) - 1)) != CL_SUCCESS) {
         cli_dbgmsg("[cli_xlm_extract_macros] Failed to write header\n");
-        ret = CL_EWRITE;
         goto done;
     }
 
-    cli_dbgmsg("[cli_xlm_extract_macros] Extracting macros to %s\n", tempfile);
+    cli_dbgmsg("[cli_xlm_extract_macros] Extracting macros from %s\n", fullname);
 
-    while ((ret = cli_readn(in_fd, &biff_header, sizeof(biff_header))) == sizeof(biff_header)) {
+    while (fmap_readn(in_map, &biff_header, in_pos, sizeof(biff_header)) == sizeof(biff_header)) {
+        in_pos += sizeof(biff_header);
         biff_header.opcode = le16_to_host(biff_header.opcode);
         biff_header.length = le16_to_host(biff_header.length);
 
@@ -4150,11 +4162,12 @@ cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash
             goto done;
         }
 
-        if (cli_readn(in_fd, data, biff_header.length) != biff_header.length) {
+        if (fmap_readn(in_map, data, in_pos, biff_header.length) != biff_header.length) {
             cli_dbgmsg("[cli_xlm_extract_macros] Failed to read BIFF record data\n");
             ret = CL_EREAD;
             goto done;
         }
+        in_pos += biff_header.length;
 
         switch (biff_header.opcode) {
             case OPC_FORMULA: {
@@ -4356,59 +4369,46 @@ cli_xlm_extract_macros(const char *dir, cli_ctx *ctx, struct uniq *U, char *hash
             len += 1;
         }
 
-        if (((int)cli_writen(out_fd, buf, len)) != len) {
-            cli_dbgmsg("[cli_xlm_extract_macros] Failed to write output\n");
-            ret = CL_EWRITE;
-            goto done;
+        if ((ret = cli_membuf_append(&out, buf, len)) != CL_SUCCESS) {
+            if (ret == CL_EMEM) {
+                cli_dbgmsg("[cli_xlm_extract_macros] Failed to write output\n");
+                goto done;
+            }
+            cli_dbgmsg("[cli_xlm_extract_macros] Disassembly too big to keep, scanning what we have\n");
+            break;
         }
     }
 
-    if (ret < 0) {
-        ret = CL_EREAD;
-        goto done;
-    }
-
-    if (out_fd != -1) {
-        if (lseek(out_fd, 0, SEEK_SET) != 0) {
-            cli_dbgmsg("cli_xlm_extract_macros: Failed to seek to beginning of temporary file\n");
-            ret = CL_ESEEK;
-            goto done;
-        }
-
-        ctx->recursion += 1;
-        cli_set_container(ctx, CL_TYPE_MSOLE2, 0); //TODO: set correct container size
-
-        if (cli_scan_desc(out_fd, ctx, CL_TYPE_SCRIPT, 0, NULL, AC_SCAN_VIR, NULL, NULL) == CL_VIRUS) {
-            ctx->recursion -= 1;
-            ret = CL_VIRUS;
-            goto done;
-        }
+    ctx->recursion += 1;
+    cli_set_container(ctx, CL_TYPE_MSOLE2, 0); //TODO: set correct container size
 
+    if (cli_scan_mem(out.data, out.len, ctx, CL_TYPE_SCRIPT, 0, NULL, AC_SCAN_VIR, NULL, NULL) == CL_VIRUS) {
         ctx->recursion -= 1;
+        ret = CL_VIRUS;
+        goto done;
     }
 
+    ctx->recursion -= 1;
+
     ret = CL_SUCCESS;
 
 done:
+    if (in_map != NULL) {
+        funmap(in_map);
+        in_map = NULL;
+    }
+
     if (in_fd != -1) {
         close(in_fd);
         in_fd = -1;
     }
 
-    if (out_fd != -1) {
-        close(out_fd);
-        out_fd = -1;
-    }
-
     if (data != NULL) {
         free(data);
         data = NULL;
     }
 
-    if (tempfile != NULL) {
-        free(tempfile);
-        tempfile = NULL;
-    }
+    cli_membuf_free(&out);
 
     return ret;
 }
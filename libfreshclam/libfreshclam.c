@@ -242,6 +242,7 @@ fc_error_t fc_initialize(fc_config *fcConfig)
     g_requestTimeout = fcConfig->requestTimeout;
 
     g_bCompressLocalDatabase = fcConfig->bCompressLocalDatabase;
+    g_maxConcurrentPatches   = fcConfig->maxConcurrentPatches;
 
     status = FC_SUCCESS;
 
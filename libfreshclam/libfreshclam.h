@@ -50,6 +50,7 @@ typedef struct fc_config_ {
     uint32_t connectTimeout;         /**< CURLOPT_CONNECTTIMEOUT, Timeout for the. connection phase (seconds). */
     uint32_t requestTimeout;         /**< CURLOPT_TIMEOUT, Timeout for libcurl transfer operation (seconds). */
     uint32_t bCompressLocalDatabase; /**< If set, will apply gz compression to CLD databases. */
+    uint32_t maxConcurrentPatches;   /**< Max # of database patches to download at once. 0 or 1 to download one at a time. */
     const char *logFile;             /**< (optional) Filepath to use for log output, if desired. */
     const char *logFacility;         /**< (optional) System logging facility (I.e. "syslog"), if desired. */
     const char *localIP;             /**< (optional) client IP for multihomed systems. */
@@ -116,6 +116,7 @@ uint32_t g_connectTimeout = 0;
 uint32_t g_requestTimeout = 0;
 
 uint32_t g_bCompressLocalDatabase = 0;
+uint32_t g_maxConcurrentPatches   = 0;
 
 /**
  * @brief Get DNS text record field # for official databases.
@@ -1235,7 +1236,8 @@ static fc_error_t downloadPatch(
     const char *tmpdir,
     int version,
     char *server,
-    int logerr)
+    int logerr,
+    const char *patchfile)
 {
     fc_error_t ret;
     fc_error_t status = FC_EARG;
@@ -1262,35 +1264,46 @@ static fc_error_t downloadPatch(
         goto done;
     }
 
+    if (NULL != patchfile) {
+        /* Already fetched by downloadPatches(), open it before leaving the current directory. */
+        if (-1 == (fd = open(patchfile, O_RDONLY | O_BINARY))) {
+            logg("!downloadPatch: Can't open %s for reading\n", patchfile);
+            status = FC_EFILE;
+            goto done;
+        }
+    }
+
     if (FC_SUCCESS != mkdir_and_chdir_for_cdiff_tmp(database, tmpdir)) {
         status = FC_EDIRECTORY;
         goto done;
     }
 
-    if (NULL == (tempname = cli_gentemp("."))) {
-        status = FC_EMEM;
-        goto done;
-    }
+    if (-1 == fd) {
+        if (NULL == (tempname = cli_gentemp("."))) {
+            status = FC_EMEM;
+            goto done;
+        }
 
-    snprintf(patch, sizeof(patch), "%s-%d.cdiff", database, version);
-    urlLen = strlen(server) + strlen("/") + strlen(patch);
-    url    = malloc(urlLen + 1);
-    snprintf(url, urlLen + 1, "%s/%s", server, patch);
+        snprintf(patch, sizeof(patch), "%s-%d.cdiff", database, version);
+        urlLen = strlen(server) + strlen("/") + strlen(patch);
+        url    = malloc(urlLen + 1);
+        snprintf(url, urlLen + 1, "%s/%s", server, patch);
 
-    if (FC_SUCCESS != (ret = downloadFile(url, tempname, 1, logerr, 0))) {
-        if (ret == FC_EEMPTYFILE) {
-            logg("Empty script %s, need to download entire database\n", patch);
-        } else {
-            logg("%cgetpatch: Can't download %s from %s\n", logerr ? '!' : '^', patch, url);
+        if (FC_SUCCESS != (ret = downloadFile(url, tempname, 1, logerr, 0))) {
+            if (ret == FC_EEMPTYFILE) {
+                logg("Empty script %s, need to download entire database\n", patch);
+            } else {
+                logg("%cgetpatch: Can't download %s from %s\n", logerr ? '!' : '^', patch, url);
+            }
+            status = ret;
+            goto done;
         }
-        status = ret;
-        goto done;
-    }
 
-    if (-1 == (fd = open(tempname, O_RDONLY | O_BINARY))) {
-        logg("!downloadPatch: Can't open %s for reading\n", tempname);
-        status = FC_EFILE;
-        goto done;
+        if (-1 == (fd = open(tempname, O_RDONLY | O_BINARY))) {
+            logg("!downloadPatch: Can't open %s for reading\n", tempname);
+            status = FC_EFILE;
+            goto done;
+        }
     }
 
     if (-1 == cdiff_apply(fd, 1)) {
@@ -1326,6 +1339,235 @@ done:
     return status;
 }
 
+#if LIBCURL_VERSION_NUM >= 0x071c00
+/* curl_multi_wait() was introduced in 7.28.0 */
+#define HAVE_PARALLEL_PATCHES 1
+
+struct patch_xfer {
+    uint32_t version;
+    char *tempname;
+    CURL *curl;
+    struct FileStruct file;
+};
+
+static void patch_xfer_free(CURLM *multi, struct patch_xfer *xfer)
+{
+    if (NULL != xfer->curl) {
+        curl_multi_remove_handle(multi, xfer->curl);
+        curl_easy_cleanup(xfer->curl);
+        xfer->curl = NULL;
+    }
+    if (-1 != xfer->file.handle) {
+        close(xfer->file.handle);
+        xfer->file.handle = -1;
+    }
+    if (NULL != xfer->tempname) {
+        unlink(xfer->tempname);
+        free(xfer->tempname);
+        xfer->tempname = NULL;
+    }
+}
+
+static fc_error_t patch_xfer_start(
+    CURLM *multi,
+    const char *database,
+    char *server,
+    struct patch_xfer *xfer)
+{
+    fc_error_t ret;
+    fc_error_t status = FC_EMEM;
+    char url[PATH_MAX];
+
+    if (NULL == (xfer->tempname = cli_gentemp(g_tempDirectory))) {
+        goto done;
+    }
+
+    snprintf(url, sizeof(url), "%s/%s-%u.cdiff", server, database, xfer->version);
+    logg("*Retrieving %s\n", url);
+
+    if (FC_SUCCESS != (ret = create_curl_handle(0 == strncasecmp(url, "http", strlen("http")), 1, &xfer->curl))) {
+        logg("!downloadPatches: Failed to create curl handle.\n");
+        status = ret;
+        goto done;
+    }
+
+    if (-1 == (xfer->file.handle = open(xfer->tempname, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0644))) {
+        logg("!downloadPatches: Can't create new file %s\n", xfer->tempname);
+        status = FC_EDBDIRACCESS;
+        goto done;
+    }
+
+    if ((CURLE_OK != curl_easy_setopt(xfer->curl, CURLOPT_URL, url)) ||
+        (CURLE_OK != curl_easy_setopt(xfer->curl, CURLOPT_WRITEFUNCTION, WriteFileCallback)) ||
+        (CURLE_OK != curl_easy_setopt(xfer->curl, CURLOPT_WRITEDATA, (void *)&xfer->file)) ||
+        (CURLE_OK != curl_easy_setopt(xfer->curl, CURLOPT_PRIVATE, (void *)xfer))) {
+        logg("!downloadPatches: Failed to set up curl session for %s.\n", url);
+        status = FC_EINIT;
+        goto done;
+    }
+
+    if (CURLM_OK != curl_multi_add_handle(multi, xfer->curl)) {
+        logg("!downloadPatches: Failed to add curl session for %s.\n", url);
+        status = FC_EINIT;
+        goto done;
+    }
+
+    status = FC_SUCCESS;
+
+done:
+
+    if (FC_SUCCESS != status) {
+        patch_xfer_free(multi, xfer);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Fetch a range of database patches concurrently.
+ *
+ * Up to g_maxConcurrentPatches transfers share one curl multi handle. The
+ * patches are only downloaded here; they are verified and applied in order
+ * by downloadPatch(). A patch that could not be fetched is left NULL in the
+ * output array so the caller can retry it on its own.
+ *
+ * @param database      Database name.
+ * @param server        Server to download the patches from.
+ * @param first         First patch version to fetch.
+ * @param last          Last patch version to fetch.
+ * @param maxSize       Give up if the patches add up to more than this many bytes. 0 means no limit.
+ * @param patchFiles    [out] Array of (last - first + 1) temp filenames, owned by the caller.
+ * @return fc_error_t   FC_SUCCESS if the transfers ran, even if some of them failed.
+ * @return fc_error_t   FC_EFAILEDUPDATE if the patches would cost more than the full database.
+ */
+static fc_error_t downloadPatches(
+    const char *database,
+    char *server,
+    uint32_t first,
+    uint32_t last,
+    uint64_t maxSize,
+    char ***patchFiles)
+{
+    fc_error_t status = FC_EARG;
+
+    CURLM *multi             = NULL;
+    CURLMsg *msg             = NULL;
+    struct patch_xfer *xfers = NULL;
+    struct patch_xfer *xfer  = NULL;
+    char **files             = NULL;
+
+    uint32_t count, next = 0, active = 0, fetched = 0, i;
+    uint64_t total = 0;
+    int running = 0, msgs = 0;
+    long http_code = 0;
+
+    if ((NULL == database) || (NULL == server) || (NULL == patchFiles) || (first > last)) {
+        logg("!downloadPatches: Invalid arguments.\n");
+        goto done;
+    }
+    *patchFiles = NULL;
+    count       = last - first + 1;
+
+    xfers = calloc(count, sizeof(struct patch_xfer));
+    files = calloc(count, sizeof(char *));
+    if ((NULL == xfers) || (NULL == files)) {
+        logg("!downloadPatches: Failed to allocate memory for %u transfers.\n", count);
+        status = FC_EMEM;
+        goto done;
+    }
+    for (i = 0; i < count; i++) {
+        xfers[i].version     = first + i;
+        xfers[i].file.handle = -1;
+    }
+
+    if (NULL == (multi = curl_multi_init())) {
+        logg("!downloadPatches: curl_multi_init failed!\n");
+        status = FC_EINIT;
+        goto done;
+    }
+
+    while ((next < count) || (active > 0)) {
+        while ((next < count) && (active < g_maxConcurrentPatches)) {
+            if (FC_SUCCESS == patch_xfer_start(multi, database, server, &xfers[next]))
+                active++;
+            next++;
+        }
+
+        if (CURLM_OK != curl_multi_perform(multi, &running)) {
+            logg("^downloadPatches: curl_multi_perform failed\n");
+            break;
+        }
+
+        while (NULL != (msg = curl_multi_info_read(multi, &msgs))) {
+            if (CURLMSG_DONE != msg->msg)
+                continue;
+
+            xfer = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&xfer);
+            if (NULL == xfer)
+                continue;
+
+            http_code = 0;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+            if ((CURLE_OK == msg->data.result) && ((200 == http_code) || (206 == http_code)) && (0 < xfer->file.size)) {
+                total += xfer->file.size;
+                files[xfer->version - first] = xfer->tempname;
+                xfer->tempname               = NULL;
+                patch_xfer_free(multi, xfer);
+                fetched++;
+            } else {
+                logg("*downloadPatches: Failed to fetch %s-%u.cdiff (%d, %li), will retry it later\n",
+                     database, xfer->version, msg->data.result, http_code);
+                patch_xfer_free(multi, xfer);
+            }
+            active--;
+        }
+
+        if ((0 != maxSize) && (total > maxSize)) {
+            logg("*downloadPatches: Patches for %s exceed the size of the full database (%llu > %llu bytes)\n",
+                 database, (long long unsigned)total, (long long unsigned)maxSize);
+            status = FC_EFAILEDUPDATE;
+            goto done;
+        }
+
+        if ((active > 0) && (CURLM_OK != curl_multi_wait(multi, NULL, 0, 1000, NULL))) {
+            logg("^downloadPatches: curl_multi_wait failed\n");
+            break;
+        }
+    }
+
+    logg("*downloadPatches: Fetched %u of %u patches for %s (%llu bytes)\n",
+         fetched, count, database, (long long unsigned)total);
+
+    *patchFiles = files;
+    files       = NULL;
+    status      = FC_SUCCESS;
+
+done:
+
+    if (NULL != xfers) {
+        for (i = 0; i < count; i++) {
+            patch_xfer_free(multi, &xfers[i]);
+        }
+        free(xfers);
+    }
+    if (NULL != files) {
+        for (i = 0; i < count; i++) {
+            if (NULL != files[i]) {
+                unlink(files[i]);
+                free(files[i]);
+            }
+        }
+        free(files);
+    }
+    if (NULL != multi) {
+        curl_multi_cleanup(multi);
+    }
+
+    return status;
+}
+#endif
+
 /**
  * @brief Get CVD header info for local CVD/CLD database.
  *
@@ -1867,6 +2109,9 @@ fc_error_t updatedb(
     char *tmpdir  = NULL;
     char *tmpfile = NULL;
 
+    char **patchFiles    = NULL;
+    int bPatchesTooLarge = 0;
+
     unsigned int flevel;
 
     unsigned int i, j;
@@ -1945,7 +2190,40 @@ fc_error_t updatedb(
                 mprintf("Current database is %u versions behind.\n", remoteVersion - localVersion);
             }
         }
-        for (i = localVersion + 1; i <= remoteVersion; i++) {
+#ifdef HAVE_PARALLEL_PATCHES
+        if ((g_maxConcurrentPatches > 1) && (remoteVersion - localVersion > 1)) {
+            STATBUF sb;
+
+#ifdef HAVE_UNISTD_H
+            if (!mprintf_quiet && (mprintf_progress || isatty(fileno(stdout))))
+#else
+            if (!mprintf_quiet)
+#endif
+            {
+                mprintf("Downloading database patches # %u-%u...\n", localVersion + 1, remoteVersion);
+            }
+
+            /* The local database stands in for the size of a full download. */
+            ret = downloadPatches(database, server, localVersion + 1, remoteVersion,
+                                  (NULL != localFilename && 0 == CLAMSTAT(localFilename, &sb)) ? (uint64_t)sb.st_size : 0,
+                                  &patchFiles);
+            if (FC_EFAILEDUPDATE == ret) {
+                bPatchesTooLarge = 1;
+            } else {
+                /* Anything not fetched above is retried one patch at a time. */
+                ret = FC_SUCCESS;
+            }
+        }
+#endif
+
+        for (i = localVersion + 1; (FC_SUCCESS == ret) && (i <= remoteVersion); i++) {
+            const char *patchFile = (NULL != patchFiles) ? patchFiles[i - localVersion - 1] : NULL;
+
+            if (NULL != patchFile) {
+                ret = downloadPatch(database, tmpdir, i, server, logerr, patchFile);
+                continue;
+            }
+
             for (j = 1; j <= g_maxAttempts; j++) {
                 int llogerr = logerr;
                 if (logerr)
@@ -1959,15 +2237,13 @@ fc_error_t updatedb(
                 {
                     mprintf("Downloading database patch # %u...\n", i);
                 }
-                ret = downloadPatch(database, tmpdir, i, server, llogerr);
+                ret = downloadPatch(database, tmpdir, i, server, llogerr, NULL);
                 if (ret == FC_ECONNECTION || ret == FC_EFAILEDGET) {
                     continue;
                 } else {
                     break;
                 }
             }
-            if (FC_SUCCESS != ret)
-                break;
         }
 
         if (FC_SUCCESS != ret) {
@@ -1976,6 +2252,8 @@ fc_error_t updatedb(
              */
             if (ret == FC_EEMPTYFILE) {
                 logg("*Empty CDIFF found. Skip incremental updates for this version and download %s\n", remoteFilename);
+            } else if (bPatchesTooLarge) {
+                logg("Patches for %s are larger than the full database, downloading %s instead\n", database, remoteFilename);
             } else {
                 logg("^Incremental update failed, trying to download %s\n", remoteFilename);
             }
@@ -2113,6 +2391,15 @@ done:
         cli_rmdirs(tmpdir);
         free(tmpdir);
     }
+    if (NULL != patchFiles) {
+        for (i = 0; i < remoteVersion - localVersion; i++) {
+            if (NULL != patchFiles[i]) {
+                unlink(patchFiles[i]);
+                free(patchFiles[i]);
+            }
+        }
+        free(patchFiles);
+    }
 
     return status;
 }
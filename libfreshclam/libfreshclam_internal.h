@@ -54,6 +54,7 @@ extern uint32_t g_connectTimeout;
 extern uint32_t g_requestTimeout;
 
 extern uint32_t g_bCompressLocalDatabase;
+extern uint32_t g_maxConcurrentPatches;
 
 fc_error_t updatedb(
     const char *database,
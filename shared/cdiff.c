@@ -27,6 +27,7 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -339,14 +340,65 @@ static int cdiff_cmd_xchg(const char *cmdstr, struct cdiff_ctx *ctx, char *lbuf,
     return 0;
 }
 
+static int cdiff_read_db(const char *name, char **data, size_t *size)
+{
+    struct stat sb;
+    char *buf;
+    int fd;
+
+    if ((fd = open(name, O_RDONLY | O_BINARY)) == -1) {
+        logg("!cdiff_read_db: Can't open file %s for reading\n", name);
+        return -1;
+    }
+
+    if (fstat(fd, &sb) == -1) {
+        logg("!cdiff_read_db: Can't fstat file %s\n", name);
+        close(fd);
+        return -1;
+    }
+
+    if (!(buf = malloc(sb.st_size + 1))) {
+        logg("!cdiff_read_db: Can't allocate %llu bytes for %s\n", (long long unsigned)sb.st_size + 1, name);
+        close(fd);
+        return -1;
+    }
+
+    if (cli_readn(fd, buf, sb.st_size) != (size_t)sb.st_size) {
+        logg("!cdiff_read_db: Can't read %s\n", name);
+        free(buf);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    *data = buf;
+    *size = sb.st_size;
+    return 0;
+}
+
+static int cdiff_write_adds(FILE *fh, struct cdiff_node *add)
+{
+    while (add) {
+        if (fputs(add->str, fh) == EOF || fputc('\n', fh) == EOF)
+            return -1;
+        add = add->next;
+    }
+
+    return 0;
+}
+
 static int cdiff_cmd_close(const char *cmdstr, struct cdiff_ctx *ctx, char *lbuf, unsigned int lbuflen)
 {
     struct cdiff_node *add, *del, *xchg;
     unsigned int lines = 0;
-    char *tmp;
+    char *tmp, *data = NULL, *line, *eol, *keep;
+    size_t size = 0, linelen, slen;
     FILE *fh, *tmpfh;
+    int ret = -1;
 
     UNUSEDPARAM(cmdstr);
+    UNUSEDPARAM(lbuf);
+    UNUSEDPARAM(lbuflen);
 
     if (!ctx->open_db) {
         logg("!cdiff_cmd_close: No database to close\n");
@@ -357,123 +409,132 @@ static int cdiff_cmd_close(const char *cmdstr, struct cdiff_ctx *ctx, char *lbuf
     del  = ctx->del_start;
     xchg = ctx->xchg_start;
 
-    if (del || xchg) {
+    if (!del && !xchg) {
+        /* nothing to rewrite, only append the new signatures */
+        if (add) {
+            if (!(fh = fopen(ctx->open_db, "ab"))) {
+                logg("!cdiff_cmd_close: Can't open file %s for appending\n", ctx->open_db);
+                return -1;
+            }
 
-        if (!(fh = fopen(ctx->open_db, "rb"))) {
-            logg("!cdiff_cmd_close: Can't open file %s for reading\n", ctx->open_db);
-            return -1;
-        }
+            if (cdiff_write_adds(fh, add) == -1) {
+                fclose(fh);
+                logg("!cdiff_cmd_close: Can't write to %s\n", ctx->open_db);
+                return -1;
+            }
 
-        if (!(tmp = cli_gentemp("."))) {
-            logg("!cdiff_cmd_close: Can't generate temporary name\n");
             fclose(fh);
-            return -1;
         }
 
-        if (!(tmpfh = fopen(tmp, "wb"))) {
-            logg("!cdiff_cmd_close: Can't open file %s for writing\n", tmp);
-            fclose(fh);
-            free(tmp);
-            return -1;
-        }
+        cdiff_ctx_free(ctx);
+        return 0;
+    }
 
-        while (fgets(lbuf, lbuflen, fh)) {
-            lines++;
+    /*
+     * Patch the database in memory: unchanged runs of lines are copied
+     * straight from the loaded image and the result, including the added
+     * signatures, is written to the replacement file in a single pass.
+     */
+    if (cdiff_read_db(ctx->open_db, &data, &size) == -1)
+        return -1;
 
-            if (del && del->lineno == lines) {
-                if (strncmp(lbuf, del->str, strlen(del->str))) {
-                    fclose(fh);
-                    fclose(tmpfh);
-                    unlink(tmp);
-                    free(tmp);
-                    logg("!cdiff_cmd_close: Can't apply DEL at line %d of %s\n", lines, ctx->open_db);
-                    return -1;
-                }
-                del = del->next;
-                continue;
-            }
+    if (!(tmp = cli_gentemp("."))) {
+        logg("!cdiff_cmd_close: Can't generate temporary name\n");
+        free(data);
+        return -1;
+    }
 
-            if (xchg && xchg->lineno == lines) {
-                if (strncmp(lbuf, xchg->str, strlen(xchg->str))) {
-                    fclose(fh);
-                    fclose(tmpfh);
-                    unlink(tmp);
-                    free(tmp);
-                    logg("!cdiff_cmd_close: Can't apply XCHG at line %d of %s\n", lines, ctx->open_db);
-                    return -1;
-                }
+    if (!(tmpfh = fopen(tmp, "wb"))) {
+        logg("!cdiff_cmd_close: Can't open file %s for writing\n", tmp);
+        free(data);
+        free(tmp);
+        return -1;
+    }
 
-                if (fputs(xchg->str2, tmpfh) == EOF || fputc('\n', tmpfh) == EOF) {
-                    fclose(fh);
-                    fclose(tmpfh);
-                    unlink(tmp);
-                    logg("!cdiff_cmd_close: Can't write to %s\n", tmp);
-                    free(tmp);
-                    return -1;
-                }
-                xchg = xchg->next;
-                continue;
+    line = keep = data;
+    while (line < data + size && (del || xchg)) {
+        lines++;
+
+        if ((eol = memchr(line, '\n', data + size - line)))
+            linelen = eol - line + 1;
+        else
+            linelen = data + size - line;
+
+        if (del && del->lineno == lines) {
+            slen = strlen(del->str);
+            if (slen > linelen || memcmp(line, del->str, slen)) {
+                logg("!cdiff_cmd_close: Can't apply DEL at line %d of %s\n", lines, ctx->open_db);
+                goto done;
             }
 
-            if (fputs(lbuf, tmpfh) == EOF) {
-                fclose(fh);
-                fclose(tmpfh);
-                unlink(tmp);
+            if (line > keep && fwrite(keep, line - keep, 1, tmpfh) != 1) {
                 logg("!cdiff_cmd_close: Can't write to %s\n", tmp);
-                free(tmp);
-                return -1;
+                goto done;
+            }
+            keep = line + linelen;
+            del  = del->next;
+
+        } else if (xchg && xchg->lineno == lines) {
+            slen = strlen(xchg->str);
+            if (slen > linelen || memcmp(line, xchg->str, slen)) {
+                logg("!cdiff_cmd_close: Can't apply XCHG at line %d of %s\n", lines, ctx->open_db);
+                goto done;
             }
-        }
-
-        fclose(fh);
-        fclose(tmpfh);
-
-        if (del || xchg) {
-            logg("!cdiff_cmd_close: Not all DEL/XCHG have been executed\n");
-            unlink(tmp);
-            free(tmp);
-            return -1;
-        }
 
-        if (unlink(ctx->open_db) == -1) {
-            logg("!cdiff_cmd_close: Can't unlink %s\n", ctx->open_db);
-            unlink(tmp);
-            free(tmp);
-            return -1;
+            if ((line > keep && fwrite(keep, line - keep, 1, tmpfh) != 1) ||
+                fputs(xchg->str2, tmpfh) == EOF || fputc('\n', tmpfh) == EOF) {
+                logg("!cdiff_cmd_close: Can't write to %s\n", tmp);
+                goto done;
+            }
+            keep = line + linelen;
+            xchg = xchg->next;
         }
 
-        if (rename(tmp, ctx->open_db) == -1) {
-            logg("!cdiff_cmd_close: Can't rename %s to %s\n", tmp, ctx->open_db);
-            unlink(tmp);
-            free(tmp);
-            return -1;
-        }
+        line += linelen;
+    }
 
-        free(tmp);
+    if (del || xchg) {
+        logg("!cdiff_cmd_close: Not all DEL/XCHG have been executed\n");
+        goto done;
     }
 
-    if (add) {
+    if ((data + size > keep && fwrite(keep, data + size - keep, 1, tmpfh) != 1) ||
+        cdiff_write_adds(tmpfh, add) == -1) {
+        logg("!cdiff_cmd_close: Can't write to %s\n", tmp);
+        goto done;
+    }
 
-        if (!(fh = fopen(ctx->open_db, "ab"))) {
-            logg("!cdiff_cmd_close: Can't open file %s for appending\n", ctx->open_db);
-            return -1;
-        }
+    if (fclose(tmpfh) == EOF) {
+        tmpfh = NULL;
+        logg("!cdiff_cmd_close: Can't write to %s\n", tmp);
+        goto done;
+    }
+    tmpfh = NULL;
 
-        while (add) {
-            if (fputs(add->str, fh) == EOF || fputc('\n', fh) == EOF) {
-                fclose(fh);
-                logg("!cdiff_cmd_close: Can't write to %s\n", ctx->open_db);
-                return -1;
-            }
-            add = add->next;
-        }
+    if (unlink(ctx->open_db) == -1) {
+        logg("!cdiff_cmd_close: Can't unlink %s\n", ctx->open_db);
+        goto done;
+    }
 
-        fclose(fh);
+    if (rename(tmp, ctx->open_db) == -1) {
+        logg("!cdiff_cmd_close: Can't rename %s to %s\n", tmp, ctx->open_db);
+        goto done;
     }
 
+    free(tmp);
+    tmp = NULL;
     cdiff_ctx_free(ctx);
+    ret = 0;
 
-    return 0;
+done:
+    if (tmpfh)
+        fclose(tmpfh);
+    if (tmp) {
+        unlink(tmp);
+        free(tmp);
+    }
+    free(data);
+    return ret;
 }
 
 static int cdiff_cmd_move(const char *cmdstr, struct cdiff_ctx *ctx, char *lbuf, unsigned int lbuflen)
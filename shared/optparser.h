@@ -35,6 +35,7 @@
 #define OPT_CLAMBC          256
 #define OPT_CLAMONACC    512
 #define OPT_DEPRECATED	1024
+#define OPT_CLAMDLOAD       2048
 
 #define CLOPT_TYPE_STRING   1    /* quoted/regular string */
 #define CLOPT_TYPE_NUMBER   2    /* raw number */
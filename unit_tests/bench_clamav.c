@@ -0,0 +1,927 @@
+/*
+ *  Scanning throughput and latency benchmarks for libclamav.
+ *
+ *  Copyright (C) 2013-2020 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Every input is generated from a seeded PRNG: the signature databases,
+ * random data and a small corpus of PE, ZIP, OLE2, PDF and mail files with
+ * nested containers. Runs with the same seed and scale scan the same bytes
+ * against the same signatures, so results can be compared across commits.
+ *
+ * Usage: bench_clamav [-j] [-s seed] [-n scale] [-f file.ftm]
+ *   -j  print JSON instead of a table
+ *   -s  PRNG seed (default 1)
+ *   -n  multiply the iteration counts (default 1)
+ *   -f  also load these file type definitions, e.g. daily.ftm
+ */
+
+#if HAVE_CONFIG_H
+#include "clamav-config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../libclamav/clamav.h"
+#include "../libclamav/others.h"
+#include "../libclamav/matcher.h"
+#include "../libclamav/matcher-ac.h"
+#include "../libclamav/matcher-hash.h"
+#include "../libclamav/filtering.h"
+#include "../libclamav/fmap.h"
+#include "../libclamav/filetypes.h"
+#include "../libclamav/default.h"
+
+#define BENCH_NDB_SIGS 4000
+#define BENCH_HDB_SIGS 20000
+#define BENCH_HDB_SIZE 4096
+#define BENCH_RANDOM_SIZE (1024 * 1024)
+#define BENCH_FMAP_CHUNK 4096
+#define BENCH_FTM_SIZE 512
+#define BENCH_MAX_RESULTS 32
+
+struct bench_buf {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+};
+
+struct bench_result {
+    const char *name;
+    unsigned long iterations;
+    uint64_t bytes; /* per iteration, 0 if not meaningful */
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+};
+
+static uint64_t rng_state;
+static struct bench_result results[BENCH_MAX_RESULTS];
+static unsigned int nresults;
+
+static uint64_t rng_next(void)
+{
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void rng_fill(unsigned char *dst, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dst[i] = (unsigned char)(rng_next() >> 56);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "bench_clamav: %s\n", msg);
+    exit(1);
+}
+
+static void *xmalloc(size_t len)
+{
+    void *ptr = malloc(len ? len : 1);
+
+    if (!ptr)
+        die("out of memory");
+    return ptr;
+}
+
+/* ---------------------------------------------------------------------------
+ * Corpus generation
+ */
+
+static void buf_put(struct bench_buf *buf, const void *data, size_t len)
+{
+    if (buf->len + len > buf->size) {
+        size_t size = buf->size ? buf->size : 4096;
+
+        while (size < buf->len + len)
+            size *= 2;
+        buf->data = realloc(buf->data, size);
+        if (!buf->data)
+            die("out of memory");
+        buf->size = size;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void buf_str(struct bench_buf *buf, const char *str)
+{
+    buf_put(buf, str, strlen(str));
+}
+
+static void buf_le16(struct bench_buf *buf, uint16_t v)
+{
+    unsigned char b[2] = {v & 0xff, v >> 8};
+
+    buf_put(buf, b, 2);
+}
+
+static void buf_le32(struct bench_buf *buf, uint32_t v)
+{
+    unsigned char b[4] = {v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24};
+
+    buf_put(buf, b, 4);
+}
+
+static void buf_zero(struct bench_buf *buf, size_t len)
+{
+    static const unsigned char zeros[512];
+
+    while (len) {
+        size_t n = len > sizeof(zeros) ? sizeof(zeros) : len;
+
+        buf_put(buf, zeros, n);
+        len -= n;
+    }
+}
+
+static void buf_random(struct bench_buf *buf, size_t len)
+{
+    size_t off = buf->len;
+
+    buf_zero(buf, len);
+    rng_fill(buf->data + off, len);
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+/* PE32 executable with a .text and a .data section of random content */
+static void gen_pe(struct bench_buf *pe, uint32_t text_size, uint32_t data_size)
+{
+    unsigned char dos[0x80] = {'M', 'Z'};
+    unsigned int i;
+
+    put_le32(dos + 0x3c, sizeof(dos));
+    buf_put(pe, dos, sizeof(dos));
+
+    buf_str(pe, "PE");
+    buf_le16(pe, 0);
+    buf_le16(pe, 0x14c); /* i386 */
+    buf_le16(pe, 2);     /* sections */
+    buf_le32(pe, 0x5e000000);
+    buf_le32(pe, 0);
+    buf_le32(pe, 0);
+    buf_le16(pe, 0xe0);   /* optional header size */
+    buf_le16(pe, 0x0102); /* executable, 32 bit */
+
+    buf_le16(pe, 0x10b);
+    buf_le16(pe, 0);
+    buf_le32(pe, text_size);
+    buf_le32(pe, data_size);
+    buf_le32(pe, 0);
+    buf_le32(pe, 0x1000); /* entry point */
+    buf_le32(pe, 0x1000); /* base of code */
+    buf_le32(pe, 0x1000 + text_size);
+    buf_le32(pe, 0x400000); /* image base */
+    buf_le32(pe, 0x1000);   /* section alignment */
+    buf_le32(pe, 0x200);    /* file alignment */
+    buf_le16(pe, 4);
+    buf_le16(pe, 0);
+    buf_le16(pe, 0);
+    buf_le16(pe, 0);
+    buf_le16(pe, 4);
+    buf_le16(pe, 0);
+    buf_le32(pe, 0);
+    buf_le32(pe, 0x1000 + ((text_size + 0xfff) & ~0xfff) + ((data_size + 0xfff) & ~0xfff));
+    buf_le32(pe, 0x200); /* size of headers */
+    buf_le32(pe, 0);
+    buf_le16(pe, 2); /* GUI */
+    buf_le16(pe, 0);
+    buf_le32(pe, 0x100000);
+    buf_le32(pe, 0x1000);
+    buf_le32(pe, 0x100000);
+    buf_le32(pe, 0x1000);
+    buf_le32(pe, 0);
+    buf_le32(pe, 16);
+    buf_zero(pe, 16 * 8);
+
+    buf_str(pe, ".text");
+    buf_zero(pe, 3);
+    buf_le32(pe, text_size);
+    buf_le32(pe, 0x1000);
+    buf_le32(pe, text_size);
+    buf_le32(pe, 0x200);
+    buf_zero(pe, 12);
+    buf_le32(pe, 0x60000020);
+
+    buf_str(pe, ".data");
+    buf_zero(pe, 3);
+    buf_le32(pe, data_size);
+    buf_le32(pe, 0x1000 + ((text_size + 0xfff) & ~0xfff));
+    buf_le32(pe, data_size);
+    buf_le32(pe, 0x200 + text_size);
+    buf_zero(pe, 12);
+    buf_le32(pe, 0xc0000040);
+
+    buf_zero(pe, 0x200 - pe->len);
+    buf_random(pe, text_size);
+    buf_random(pe, data_size);
+    /* the entry point code every PE scanner looks at */
+    for (i = 0; i < 16 && i < text_size; i++)
+        pe->data[0x200 + i] = "\x55\x8b\xec\x83\xec\x10\x53\x56\x57\x33\xc0\x50\x50\x50\xe8\x00"[i];
+}
+
+struct zip_member {
+    const char *name;
+    const struct bench_buf *buf;
+};
+
+/* ZIP archive with stored members, so nested archives stay nested */
+static void gen_zip(struct bench_buf *zip, const struct zip_member *members, unsigned int count)
+{
+    uint32_t *offsets, *crcs, cd_start, cd_size;
+    unsigned int i;
+
+    offsets = xmalloc(count * sizeof(*offsets));
+    crcs    = xmalloc(count * sizeof(*crcs));
+
+    for (i = 0; i < count; i++) {
+        const struct bench_buf *m = members[i].buf;
+
+        offsets[i] = zip->len;
+        crcs[i]    = crc32(0, m->data, m->len);
+        buf_le32(zip, 0x04034b50);
+        buf_le16(zip, 20);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0); /* stored */
+        buf_le16(zip, 0);
+        buf_le16(zip, 0x21);
+        buf_le32(zip, crcs[i]);
+        buf_le32(zip, m->len);
+        buf_le32(zip, m->len);
+        buf_le16(zip, strlen(members[i].name));
+        buf_le16(zip, 0);
+        buf_str(zip, members[i].name);
+        buf_put(zip, m->data, m->len);
+    }
+
+    cd_start = zip->len;
+    for (i = 0; i < count; i++) {
+        const struct bench_buf *m = members[i].buf;
+
+        buf_le32(zip, 0x02014b50);
+        buf_le16(zip, 20);
+        buf_le16(zip, 20);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0x21);
+        buf_le32(zip, crcs[i]);
+        buf_le32(zip, m->len);
+        buf_le32(zip, m->len);
+        buf_le16(zip, strlen(members[i].name));
+        buf_le16(zip, 0);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0);
+        buf_le16(zip, 0);
+        buf_le32(zip, 0);
+        buf_le32(zip, offsets[i]);
+        buf_str(zip, members[i].name);
+    }
+
+    cd_size = zip->len - cd_start;
+    buf_le32(zip, 0x06054b50);
+    buf_le16(zip, 0);
+    buf_le16(zip, 0);
+    buf_le16(zip, count);
+    buf_le16(zip, count);
+    buf_le32(zip, cd_size);
+    buf_le32(zip, cd_start);
+    buf_le16(zip, 0);
+
+    free(offsets);
+    free(crcs);
+}
+
+static void ole2_dirent(unsigned char *ent, const char *name, uint8_t type, uint32_t child,
+                        uint32_t start, uint32_t size)
+{
+    size_t i, len = strlen(name);
+
+    memset(ent, 0, 128);
+    for (i = 0; i < len; i++)
+        ent[i * 2] = name[i];
+    ent[64] = (len + 1) * 2;
+    ent[66] = type;
+    ent[67] = 1; /* black */
+    put_le32(ent + 68, 0xffffffff);
+    put_le32(ent + 72, 0xffffffff);
+    put_le32(ent + 76, child);
+    put_le32(ent + 116, start);
+    put_le32(ent + 120, size);
+}
+
+/* OLE2 compound file holding one stream, large enough to skip the mini stream */
+static void gen_ole2(struct bench_buf *ole, const struct bench_buf *stream)
+{
+    unsigned char sector[512];
+    uint32_t nsect = (stream->len + 511) / 512, i;
+
+    if (nsect + 2 > 128)
+        die("OLE2 stream too large for a single FAT sector");
+
+    memset(sector, 0, sizeof(sector));
+    memcpy(sector, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", 8);
+    sector[24] = 0x3e;
+    sector[26] = 3;
+    sector[28] = 0xfe;
+    sector[29] = 0xff;
+    sector[30] = 9;
+    sector[32] = 6;
+    put_le32(sector + 44, 1);          /* FAT sectors */
+    put_le32(sector + 48, 1);          /* first directory sector */
+    put_le32(sector + 56, 4096);       /* mini stream cutoff */
+    put_le32(sector + 60, 0xfffffffe); /* no mini FAT */
+    put_le32(sector + 68, 0xfffffffe); /* no DIFAT sectors */
+    put_le32(sector + 76, 0);          /* FAT lives in sector 0 */
+    for (i = 1; i < 109; i++)
+        put_le32(sector + 76 + i * 4, 0xffffffff);
+    buf_put(ole, sector, sizeof(sector));
+
+    memset(sector, 0xff, sizeof(sector));
+    put_le32(sector, 0xfffffffd);     /* FAT sector */
+    put_le32(sector + 4, 0xfffffffe); /* directory */
+    for (i = 0; i < nsect; i++)
+        put_le32(sector + (2 + i) * 4, i + 1 < nsect ? 3 + i : 0xfffffffe);
+    buf_put(ole, sector, sizeof(sector));
+
+    ole2_dirent(sector, "Root Entry", 5, 1, 0xfffffffe, 0);
+    ole2_dirent(sector + 128, "Contents", 2, 0xffffffff, 2, stream->len);
+    ole2_dirent(sector + 256, "", 0, 0xffffffff, 0, 0);
+    ole2_dirent(sector + 384, "", 0, 0xffffffff, 0, 0);
+    buf_put(ole, sector, sizeof(sector));
+
+    buf_put(ole, stream->data, stream->len);
+    buf_zero(ole, nsect * 512 - stream->len);
+}
+
+/* PDF with a deflated content stream of generated text */
+static void gen_pdf(struct bench_buf *pdf, size_t text_size)
+{
+    static const char *words[] = {"alpha", "bravo", "charlie", "delta", "echo", "BT", "ET", "Tf", "Td", "Tj"};
+    struct bench_buf text = {0};
+    unsigned char *packed;
+    uLongf packed_len;
+    char hdr[128];
+
+    while (text.len < text_size) {
+        buf_str(&text, words[rng_next() % (sizeof(words) / sizeof(words[0]))]);
+        buf_str(&text, (rng_next() & 7) ? " " : "\n");
+    }
+
+    packed_len = compressBound(text.len);
+    packed     = xmalloc(packed_len);
+    if (compress(packed, &packed_len, text.data, text.len) != Z_OK)
+        die("compress() failed");
+
+    buf_str(pdf, "%PDF-1.4\n");
+    buf_str(pdf, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+    buf_str(pdf, "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+    buf_str(pdf, "3 0 obj\n<< /Type /Page /Parent 2 0 R /Contents 4 0 R >>\nendobj\n");
+    snprintf(hdr, sizeof(hdr), "4 0 obj\n<< /Length %lu /Filter /FlateDecode >>\nstream\n", (unsigned long)packed_len);
+    buf_str(pdf, hdr);
+    buf_put(pdf, packed, packed_len);
+    buf_str(pdf, "\nendstream\nendobj\ntrailer\n<< /Root 1 0 R >>\n%%EOF\n");
+
+    free(packed);
+    free(text.data);
+}
+
+/* RFC 2822 message with a text part and a base64 attachment */
+static void gen_mail(struct bench_buf *mail, const struct bench_buf *attachment)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i, col = 0;
+
+    buf_str(mail, "From: sender@example.com\nTo: rcpt@example.com\nSubject: benchmark\n"
+                  "MIME-Version: 1.0\nContent-Type: multipart/mixed; boundary=\"bench\"\n\n"
+                  "--bench\nContent-Type: text/plain\n\nGenerated message body.\n\n"
+                  "--bench\nContent-Type: application/octet-stream\n"
+                  "Content-Transfer-Encoding: base64\n"
+                  "Content-Disposition: attachment; filename=\"payload.exe\"\n\n");
+
+    for (i = 0; i < attachment->len; i += 3) {
+        uint32_t v   = attachment->data[i] << 16;
+        size_t left  = attachment->len - i;
+        char quad[4] = {'=', '=', '=', '='};
+
+        if (left > 1)
+            v |= attachment->data[i + 1] << 8;
+        if (left > 2)
+            v |= attachment->data[i + 2];
+        quad[0] = b64[(v >> 18) & 63];
+        quad[1] = b64[(v >> 12) & 63];
+        if (left > 1)
+            quad[2] = b64[(v >> 6) & 63];
+        if (left > 2)
+            quad[3] = b64[v & 63];
+        buf_put(mail, quad, 4);
+        col += 4;
+        if (col == 76) {
+            buf_str(mail, "\n");
+            col = 0;
+        }
+    }
+    buf_str(mail, "\n--bench--\n");
+}
+
+/* ---------------------------------------------------------------------------
+ * Signatures
+ */
+
+static void hexstr(char *dst, const unsigned char *src, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        dst[i * 2]     = hex[src[i] >> 4];
+        dst[i * 2 + 1] = hex[src[i] & 15];
+    }
+    dst[len * 2] = 0;
+}
+
+static void write_file(const char *path, const struct bench_buf *buf)
+{
+    FILE *fs = fopen(path, "wb");
+
+    if (!fs || fwrite(buf->data, 1, buf->len, fs) != buf->len || fclose(fs))
+        die("can't write the signature databases");
+}
+
+/*
+ * Body signatures go to both the AC and the BM matcher: a quarter are
+ * static strings, the rest use wildcards. None of them can match the
+ * random corpus by chance, so every scan is a full clean scan.
+ */
+static void gen_databases(const char *dir, unsigned char (*hashes)[16])
+{
+    struct bench_buf ndb = {0}, hdb = {0};
+    unsigned char bytes[16];
+    char line[256], a[33], b[33];
+    unsigned int i;
+
+    for (i = 0; i < BENCH_NDB_SIGS; i++) {
+        rng_fill(bytes, sizeof(bytes));
+        hexstr(a, bytes, 6);
+        hexstr(b, bytes + 8, 6);
+        switch (i & 3) {
+            case 0:
+                snprintf(line, sizeof(line), "Bench.Static.%u:0:*:%s%s\n", i, a, b);
+                break;
+            case 1:
+                snprintf(line, sizeof(line), "Bench.Wild.%u:0:*:%s??%s\n", i, a, b);
+                break;
+            case 2:
+                snprintf(line, sizeof(line), "Bench.Range.%u:0:*:%s{0-16}%s\n", i, a, b);
+                break;
+            default:
+                snprintf(line, sizeof(line), "Bench.Exe.%u:1:*:%s*%s\n", i, a, b);
+                break;
+        }
+        buf_str(&ndb, line);
+    }
+
+    for (i = 0; i < BENCH_HDB_SIGS; i++) {
+        rng_fill(hashes[i], 16);
+        hexstr(a, hashes[i], 16);
+        snprintf(line, sizeof(line), "%s:%u:Bench.Hash.%u\n", a, BENCH_HDB_SIZE, i);
+        buf_str(&hdb, line);
+    }
+
+    snprintf(line, sizeof(line), "%s/bench.ndb", dir);
+    write_file(line, &ndb);
+    snprintf(line, sizeof(line), "%s/bench.hdb", dir);
+    write_file(line, &hdb);
+
+    free(ndb.data);
+    free(hdb.data);
+}
+
+static struct cl_engine *load_engine(const char *dir, const char *ftm, int cache)
+{
+    struct cl_engine *engine;
+    unsigned int sigs = 0;
+
+    if (!(engine = cl_engine_new()))
+        die("cl_engine_new() failed");
+    if (!cache)
+        cl_engine_set_num(engine, CL_ENGINE_DISABLE_CACHE, 1);
+    if (cl_load(dir, engine, &sigs, CL_DB_STDOPT) != CL_SUCCESS)
+        die("cl_load() failed");
+    if (ftm && cl_load(ftm, engine, &sigs, CL_DB_STDOPT) != CL_SUCCESS)
+        die("can't load the file type definitions");
+    if (cl_engine_compile(engine) != CL_SUCCESS)
+        die("cl_engine_compile() failed");
+    return engine;
+}
+
+/* ---------------------------------------------------------------------------
+ * Measurement
+ */
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Sort the per-iteration times and keep the summary */
+static void record(const char *name, unsigned long iterations, uint64_t bytes, uint64_t *samples)
+{
+    struct bench_result *res;
+    unsigned long i;
+
+    if (nresults == BENCH_MAX_RESULTS)
+        die("too many benchmarks");
+
+    res             = &results[nresults++];
+    res->name       = name;
+    res->iterations = iterations;
+    res->bytes      = bytes;
+    res->total_ns   = 0;
+    for (i = 0; i < iterations; i++)
+        res->total_ns += samples[i];
+
+    qsort(samples, iterations, sizeof(*samples), cmp_u64);
+    res->p50_ns = samples[(iterations - 1) / 2];
+    res->p99_ns = samples[(iterations - 1) * 99 / 100];
+}
+
+static void bench_ac(const char *name, const struct cli_matcher *root, const struct bench_buf *buf,
+                     unsigned long iterations)
+{
+    struct cli_ac_data mdata;
+    const char *virname = NULL;
+    uint64_t *samples   = xmalloc(iterations * sizeof(*samples));
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start;
+
+        if (cli_ac_initdata(&mdata, root->ac_partsigs, root->ac_lsigs, root->ac_reloff_num, CLI_DEFAULT_AC_TRACKLEN) != CL_SUCCESS)
+            die("cli_ac_initdata() failed");
+        start = now_ns();
+        if (cli_ac_scanbuff(buf->data, buf->len, &virname, NULL, NULL, root, &mdata, 0, 0, NULL, AC_SCAN_VIR, NULL) == CL_VIRUS)
+            die("unexpected match in cli_ac_scanbuff()");
+        samples[i] = now_ns() - start;
+        cli_ac_freedata(&mdata);
+    }
+
+    record(name, iterations, buf->len, samples);
+    free(samples);
+}
+
+static void bench_filter(const struct cli_matcher *root, const struct bench_buf *buf, unsigned long iterations)
+{
+    struct filter_match_info info;
+    uint64_t *samples = xmalloc(iterations * sizeof(*samples));
+    unsigned long i;
+    volatile int found = 0;
+
+    if (!root->filter)
+        die("the AC root has no filter");
+
+    /* restart after every candidate so the whole buffer gets filtered */
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        size_t off     = 0;
+
+        while (off < buf->len && filter_search_ext(root->filter, buf->data + off, buf->len - off, &info) == 0) {
+            off += info.first_match + 1;
+            found++;
+        }
+        samples[i] = now_ns() - start;
+    }
+
+    record("filter_search_ext", iterations, buf->len, samples);
+    free(samples);
+}
+
+/* Every iteration looks up one batch of digests, half of them present */
+static void bench_hm(const struct cl_engine *engine, unsigned char (*hashes)[16], unsigned long iterations)
+{
+    const unsigned int batch = 1000;
+    unsigned char(*lookups)[16];
+    uint64_t *samples = xmalloc(iterations * sizeof(*samples));
+    const char *virname;
+    unsigned long i;
+    unsigned int j, hits = 0;
+
+    lookups = xmalloc(batch * sizeof(*lookups));
+    for (j = 0; j < batch; j++) {
+        if (j & 1)
+            rng_fill(lookups[j], 16);
+        else
+            memcpy(lookups[j], hashes[rng_next() % BENCH_HDB_SIGS], 16);
+    }
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+
+        for (j = 0; j < batch; j++)
+            hits += cli_hm_scan(lookups[j], BENCH_HDB_SIZE, &virname, engine->hm_hdb, CLI_HASH_MD5) == CL_VIRUS;
+        samples[i] = now_ns() - start;
+    }
+    if (hits != iterations * (batch / 2))
+        die("cli_hm_scan() missed known hashes");
+
+    record("cli_hm_scan x1000", iterations, 0, samples);
+    free(lookups);
+    free(samples);
+}
+
+/* Every iteration types one batch of buffers, half of them carry the magic of
+ * a random file type definition at its offset and the other half are random */
+static void bench_ftm(const struct cl_engine *engine, unsigned long iterations)
+{
+    const unsigned int batch = 1000;
+    const struct cli_ftype **ftypes, *ftype;
+    unsigned char *bufs;
+    uint64_t *samples = xmalloc(iterations * sizeof(*samples));
+    volatile unsigned int sum = 0;
+    unsigned int count = 0, j;
+    unsigned long i;
+
+    for (ftype = engine->ftypes; ftype; ftype = ftype->next)
+        count++;
+    ftypes = xmalloc(count * sizeof(*ftypes));
+    count  = 0;
+    for (ftype = engine->ftypes; ftype; ftype = ftype->next)
+        if (ftype->offset + ftype->length <= BENCH_FTM_SIZE)
+            ftypes[count++] = ftype;
+    if (!count)
+        die("the engine has no file type definitions");
+
+    bufs = xmalloc(batch * BENCH_FTM_SIZE);
+    rng_fill(bufs, batch * BENCH_FTM_SIZE);
+    for (j = 0; j < batch; j += 2) {
+        ftype = ftypes[rng_next() % count];
+        memcpy(bufs + j * BENCH_FTM_SIZE + ftype->offset, ftype->magic, ftype->length);
+    }
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+
+        for (j = 0; j < batch; j++)
+            sum += cli_compare_ftm_file(bufs + j * BENCH_FTM_SIZE, BENCH_FTM_SIZE, engine);
+        samples[i] = now_ns() - start;
+    }
+
+    record("cli_compare_ftm x1000", iterations, 0, samples);
+    free(ftypes);
+    free(bufs);
+    free(samples);
+}
+
+/* Map the file from disk each time and read it through in page sized chunks */
+static void bench_fmap(const char *path, size_t len, unsigned long iterations)
+{
+    uint64_t *samples = xmalloc(iterations * sizeof(*samples));
+    volatile unsigned char sum = 0;
+    unsigned long i;
+    size_t off;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        die("can't open the fmap test file");
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        fmap_t *map    = fmap(fd, 0, len, path);
+
+        if (!map)
+            die("fmap() failed");
+        for (off = 0; off < len; off += BENCH_FMAP_CHUNK) {
+            size_t want            = len - off < BENCH_FMAP_CHUNK ? len - off : BENCH_FMAP_CHUNK;
+            const unsigned char *p = fmap_need_off_once(map, off, want);
+
+            if (!p)
+                die("fmap_need_off_once() failed");
+            sum += p[0];
+        }
+        funmap(map);
+        samples[i] = now_ns() - start;
+    }
+
+    close(fd);
+    record("fmap read", iterations, len, samples);
+    free(samples);
+}
+
+static void bench_scanmap(const char *name, const struct cl_engine *engine, const struct bench_buf *buf,
+                          unsigned long iterations)
+{
+    struct cl_scan_options options;
+    uint64_t *samples = xmalloc(iterations * sizeof(*samples));
+    unsigned long i, scanned;
+    const char *virname = NULL;
+
+    memset(&options, 0, sizeof(options));
+    options.parse = ~0;
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        cl_fmap_t *map = cl_fmap_open_memory(buf->data, buf->len);
+
+        if (!map)
+            die("cl_fmap_open_memory() failed");
+        scanned = 0;
+        if (cl_scanmap_callback(map, name, &virname, &scanned, engine, &options, NULL) == CL_VIRUS)
+            die("unexpected detection in cl_scanmap_callback()");
+        cl_fmap_close(map);
+        samples[i] = now_ns() - start;
+    }
+
+    record(name, iterations, buf->len, samples);
+    free(samples);
+}
+
+static void print_table(void)
+{
+    unsigned int i;
+
+    printf("%-24s %10s %10s %12s %10s %10s\n", "benchmark", "iters", "GB/s", "ops/s", "p50 usec", "p99 usec");
+    for (i = 0; i < nresults; i++) {
+        const struct bench_result *r = &results[i];
+        double secs                  = r->total_ns / 1e9;
+        char gbps[32]                = "-";
+
+        if (r->bytes)
+            snprintf(gbps, sizeof(gbps), "%.3f", r->bytes * r->iterations / 1e9 / secs);
+        printf("%-24s %10lu %10s %12.1f %10.1f %10.1f\n", r->name, r->iterations, gbps,
+               r->iterations / secs, r->p50_ns / 1e3, r->p99_ns / 1e3);
+    }
+}
+
+static void print_json(unsigned long seed, unsigned long scale)
+{
+    unsigned int i;
+
+    printf("{\n  \"version\": \"%s\",\n  \"seed\": %lu,\n  \"scale\": %lu,\n  \"results\": [\n",
+           cl_retver(), seed, scale);
+    for (i = 0; i < nresults; i++) {
+        const struct bench_result *r = &results[i];
+        double secs                  = r->total_ns / 1e9;
+
+        printf("    {\"name\": \"%s\", \"iterations\": %lu, \"bytes\": %llu, \"gbps\": %.6f, "
+               "\"ops_per_sec\": %.3f, \"p50_usec\": %.3f, \"p99_usec\": %.3f}%s\n",
+               r->name, r->iterations, (unsigned long long)r->bytes,
+               r->bytes ? r->bytes * r->iterations / 1e9 / secs : 0.0,
+               r->iterations / secs, r->p50_ns / 1e3, r->p99_ns / 1e3,
+               i + 1 < nresults ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_buf random = {0}, pe = {0}, small_pe = {0}, pdf = {0}, ole2 = {0}, mail = {0}, inner = {0}, outer = {0};
+    struct zip_member members[3];
+    unsigned char(*hashes)[16];
+    struct cl_engine *engine, *cached;
+    unsigned long seed = 1, scale = 1;
+    char dir[] = "/tmp/clambench.XXXXXX";
+    char path[sizeof(dir) + 32];
+    const char *ftm = NULL;
+    int json = 0, i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j")) {
+            json = 1;
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            scale = strtoul(argv[++i], NULL, 10);
+            if (!scale)
+                scale = 1;
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            ftm = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [-j] [-s seed] [-n scale] [-f file.ftm]\n", argv[0]);
+            return 1;
+        }
+    }
+    rng_state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+    if (cl_init(CL_INIT_DEFAULT) != CL_SUCCESS)
+        die("cl_init() failed");
+    if (!mkdtemp(dir))
+        die("can't create a temporary directory");
+
+    hashes = xmalloc(BENCH_HDB_SIGS * sizeof(*hashes));
+    gen_databases(dir, hashes);
+
+    buf_random(&random, BENCH_RANDOM_SIZE);
+    gen_pe(&pe, 48 * 1024, 16 * 1024);
+    gen_pdf(&pdf, 64 * 1024);
+    gen_pe(&small_pe, 16 * 1024, 8 * 1024);
+    gen_ole2(&ole2, &small_pe);
+    gen_mail(&mail, &pe);
+
+    members[0].name = "payload.exe";
+    members[0].buf  = &pe;
+    members[1].name = "document.pdf";
+    members[1].buf  = &pdf;
+    gen_zip(&inner, members, 2);
+    members[0].name = "inner.zip";
+    members[0].buf  = &inner;
+    members[1].name = "document.doc";
+    members[1].buf  = &ole2;
+    members[2].name = "message.eml";
+    members[2].buf  = &mail;
+    gen_zip(&outer, members, 3);
+
+    snprintf(path, sizeof(path), "%s/random.bin", dir);
+    write_file(path, &random);
+
+    engine = load_engine(dir, ftm, 0);
+    cached = load_engine(dir, ftm, 1);
+
+    bench_ac("cli_ac_scanbuff", engine->root[0], &random, 20 * scale);
+    bench_ac("cli_ac_scanbuff pe", engine->root[1], &random, 20 * scale);
+    bench_filter(engine->root[0], &random, 100 * scale);
+    bench_hm(engine, hashes, 200 * scale);
+    bench_ftm(engine, 200 * scale);
+    bench_fmap(path, random.len, 100 * scale);
+    bench_scanmap("scan random", engine, &random, 20 * scale);
+    bench_scanmap("scan pe", engine, &pe, 200 * scale);
+    bench_scanmap("scan pdf", engine, &pdf, 100 * scale);
+    bench_scanmap("scan ole2", engine, &ole2, 100 * scale);
+    bench_scanmap("scan mail", engine, &mail, 100 * scale);
+    bench_scanmap("scan nested zip", engine, &outer, 50 * scale);
+    /* the first scan fills the cache, the rest are cache hits */
+    bench_scanmap("scan cached", cached, &outer, 1000 * scale);
+
+    if (json)
+        print_json(seed, scale);
+    else
+        print_table();
+
+    cl_engine_free(engine);
+    cl_engine_free(cached);
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/bench.ndb", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/bench.hdb", dir);
+    unlink(path);
+    rmdir(dir);
+
+    free(hashes);
+    free(random.data);
+    free(pe.data);
+    free(small_pe.data);
+    free(pdf.data);
+    free(ole2.data);
+    free(mail.data);
+    free(inner.data);
+    free(outer.data);
+
+    return 0;
+}
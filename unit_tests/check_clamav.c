@@ -20,8 +20,10 @@
 #include "../libclamav/clamav.h"
 #include "../libclamav/others.h"
 #include "../libclamav/matcher.h"
+#include "../libclamav/filetypes.h"
 #include "../libclamav/version.h"
 #include "../libclamav/dsig.h"
+#include "../libclamav/dlp.h"
 #include "../libclamav/fpu.h"
 #include "../platform.h"
 #include "checks.h"
@@ -506,6 +508,314 @@ static void engine_teardown(void)
     cl_engine_free(g_engine);
 }
 
+START_TEST(test_cl_telemetry)
+{
+    const char *virname = NULL;
+    char file[256];
+    unsigned long size;
+    unsigned long int scanned = 0;
+    char *report              = NULL;
+    long long scans;
+    int fd;
+    struct cl_scan_options options;
+
+    memset(&options, 0, sizeof(struct cl_scan_options));
+    options.parse |= ~0;
+
+    ck_assert_msg(cl_engine_get_telemetry(g_engine, &report, 0) == CL_EARG, "telemetry should be off by default");
+    ck_assert_msg(cl_engine_set_num(g_engine, CL_ENGINE_SCANS, 1) == CL_EARG, "scan counters are read only");
+    scans = cl_engine_get_num(g_engine, CL_ENGINE_SCANS, NULL);
+    ck_assert_msg(cl_engine_set_num(g_engine, CL_ENGINE_TELEMETRY, 1) == CL_SUCCESS, "enable telemetry");
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_TELEMETRY, NULL) == 1, "telemetry enabled");
+    ck_assert_msg(cl_engine_set_num(g_engine, CL_ENGINE_TELEMETRY_SIGNATURES, 5) == CL_SUCCESS, "enable signature profiling");
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_TELEMETRY_SIGNATURES, NULL) == 5, "signature profiling enabled");
+
+    fd = get_test_file(0, file, sizeof(file), &size);
+    cl_scandesc(fd, file, &virname, &scanned, g_engine, &options);
+    close(fd);
+
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_SCANS, NULL) == scans + 1, "scan not counted");
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_SCANNED_BYTES, NULL) >= (long long)size, "scanned bytes not counted");
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_CACHE_LOOKUPS, NULL) >= cl_engine_get_num(g_engine, CL_ENGINE_CACHE_HITS, NULL), "more cache hits than lookups");
+
+    ck_assert_msg(cl_engine_get_telemetry(g_engine, &report, 1) == CL_SUCCESS, "get telemetry");
+    ck_assert_msg(strstr(report, " scans 1\n") != NULL, "one scan expected: %s", report);
+    ck_assert_msg(strstr(report, "DEPTH: 0 files 1 ") != NULL, "top level file expected: %s", report);
+    free(report);
+
+    ck_assert_msg(cl_engine_get_telemetry(g_engine, &report, 0) == CL_SUCCESS, "get telemetry after reset");
+    ck_assert_msg(strstr(report, " scans 0\n") != NULL, "counters not reset: %s", report);
+    ck_assert_msg(strstr(report, "DEPTH:") == NULL, "counters not reset: %s", report);
+    ck_assert_msg(strstr(report, "SIGNATURE:") == NULL, "signature profile not reset: %s", report);
+    free(report);
+}
+END_TEST
+
+START_TEST(test_cl_budget_reserve)
+{
+    const char *virname       = NULL;
+    unsigned long int scanned = 0;
+    char file[256];
+    unsigned long size;
+    int fd, ret;
+    struct cl_scan_options options;
+
+    memset(&options, 0, sizeof(struct cl_scan_options));
+    options.parse |= ~0;
+
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_BUDGET_RESERVE, NULL) == 0, "budget reserve should be off by default");
+    ck_assert_msg(cl_engine_set_num(g_engine, CL_ENGINE_BUDGET_RESERVE, 91) == CL_EARG, "budget reserve above 90%% accepted");
+    ck_assert_msg(cl_engine_set_num(g_engine, CL_ENGINE_BUDGET_RESERVE, 90) == CL_SUCCESS, "set budget reserve");
+    ck_assert_msg(cl_engine_get_num(g_engine, CL_ENGINE_BUDGET_RESERVE, NULL) == 90, "budget reserve not set");
+
+    /* the test files are far below the limits, nothing may be skipped */
+    fd  = get_test_file(_i, file, sizeof(file), &size);
+    ret = cl_scandesc(fd, file, &virname, &scanned, g_engine, &options);
+    close(fd);
+    cl_engine_set_num(g_engine, CL_ENGINE_BUDGET_RESERVE, 0);
+
+    if (!FALSE_NEGATIVE) {
+        ck_assert_msg(ret == CL_VIRUS, "cl_scandesc failed for %s: %s", file, cl_strerror(ret));
+        ck_assert_msg(virname && !strcmp(virname, "ClamAV-Test-File.UNOFFICIAL"), "virusname: %s", virname);
+    }
+}
+END_TEST
+
+static void put_le16(unsigned char *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+/* Appends a stored member to @zip and its central directory entry to @cd */
+static void zip_add(unsigned char *zip, size_t *len, unsigned char *cd, size_t *cdlen, const char *name,
+                    const unsigned char *data, uint32_t size)
+{
+    size_t nlen = strlen(name);
+
+    memset(zip + *len, 0, 30);
+    put_le32(zip + *len, 0x04034b50);
+    put_le16(zip + *len + 4, 20);
+    put_le32(zip + *len + 18, size);
+    put_le32(zip + *len + 22, size);
+    put_le16(zip + *len + 26, nlen);
+    memcpy(zip + *len + 30, name, nlen);
+    memcpy(zip + *len + 30 + nlen, data, size);
+
+    memset(cd + *cdlen, 0, 46);
+    put_le32(cd + *cdlen, 0x02014b50);
+    put_le16(cd + *cdlen + 4, 20);
+    put_le16(cd + *cdlen + 6, 20);
+    put_le32(cd + *cdlen + 20, size);
+    put_le32(cd + *cdlen + 24, size);
+    put_le16(cd + *cdlen + 28, nlen);
+    put_le32(cd + *cdlen + 42, *len);
+    memcpy(cd + *cdlen + 46, name, nlen);
+
+    *len += 30 + nlen + size;
+    *cdlen += 46 + nlen;
+}
+
+struct budget_data {
+    char types[256];
+};
+
+static cl_error_t budget_pre_scan(int fd, const char *type, void *context)
+{
+    struct budget_data *d = context;
+
+    (void)fd;
+    strncat(d->types, type, sizeof(d->types) - strlen(d->types) - 2);
+    strcat(d->types, " ");
+    return CL_CLEAN;
+}
+
+START_TEST(test_cl_budget_reserve_skip)
+{
+    const char *virname       = NULL;
+    unsigned long int scanned = 0;
+    static unsigned char zip[8192], cd[512], text[4000], png[1000], exe[1024];
+    size_t len = 0, cdlen = 0, exelen;
+    long long maxscansize;
+    struct budget_data data;
+    cl_fmap_t *map;
+    int fd, ret;
+    struct cl_scan_options options;
+
+    memset(&options, 0, sizeof(struct cl_scan_options));
+    options.parse |= ~0;
+    memset(&data, 0, sizeof(data));
+
+    fd = open(OBJDIR "/../test/clam.exe", O_RDONLY);
+    ck_assert_msg(fd >= 0, "open clam.exe");
+    exelen = read(fd, exe, sizeof(exe));
+    close(fd);
+    ck_assert_msg(exelen > 0 && exelen < sizeof(exe), "read clam.exe");
+
+    /* a script typed as plain text, an image and an executable */
+    memset(text, 0, sizeof(text));
+    while (strlen((char *)text) + 12 < sizeof(text))
+        strcat((char *)text, "echo hello\r\n");
+    memset(png, 0, sizeof(png));
+    memcpy(png, "\x89PNG\r\n\x1a\n", 8);
+
+    zip_add(zip, &len, cd, &cdlen, "script.bat", text, strlen((char *)text));
+    zip_add(zip, &len, cd, &cdlen, "image.png", png, sizeof(png));
+    zip_add(zip, &len, cd, &cdlen, "clam.exe", exe, exelen);
+    memcpy(zip + len, cd, cdlen);
+    memset(zip + len + cdlen, 0, 22);
+    put_le32(zip + len + cdlen, 0x06054b50);
+    put_le16(zip + len + cdlen + 8, 3);
+    put_le16(zip + len + cdlen + 10, 3);
+    put_le32(zip + len + cdlen + 12, cdlen);
+    put_le32(zip + len + cdlen + 16, len);
+    len += cdlen + 22;
+
+    /* With a 60% reserve of 20000 bytes, images yield past 8000 bytes and
+     * text past 14000. The archive and the script take about 10000. */
+    maxscansize = cl_engine_get_num(g_engine, CL_ENGINE_MAX_SCANSIZE, NULL);
+    cl_engine_set_num(g_engine, CL_ENGINE_MAX_SCANSIZE, 20000);
+    cl_engine_set_num(g_engine, CL_ENGINE_BUDGET_RESERVE, 60);
+    cl_engine_set_clcb_pre_scan(g_engine, budget_pre_scan);
+
+    map = cl_fmap_open_memory(zip, len);
+    ck_assert_msg(!!map, "cl_fmap_open_memory failed");
+    ret = cl_scanmap_callback(map, "budget.zip", &virname, &scanned, g_engine, &options, &data);
+    cl_fmap_close(map);
+
+    cl_engine_set_clcb_pre_scan(g_engine, NULL);
+    cl_engine_set_num(g_engine, CL_ENGINE_BUDGET_RESERVE, 0);
+    cl_engine_set_num(g_engine, CL_ENGINE_MAX_SCANSIZE, maxscansize);
+
+    ck_assert_msg(strstr(data.types, "CL_TYPE_TEXT_ASCII") != NULL, "the script was skipped: %s", data.types);
+    ck_assert_msg(strstr(data.types, "CL_TYPE_PNG") == NULL, "the image was scanned: %s", data.types);
+    ck_assert_msg(strstr(data.types, "CL_TYPE_MSEXE") != NULL, "the executable was skipped: %s", data.types);
+    ck_assert_msg(ret == CL_VIRUS, "cl_scanmap_callback failed: %s", cl_strerror(ret));
+    ck_assert_msg(virname && !strcmp(virname, "ClamAV-Test-File.UNOFFICIAL"), "virusname: %s", virname);
+}
+END_TEST
+
+/* 1x1 grayscale PNG whose IDAT inflates to 64 bytes rather than 2 */
+static const unsigned char png_idat_overflow[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x7e, 0x9b, 0x55, 0x00, 0x00, 0x00,
+    0x0c, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0x60, 0xa0, 0x0c, 0x00,
+    0x00, 0x00, 0x40, 0x00, 0x01, 0x89, 0xc9, 0xaf, 0x43, 0x00, 0x00, 0x00,
+    0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82};
+
+/* The same image with 2 bytes of image data */
+static const unsigned char png_valid[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x7e, 0x9b, 0x55, 0x00, 0x00, 0x00,
+    0x0a, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0x60, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x01, 0xe5, 0x27, 0xde, 0xfc, 0x00, 0x00, 0x00, 0x00, 0x49,
+    0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82};
+
+static cl_error_t scan_buffer(const unsigned char *buf, size_t len, const char **virname)
+{
+    unsigned long int scanned = 0;
+    struct cl_scan_options options;
+    cl_fmap_t *map;
+    cl_error_t ret;
+
+    memset(&options, 0, sizeof(struct cl_scan_options));
+    options.parse |= ~0;
+    options.general |= CL_SCAN_GENERAL_HEURISTICS;
+
+    *virname = NULL;
+    map      = cl_fmap_open_memory(buf, len);
+    ck_assert_msg(!!map, "cl_fmap_open_memory failed");
+    ret = cl_scanmap_callback(map, "test.png", virname, &scanned, g_engine, &options, NULL);
+    cl_fmap_close(map);
+    return ret;
+}
+
+START_TEST(test_cl_png)
+{
+    const char *virname = NULL;
+    unsigned char buf[sizeof(png_valid) + 1024];
+    ssize_t exelen;
+    int fd, ret;
+
+    ret = scan_buffer(png_valid, sizeof(png_valid), &virname);
+    ck_assert_msg(ret == CL_CLEAN, "valid PNG detected: %s", virname);
+
+    ret = scan_buffer(png_idat_overflow, sizeof(png_idat_overflow), &virname);
+    ck_assert_msg(ret == CL_VIRUS, "IDAT larger than the image not detected: %s", cl_strerror(ret));
+    ck_assert_msg(virname && !strcmp(virname, "Heuristics.PNG.CVE-2010-1205"), "virusname: %s", virname);
+
+    /* whatever follows IEND is scanned as a file of its own */
+    fd = open(OBJDIR "/../test/clam.exe", O_RDONLY);
+    ck_assert_msg(fd >= 0, "open clam.exe");
+    exelen = read(fd, buf + sizeof(png_valid), sizeof(buf) - sizeof(png_valid));
+    close(fd);
+    ck_assert_msg(exelen > 0 && (size_t)exelen < sizeof(buf) - sizeof(png_valid), "read clam.exe");
+    memcpy(buf, png_valid, sizeof(png_valid));
+
+    ret = scan_buffer(buf, sizeof(png_valid) + exelen, &virname);
+    ck_assert_msg(ret == CL_VIRUS, "data after IEND not scanned: %s", cl_strerror(ret));
+    ck_assert_msg(virname && !strcmp(virname, "ClamAV-Test-File.UNOFFICIAL"), "virusname: %s", virname);
+}
+END_TEST
+
+struct trace_data {
+    unsigned calls;
+    char buf[4096];
+};
+
+static void trace_cb(const char *trace, size_t len, void *context)
+{
+    struct trace_data *d = context;
+
+    d->calls++;
+    if (len >= sizeof(d->buf))
+        len = sizeof(d->buf) - 1;
+    memcpy(d->buf, trace, len);
+    d->buf[len] = '\0';
+}
+
+START_TEST(test_cl_trace)
+{
+    const char *virname       = NULL;
+    unsigned long int scanned = 0;
+    char file[256];
+    unsigned long size;
+    struct trace_data data;
+    int fd;
+    struct cl_scan_options options;
+
+    memset(&options, 0, sizeof(struct cl_scan_options));
+    options.parse |= ~0;
+    memset(&data, 0, sizeof(data));
+
+    cl_engine_set_clcb_trace(g_engine, trace_cb);
+    fd = get_test_file(0, file, sizeof(file), &size);
+    cl_scandesc_callback(fd, file, &virname, &scanned, g_engine, &options, &data);
+    close(fd);
+    cl_engine_set_clcb_trace(g_engine, NULL);
+
+    ck_assert_msg(data.calls == 1, "trace callback called %u times", data.calls);
+    ck_assert_msg(!strncmp(data.buf, "{\"id\":", 6), "trace line expected: %s", data.buf);
+    ck_assert_msg(strstr(data.buf, "\"parent\":0,\"depth\":0,") != NULL, "top level object expected: %s", data.buf);
+    ck_assert_msg(strstr(data.buf, "\"path\":\"") != NULL, "path of the scanned file expected: %s", data.buf);
+    ck_assert_msg(data.buf[strlen(data.buf) - 1] == '\n', "trace lines must be terminated: %s", data.buf);
+
+    data.calls = 0;
+    fd         = get_test_file(0, file, sizeof(file), &size);
+    cl_scandesc_callback(fd, file, &virname, &scanned, g_engine, &options, &data);
+    close(fd);
+    ck_assert_msg(data.calls == 0, "trace callback called after it was unset");
+}
+END_TEST
+
 static int get_test_file(int i, char *file, unsigned fsize, unsigned long *size)
 {
     int fd;
@@ -706,6 +1016,11 @@ static Suite *test_cl_suite(void)
     tcase_add_loop_test(tc_cl_scan, test_cl_scanmap_callback_handle_allscan, 0, expect);
     tcase_add_loop_test(tc_cl_scan, test_cl_scanmap_callback_mem, 0, expect);
     tcase_add_loop_test(tc_cl_scan, test_cl_scanmap_callback_mem_allscan, 0, expect);
+    tcase_add_test(tc_cl_scan, test_cl_telemetry);
+    tcase_add_test(tc_cl_scan, test_cl_trace);
+    tcase_add_loop_test(tc_cl_scan, test_cl_budget_reserve, 0, expect);
+    tcase_add_test(tc_cl_scan, test_cl_budget_reserve_skip);
+    tcase_add_test(tc_cl_scan, test_cl_png);
 
     user_timeout = getenv("T");
     if (user_timeout) {
@@ -983,6 +1298,98 @@ START_TEST(test_sanitize_path)
 }
 END_TEST
 
+/* the filetype index must pick the same definition as walking the list */
+static cli_file_t ftm_first_match(const struct cli_ftype *ftype, const unsigned char *buf, size_t buflen)
+{
+    for (; ftype; ftype = ftype->next)
+        if (ftype->offset + ftype->length <= buflen && !memcmp(buf + ftype->offset, ftype->magic, ftype->length))
+            return ftype->type;
+
+    return CL_TYPE_ERROR;
+}
+
+START_TEST(test_ftm_index)
+{
+    struct cl_engine *engine;
+    const struct cli_ftype *ftype;
+    unsigned char buf[2048];
+    size_t len;
+    cli_file_t expected, got;
+
+    engine = cl_engine_new();
+    ck_assert_msg(engine != NULL, "cl_engine_new failed");
+    ck_assert_msg(cl_engine_compile(engine) == CL_SUCCESS, "cl_engine_compile failed");
+    ck_assert_msg(engine->ftindex != NULL && engine->ptindex != NULL, "filetype index was not built");
+
+    for (ftype = engine->ftypes; ftype; ftype = ftype->next) {
+        if (ftype->offset + ftype->length > sizeof(buf))
+            continue;
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf + ftype->offset, ftype->magic, ftype->length);
+
+        for (len = ftype->offset + ftype->length; len + 1 >= ftype->offset + ftype->length; len--) {
+            expected = ftm_first_match(engine->ftypes, buf, len);
+            got      = cli_compare_ftm_file(buf, len, engine);
+            if (expected != CL_TYPE_ERROR)
+                ck_assert_msg(got == expected, "%s: got %s, expected %s (len %u)", ftype->tname, cli_ftname(got), cli_ftname(expected), (unsigned)len);
+            if (!len)
+                break;
+        }
+    }
+
+    for (ftype = engine->ptypes; ftype; ftype = ftype->next) {
+        if (ftype->offset + ftype->length > sizeof(buf))
+            continue;
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf + ftype->offset, ftype->magic, ftype->length);
+
+        expected = ftm_first_match(engine->ptypes, buf, sizeof(buf));
+        got      = cli_compare_ftm_partition(buf, sizeof(buf), engine);
+        ck_assert_msg(got == expected, "%s: got %s, expected %s", ftype->tname, cli_ftname(got), cli_ftname(expected));
+    }
+
+    cl_engine_free(engine);
+}
+END_TEST
+
+/* dlp_scan() must agree with the per-buffer counters, however the data is split */
+START_TEST(test_dlp_scan)
+{
+    static const char text[] =
+        "card 4111111111111111, card 4111 1111 1111 1111, not a card 4111111111111112\n"
+        "ssn 123-45-6789 and 123456789, not ssn 666-12-3456, 1234567890 or 000-00-0000\n"
+        "4012888888881881 078-05-1120 219099999";
+    const unsigned char *buf = (const unsigned char *)text;
+    size_t len               = sizeof(text) - 1;
+    struct dlp_scan scan;
+    size_t split;
+
+    for (split = 0; split <= len; split++) {
+        memset(&scan, 0, sizeof(scan));
+        scan.what = DLP_CC | DLP_SSN_NORMAL | DLP_SSN_STRIPPED;
+
+        /* the second call sees the byte before the split as context */
+        ck_assert(dlp_scan(&scan, buf, len, 0, 0, split) == 0);
+        ck_assert(dlp_scan(&scan, buf + (split ? split - 1 : 0), len - (split ? split - 1 : 0),
+                           split ? split - 1 : 0, split ? 1 : 0, len - (split ? split - 1 : 0)) == 0);
+
+        ck_assert_msg(scan.cc_count == (unsigned int)dlp_get_cc_count(buf, len, 0),
+                      "split %u: %u credit cards, expected %d", (unsigned)split, scan.cc_count, dlp_get_cc_count(buf, len, 0));
+        ck_assert_msg(scan.ssn_count == (unsigned int)dlp_get_ssn_count(buf, len),
+                      "split %u: %u SSNs, expected %d", (unsigned)split, scan.ssn_count, dlp_get_ssn_count(buf, len));
+    }
+
+    ck_assert_msg(dlp_get_cc_count(buf, len, 0) == 3, "dlp_get_cc_count: %d", dlp_get_cc_count(buf, len, 0));
+    ck_assert_msg(dlp_get_ssn_count(buf, len) == 4, "dlp_get_ssn_count: %d", dlp_get_ssn_count(buf, len));
+
+    memset(&scan, 0, sizeof(scan));
+    scan.what    = DLP_SSN_NORMAL;
+    scan.min_ssn = 2;
+    ck_assert(dlp_scan(&scan, buf, len, 0, 0, len) == 1);
+    ck_assert_msg(scan.ssn_count == 2, "stopped after %u SSNs", scan.ssn_count);
+}
+END_TEST
+
 static Suite *test_cli_suite(void)
 {
     Suite *s               = suite_create("cli");
@@ -1002,6 +1409,8 @@ static Suite *test_cli_suite(void)
 
     suite_add_tcase(s, tc_cli_assorted);
     tcase_add_test(tc_cli_assorted, test_sanitize_path);
+    tcase_add_test(tc_cli_assorted, test_ftm_index);
+    tcase_add_test(tc_cli_assorted, test_dlp_scan);
 
     return s;
 }
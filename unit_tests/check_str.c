@@ -38,6 +38,9 @@
 #include "../libclamav/mbox.h"
 #include "../libclamav/message.h"
 #include "../libclamav/jsparse/textbuf.h"
+#include "../libclamav/textdet.h"
+#include "../libclamav/textnorm.h"
+#include "../libclamav/rtf.h"
 #include "checks.h"
 
 START_TEST(test_unescape_simple)
@@ -252,10 +255,221 @@ START_TEST(test_u16_u8)
 END_TEST
 
 
+/* byte at a time versions of the textdet.c and textnorm.c loops */
+static int ref_isctrl(unsigned char c)
+{
+    return c < 7 || c == 0x0b || (c >= 0x0e && c < 0x20 && c != 0x1b) || c == 0x7f;
+}
+
+static cli_file_t ref_texttype(const unsigned char *buf, size_t len)
+{
+    size_t i, j, following;
+    int gotone = 0;
+
+    for (i = 0; i < len && !ref_isctrl(buf[i]); i++)
+        ;
+    if (i == len && !(len >= 3 && !memcmp(buf, "\xef\xbb\xbf", 3)))
+        return CL_TYPE_TEXT_ASCII;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] < 0x80) {
+            if (ref_isctrl(buf[i]))
+                return CL_TYPE_ANY;
+            continue;
+        }
+        if (buf[i] < 0xc0 || buf[i] >= 0xfe)
+            return CL_TYPE_ANY;
+        for (following = 1; buf[i] & (0x40 >> following); following++)
+            ;
+        for (j = 0; j < following; j++) {
+            if (++i >= len)
+                return gotone ? CL_TYPE_TEXT_UTF8 : CL_TYPE_ANY;
+            if ((buf[i] & 0xc0) != 0x80)
+                return CL_TYPE_ANY;
+        }
+        gotone = 1;
+    }
+    return gotone ? CL_TYPE_TEXT_UTF8 : CL_TYPE_ANY;
+}
+
+static size_t ref_normalize(const unsigned char *buf, size_t len, unsigned char *out, size_t out_len, size_t *consumed)
+{
+    size_t i, pos = 0;
+    int space = 0;
+
+    for (i = 0; i < len && pos < out_len; i++) {
+        if (buf[i] == ' ' || (buf[i] >= '\t' && buf[i] <= '\r')) {
+            if (!space)
+                out[pos++] = ' ';
+            space = 1;
+        } else if (buf[i] > ' ' && buf[i] < 0x80) {
+            out[pos++] = (buf[i] >= 'A' && buf[i] <= 'Z') ? buf[i] + 32 : buf[i];
+            space      = 0;
+        }
+    }
+    *consumed = i;
+    return pos;
+}
+
+/* random text, mostly printable so the word at a time paths get used */
+static void fill_text(unsigned char *buf, size_t len, uint32_t *seed, int flavour)
+{
+    static const char *rare = "\t\n\r \x1b\x07\x01\x7f\x85\xe9";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        *seed = *seed * 1103515245 + 12345;
+        if ((*seed >> 16) % 64 || !flavour) {
+            buf[i] = 0x20 + (*seed >> 8) % 0x5f;
+        } else if (flavour == 2 && i + 2 < len) {
+            memcpy(buf + i, "\xe2\x82\xac", 3);
+            i += 2;
+        } else {
+            buf[i] = rare[(*seed >> 8) % strlen(rare)];
+        }
+    }
+}
+
+START_TEST(test_texttype)
+{
+    unsigned char buf[300];
+    uint32_t seed = _i;
+    size_t len;
+    cli_file_t expected, got;
+    int flavour;
+
+    for (flavour = 0; flavour < 3; flavour++) {
+        for (len = 0; len < sizeof(buf); len += 7) {
+            fill_text(buf, len, &seed, flavour);
+            expected = ref_texttype(buf, len);
+            got      = cli_texttype(buf, len);
+            if (expected == CL_TYPE_ANY)
+                ck_assert_msg(got != CL_TYPE_TEXT_ASCII && got != CL_TYPE_TEXT_UTF8, "len %u: got %d, expected neither ASCII nor UTF-8", (unsigned)len, got);
+            else
+                ck_assert_msg(got == expected, "len %u: got %d, expected %d", (unsigned)len, got, expected);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_text_normalize)
+{
+    unsigned char buf[300], out[256], expected[256];
+    struct text_norm_state state;
+    uint32_t seed = _i;
+    size_t len, out_len, consumed, written;
+    int flavour;
+
+    for (flavour = 0; flavour < 3; flavour++) {
+        for (len = 0; len < sizeof(buf); len += 5) {
+            fill_text(buf, len, &seed, flavour);
+            out_len = (len * 7 + _i) % sizeof(out);
+
+            written = ref_normalize(buf, len, expected, out_len, &consumed);
+            text_normalize_init(&state, out, out_len);
+            ck_assert_msg(text_normalize_buffer(&state, buf, len) == consumed, "len %u: consumed", (unsigned)len);
+            ck_assert_msg(state.out_pos == written && !memcmp(out, expected, written), "len %u: normalized text differs", (unsigned)len);
+        }
+    }
+}
+END_TEST
+
+/* byte at a time version of the rtf.c \objdata hex decoding */
+static int ref_nibble(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static size_t ref_unhex(const unsigned char *buf, size_t len, unsigned char *out)
+{
+    size_t i, pos = 0;
+    int high = -1, n;
+
+    for (i = 0; i < len; i++) {
+        if ((n = ref_nibble(buf[i])) < 0)
+            continue;
+        if (high < 0) {
+            high = n;
+        } else {
+            out[pos++] = high << 4 | n;
+            high       = -1;
+        }
+    }
+    return pos;
+}
+
+/* Decodes @buf in two calls split at @split, as the RTF parser may */
+static void check_unhex(const unsigned char *buf, size_t len, size_t split)
+{
+    unsigned char out[160], expected[160];
+    size_t written, got, i, digits;
+    int has_partial = 0, partial = 0, last;
+
+    written = ref_unhex(buf, len, expected);
+    got     = cli_rtf_unhex(buf, split, out, &has_partial, &partial);
+    got += cli_rtf_unhex(buf + split, len - split, out + got, &has_partial, &partial);
+    ck_assert_msg(got == written, "len %u split %u: %u bytes decoded, expected %u", (unsigned)len, (unsigned)split, (unsigned)got, (unsigned)written);
+    ck_assert_msg(!memcmp(out, expected, written), "len %u split %u: decoded data differs", (unsigned)len, (unsigned)split);
+
+    /* an odd digit is kept for the next call */
+    for (i = len, last = -1; i > 0 && last < 0; i--)
+        last = ref_nibble(buf[i - 1]);
+    for (i = 0, digits = 0; i < len; i++)
+        digits += ref_nibble(buf[i]) >= 0;
+    ck_assert_msg(has_partial == (digits & 1), "len %u split %u: has_partial %d", (unsigned)len, (unsigned)split, has_partial);
+    if (has_partial)
+        ck_assert_msg(partial == last << 4, "len %u split %u: partial %x", (unsigned)len, (unsigned)split, partial);
+}
+
+/* characters right next to the hex ranges, whitespace and bytes above 0x7f */
+static const unsigned char unhex_noise[] = "/:@G`g \n\r\t\x00\xb0\xb9\xc1\xc6\xe1\xe6\xff";
+
+START_TEST(test_rtf_unhex)
+{
+    static const char *hex = "0123456789abcdefABCDEF";
+    unsigned char buf[256];
+    uint32_t seed = _i;
+    size_t len, i, pos, split;
+
+    /* a non-hex byte at each position of a word that would take the fast path */
+    for (pos = 0; pos < 8; pos++) {
+        for (i = 0; i < sizeof(unhex_noise) - 1; i++) {
+            memcpy(buf, "4142434445464748494a4B4c4D4e4F50", 32);
+            buf[8 + pos] = unhex_noise[i];
+            for (split = 0; split <= 32; split += 3)
+                check_unhex(buf, 32, split);
+        }
+    }
+
+    /* a digit pair split by whitespace */
+    memcpy(buf, "0123 4567\n89ab\r\ncdef", 22);
+    for (split = 0; split <= 22; split++)
+        check_unhex(buf, 22, split);
+
+    /* random mixed case hex with some noise */
+    for (len = 0; len < sizeof(buf); len += 7) {
+        for (i = 0; i < len; i++) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % 16)
+                buf[i] = hex[(seed >> 8) % 22];
+            else
+                buf[i] = unhex_noise[(seed >> 8) % (sizeof(unhex_noise) - 1)];
+        }
+        check_unhex(buf, len, (seed >> 4) % (len + 1));
+    }
+}
+END_TEST
+
 Suite *test_str_suite(void)
 {
     Suite *s = suite_create("str");
-    TCase *tc_cli_unescape, *tc_tbuf, *tc_str, *tc_decodeline;
+    TCase *tc_cli_unescape, *tc_tbuf, *tc_str, *tc_decodeline, *tc_text;
 
     tc_cli_unescape = tcase_create("cli_unescape");
     suite_add_tcase(s, tc_cli_unescape);
@@ -282,5 +496,11 @@ Suite *test_str_suite(void)
 
     tcase_add_loop_test(tc_decodeline, test_base64, 0, sizeof(base64tests) / sizeof(base64tests[0]));
 
+    tc_text = tcase_create("text detection and normalization");
+    suite_add_tcase(s, tc_text);
+    tcase_add_loop_test(tc_text, test_texttype, 0, 16);
+    tcase_add_loop_test(tc_text, test_text_normalize, 0, 16);
+    tcase_add_loop_test(tc_text, test_rtf_unhex, 0, 16);
+
     return s;
 }